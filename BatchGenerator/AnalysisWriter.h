@@ -0,0 +1,134 @@
+#pragma once
+
+#include "RenderAnalyser.h"
+#include "ToneEngine.h"
+
+#include <cmath>
+#include <cstdint>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <string>
+
+// Runs a RenderAnalyser over every block on its way to another writer and,
+// when the writer is closed, writes the results to a JSON sidecar:
+//
+//   {"analysis_version":1,"complete":true,"seconds":...,"sample_rate":...,
+//    "sample_peak_dbfs":...,"true_peak_dbtp":...,"rms_dbfs":[l,r],
+//    "integrated_lufs":...,"saturation":{"samples_past_knee":...,
+//    "samples_driven_hard":...},"probes":[{"seconds":...,
+//    "target_pulse_hz":...,"measured_pulse_hz":...,"pulse_ok":...,
+//    "target_carrier_hz":...,"measured_carrier_hz":...,"carrier_ok":...}],
+//    "frequencies_on_target":true}
+//
+// Levels of silence are null. Saturation counts are of sample values over
+// both channels. "complete" is false when the render stopped early.
+//
+// It sees the engine's output, before any fade, resampling or mixed-in
+// inputs. Fades and resampling don't change what the sidecar claims about
+// the session, but a mix would make its levels wrong for the file, so the
+// batch tool doesn't analyse mixed renders.
+class AnalysisWriter : public juce::AudioFormatWriter {
+public:
+  // firstSample is where the render starts on the session's timeline and
+  // numSamples how many it should write.
+  AnalysisWriter(std::unique_ptr<juce::AudioFormatWriter> w,
+                 const SessionSettings &settings, int64_t firstSample,
+                 int64_t numSamples, std::string sidecar)
+      : juce::AudioFormatWriter(nullptr, "Analysis", w->getSampleRate(),
+                                (unsigned)w->getNumChannels(), 32),
+        writer(std::move(w)),
+        analyser(settings.sampleRate,
+                 settings.mode == EntrainmentMode::Binaural,
+                 targetsOf(settings),
+                 (double)firstSample / settings.sampleRate),
+        expectedSamples(numSamples), sidecarPath(std::move(sidecar)) {
+    usesFloatingPointData = true;
+  }
+
+  ~AnalysisWriter() override {
+    // The output is finished first, so the sidecar never describes a file
+    // that isn't complete on disk.
+    writer.reset();
+    writeSidecar(analyser.finish());
+  }
+
+  bool write(const int **samples, int numSamples) override {
+    auto channels = reinterpret_cast<const float *const *>(samples);
+    analyser.process(channels[0], channels[numChannels > 1 ? 1 : 0],
+                     numSamples);
+    return writer->writeFromFloatArrays(channels, (int)numChannels,
+                                        numSamples);
+  }
+
+  bool flush() override { return writer->flush(); }
+
+private:
+  // What the engine was asked to play: the fixed frequencies, or the
+  // journey's lanes sampled the way the engine samples them.
+  static RenderAnalyser::TargetFn targetsOf(const SessionSettings &s) {
+    if (!s.isJourney) {
+      const RenderAnalyser::Target fixed{s.pulseFreq, s.carrierFreq};
+      return [fixed](double) { return fixed; };
+    }
+    const double ticksPerSecond = s.sampleRate / (double)s.controlInterval;
+    auto pulse = std::make_shared<ControlLane>();
+    auto carrier = std::make_shared<ControlLane>();
+    pulse->prepare(s.journey.pulse, s.pulseFreq, ticksPerSecond);
+    carrier->prepare(s.journey.carrier, s.carrierFreq, ticksPerSecond);
+    return [pulse, carrier, ticksPerSecond](double seconds) {
+      const auto tick = (int64_t)std::floor(seconds * ticksPerSecond);
+      return RenderAnalyser::Target{pulse->valueAt(tick),
+                                    carrier->valueAt(tick)};
+    };
+  }
+
+  static juce::var level(double db) {
+    return db > -1000.0 ? juce::var(db) : juce::var();
+  }
+
+  void writeSidecar(const RenderAnalyser::Report &r) {
+    auto *saturation = new juce::DynamicObject();
+    saturation->setProperty("samples_past_knee",
+                            (juce::int64)r.samplesPastKnee);
+    saturation->setProperty("samples_driven_hard",
+                            (juce::int64)r.samplesDrivenHard);
+
+    juce::Array<juce::var> probes;
+    bool onTarget = true;
+    for (const auto &p : r.probes) {
+      auto *probe = new juce::DynamicObject();
+      probe->setProperty("seconds", p.seconds);
+      probe->setProperty("target_pulse_hz", p.target.pulse);
+      probe->setProperty("measured_pulse_hz", p.measured.pulse);
+      probe->setProperty("pulse_ok", p.pulseOk);
+      probe->setProperty("target_carrier_hz", p.target.carrier);
+      probe->setProperty("measured_carrier_hz", p.measured.carrier);
+      probe->setProperty("carrier_ok", p.carrierOk);
+      probes.add(juce::var(probe));
+      onTarget &= p.pulseOk && p.carrierOk;
+    }
+
+    auto *root = new juce::DynamicObject();
+    root->setProperty("analysis_version", 1);
+    root->setProperty("complete", r.samples == expectedSamples);
+    root->setProperty("seconds", (double)r.samples / sampleRate);
+    root->setProperty("sample_rate", sampleRate);
+    root->setProperty("sample_peak_dbfs", level(r.samplePeakDb));
+    root->setProperty("true_peak_dbtp", level(r.truePeakDb));
+    root->setProperty("rms_dbfs", juce::Array<juce::var>{level(r.rmsDb[0]),
+                                                         level(r.rmsDb[1])});
+    root->setProperty("integrated_lufs", level(r.integratedLufs));
+    root->setProperty("saturation", juce::var(saturation));
+    root->setProperty("probes", probes);
+    root->setProperty("frequencies_on_target", onTarget);
+
+    juce::File(juce::String(sidecarPath))
+        .replaceWithText(juce::JSON::toString(juce::var(root)));
+  }
+
+  std::unique_ptr<juce::AudioFormatWriter> writer;
+  RenderAnalyser analyser;
+  int64_t expectedSamples;
+  std::string sidecarPath;
+};
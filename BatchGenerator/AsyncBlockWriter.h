@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Moves sample conversion and disk writes onto their own thread so they
+// overlap with synthesis. The producer renders straight into blocks from a
+// preallocated ring and publishes them; the writer thread hands them to the
+// AudioFormatWriter in order. Ring positions are plain atomics, so while
+// neither side is starved the handoff takes no locks. A side only parks on
+// the condition variable when the ring is full (the disk is behind) or
+// empty (the DSP is behind).
+//
+// One producer thread only.
+class AsyncBlockWriter {
+public:
+  AsyncBlockWriter(juce::AudioFormatWriter &w, int numChannels, int blockSize,
+                   int queueDepth)
+      : writer(w), lengths(static_cast<size_t>(queueDepth)),
+        afterWrites(static_cast<size_t>(queueDepth)) {
+    for (int i = 0; i < queueDepth; ++i)
+      blocks.emplace_back(numChannels, blockSize);
+    thread = std::thread([this] { run(); });
+  }
+
+  ~AsyncBlockWriter() { finish(); }
+
+  int getBlockSize() const { return blocks.front().getNumSamples(); }
+
+  // The next free block, waiting while the ring is full.
+  juce::AudioBuffer<float> &acquire() {
+    const uint64_t next = produced.load();
+    if (next - consumed.load() == blocks.size()) {
+      ++producerWaits;
+      park(producerParked,
+           [&] { return next - consumed.load() < blocks.size(); });
+    }
+    return blocks[next % blocks.size()];
+  }
+
+  // Publishes the first numSamples of the block from acquire(). If given,
+  // afterWrite runs on the writer thread once the block has been written;
+  // returning false counts as a failed write.
+  void push(int numSamples, std::function<bool()> afterWrite = {}) {
+    const uint64_t next = produced.load();
+    lengths[next % blocks.size()] = numSamples;
+    afterWrites[next % blocks.size()] = std::move(afterWrite);
+    produced.store(next + 1);
+    wake(consumerParked);
+  }
+
+  // Drains the ring and stops the writer thread. Returns false if any write
+  // failed.
+  bool finish() {
+    if (thread.joinable()) {
+      done.store(true);
+      wake(consumerParked);
+      thread.join();
+    }
+    return !failed;
+  }
+
+  // How often each side found the other one behind.
+  int64_t getProducerWaits() const { return producerWaits; }
+  int64_t getWriterWaits() const { return writerWaits; }
+
+private:
+  void run() {
+    for (;;) {
+      const uint64_t next = consumed.load();
+      if (next == produced.load()) {
+        if (done.load() && next == produced.load())
+          return;
+        ++writerWaits;
+        park(consumerParked,
+             [&] { return next != produced.load() || done.load(); });
+        continue;
+      }
+      const size_t slot = next % blocks.size();
+      if (!writer.writeFromAudioSampleBuffer(blocks[slot], 0, lengths[slot]))
+        failed = true;
+      if (auto &afterWrite = afterWrites[slot]) {
+        if (!failed && !afterWrite())
+          failed = true;
+        afterWrite = nullptr;
+      }
+      consumed.store(next + 1);
+      wake(producerParked);
+    }
+  }
+
+  // The parked flag is set under the mutex before the condition is checked
+  // again, and the other side reads it after publishing, so a wake-up can't
+  // slip in between the check and the wait.
+  template <typename Ready>
+  void park(std::atomic<bool> &parked, Ready ready) {
+    std::unique_lock<std::mutex> lock(mutex);
+    parked.store(true);
+    wakeUp.wait(lock, ready);
+    parked.store(false);
+  }
+
+  void wake(std::atomic<bool> &parked) {
+    if (parked.load()) {
+      std::lock_guard<std::mutex> lock(mutex);
+      wakeUp.notify_all();
+    }
+  }
+
+  juce::AudioFormatWriter &writer;
+  std::vector<juce::AudioBuffer<float>> blocks;
+  std::vector<int> lengths;
+  std::vector<std::function<bool()>> afterWrites;
+  std::atomic<uint64_t> produced{0}, consumed{0};
+  std::atomic<bool> done{false};
+  std::atomic<bool> producerParked{false}, consumerParked{false};
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  int64_t producerWaits = 0, writerWaits = 0;
+  bool failed = false;
+  std::thread thread;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PcmPacker.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Command line pieces shared by IsochronicBatchGen and IsochronicBounce, so
+// both take times and sample formats the same way.
+
+// Too few arguments to describe a render.
+struct UsageError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// Status messages go to stderr while the audio itself goes to stdout.
+inline bool audioOnStdout = false;
+
+inline std::ostream &console() { return audioOnStdout ? std::cerr : std::cout; }
+
+// Seconds from "90", "90s", "45m", "7h" or a percentage of the session
+// ("75%"). Throws on an unknown unit.
+inline double parseTime(const std::string &text, double sessionSeconds) {
+  size_t used = 0;
+  double seconds = std::stod(text, &used);
+  std::string unit = text.substr(used);
+  if (unit == "%")
+    return seconds / 100.0 * sessionSeconds;
+  if (unit == "m")
+    return seconds * 60.0;
+  if (unit == "h")
+    return seconds * 3600.0;
+  if (!unit.empty() && unit != "s")
+    throw std::runtime_error("unknown time unit '" + unit + "'");
+  return seconds;
+}
+
+// "s16", "s24", "s32" or "f32". Throws on anything else.
+inline PcmFormat parseSampleFormat(const std::string &name) {
+  if (name == "s16")
+    return PcmFormat::S16;
+  if (name == "s24")
+    return PcmFormat::S24;
+  if (name == "s32")
+    return PcmFormat::S32;
+  if (name == "f32")
+    return PcmFormat::F32;
+  throw std::runtime_error("Unknown sample format " + name);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+#include <vector>
+
+// Sends one rendered timeline to several writers of different lengths.
+// Every target gets the shared prefix; a target is closed (and its header
+// finalised) as soon as it has its length. An optional fade-out is applied
+// to a copy of the block, so the other targets never see it.
+//
+// It takes float data, so the render loops can use it like any other
+// AudioFormatWriter and each target still converts to its own format.
+class FanOutWriter : public juce::AudioFormatWriter {
+public:
+  FanOutWriter(double sampleRateHz, unsigned channels)
+      : juce::AudioFormatWriter(nullptr, "Fan-out", sampleRateHz, channels,
+                                32) {
+    usesFloatingPointData = true;
+  }
+
+  // The last fadeSamples of this target ramp down to silence.
+  void addTarget(std::unique_ptr<juce::AudioFormatWriter> writer,
+                 int64_t lengthSamples, int64_t fadeSamples) {
+    targets.push_back({std::move(writer), lengthSamples,
+                       std::min(fadeSamples, lengthSamples)});
+  }
+
+  bool write(const int **samples, int numSamples) override {
+    auto channels = reinterpret_cast<const float *const *>(samples);
+    const int numCh = static_cast<int>(numChannels);
+    bool ok = true;
+    for (auto &t : targets) {
+      if (!t.writer)
+        continue;
+      int n = static_cast<int>(
+          std::min<int64_t>(numSamples, t.length - position));
+      if (n <= 0) {
+        t.writer.reset();
+        continue;
+      }
+      const int64_t fadeStart = t.length - t.fade;
+      if (position + n <= fadeStart) {
+        ok &= t.writer->writeFromFloatArrays(channels, numCh, n);
+      } else {
+        fadeScratch.setSize(numCh, n, false, false, true);
+        for (int c = 0; c < numCh; ++c) {
+          float *out = fadeScratch.getWritePointer(c);
+          for (int i = 0; i < n; ++i) {
+            int64_t s = position + i;
+            float gain = 1.0f;
+            if (s >= fadeStart)
+              gain = (t.fade > 1) ? (float)(t.length - 1 - s) /
+                                        (float)(t.fade - 1)
+                                  : 0.0f;
+            out[i] = channels[c][i] * gain;
+          }
+        }
+        ok &= t.writer->writeFromFloatArrays(
+            fadeScratch.getArrayOfReadPointers(), numCh, n);
+      }
+      if (position + n >= t.length)
+        t.writer.reset();
+    }
+    position += numSamples;
+    return ok;
+  }
+
+  bool flush() override {
+    bool ok = true;
+    for (auto &t : targets)
+      if (t.writer)
+        ok &= t.writer->flush();
+    return ok;
+  }
+
+private:
+  struct Target {
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    int64_t length;
+    int64_t fade;
+  };
+
+  std::vector<Target> targets;
+  juce::AudioBuffer<float> fadeScratch;
+  int64_t position = 0;
+};
@@ -0,0 +1,831 @@
+#include "FlacWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr int maxPartitionOrder = 6;
+constexpr int maxFixedOrder = 4;
+
+uint8_t crc8Table[256];
+uint16_t crc16Table[256];
+
+struct CrcTables {
+  CrcTables() {
+    for (int i = 0; i < 256; ++i) {
+      uint8_t c8 = static_cast<uint8_t>(i);
+      for (int b = 0; b < 8; ++b)
+        c8 = static_cast<uint8_t>((c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1);
+      crc8Table[i] = c8;
+      uint16_t c16 = static_cast<uint16_t>(i << 8);
+      for (int b = 0; b < 8; ++b)
+        c16 = static_cast<uint16_t>((c16 & 0x8000) ? (c16 << 1) ^ 0x8005
+                                                   : c16 << 1);
+      crc16Table[i] = c16;
+    }
+  }
+} const crcTables;
+
+uint8_t crc8(const uint8_t *data, size_t length) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < length; ++i)
+    crc = crc8Table[crc ^ data[i]];
+  return crc;
+}
+
+uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < length; ++i)
+    crc = static_cast<uint16_t>((crc << 8) ^ crc16Table[(crc >> 8) ^ data[i]]);
+  return crc;
+}
+
+// MSB-first bit packer.
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &destination) : out(destination) {}
+
+  void write(uint32_t value, int bits) {
+    if (bits == 0)
+      return;
+    if (bits < 32)
+      value &= (1u << bits) - 1;
+    acc = (acc << bits) | value;
+    fill += bits;
+    if (fill >= 32) {
+      fill -= 32;
+      const uint32_t word = static_cast<uint32_t>(acc >> fill);
+      const uint8_t bytes[4] = {
+          static_cast<uint8_t>(word >> 24), static_cast<uint8_t>(word >> 16),
+          static_cast<uint8_t>(word >> 8), static_cast<uint8_t>(word)};
+      out.insert(out.end(), bytes, bytes + 4);
+    }
+  }
+
+  // Emits the whole bytes still in the accumulator; call on a byte
+  // boundary before reading the output.
+  void sync() {
+    while (fill >= 8) {
+      fill -= 8;
+      out.push_back(static_cast<uint8_t>(acc >> fill));
+    }
+  }
+
+  void writeSigned(int32_t value, int bits) {
+    write(static_cast<uint32_t>(value), bits);
+  }
+
+  // q zeros and a one.
+  void writeUnary(uint32_t q) {
+    while (q >= 24) {
+      write(0, 24);
+      q -= 24;
+    }
+    write(1, static_cast<int>(q) + 1);
+  }
+
+  void alignToByte() {
+    if (fill % 8 != 0)
+      write(0, 8 - fill % 8);
+  }
+
+private:
+  std::vector<uint8_t> &out;
+  uint64_t acc = 0;
+  int fill = 0;
+};
+
+void writeUtf8(BitWriter &bits, uint64_t value) {
+  if (value < 0x80) {
+    bits.write(static_cast<uint32_t>(value), 8);
+    return;
+  }
+  int extra = 1;
+  while (extra < 6 && value >= (uint64_t(1) << (6 + 5 * extra)))
+    ++extra;
+  // Lead byte: extra + 1 ones, a zero, then the top bits.
+  const uint32_t lead = (0xFF00u >> (extra + 1)) & 0xFF;
+  bits.write(lead | static_cast<uint32_t>(value >> (6 * extra)), 8);
+  for (int i = extra - 1; i >= 0; --i)
+    bits.write(0x80 | static_cast<uint32_t>((value >> (6 * i)) & 0x3F), 8);
+}
+
+// How one channel of a frame is coded.
+struct SubframePlan {
+  enum Kind { Constant, Verbatim, Fixed } kind = Verbatim;
+  int order = 0;
+  int partitionOrder = 0;
+  int riceParams[1 << maxPartitionOrder];
+  uint64_t bits = 0;
+};
+
+inline uint32_t zigzag(int32_t r) {
+  return (static_cast<uint32_t>(r) << 1) ^ static_cast<uint32_t>(r >> 31);
+}
+
+// Residual of a fixed predictor of `order` at sample i >= order.
+inline int32_t fixedResidual(const int32_t *x, int i, int order) {
+  switch (order) {
+  case 0:
+    return x[i];
+  case 1:
+    return x[i] - x[i - 1];
+  case 2:
+    return x[i] - 2 * x[i - 1] + x[i - 2];
+  case 3:
+    return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+  default:
+    return x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+  }
+}
+
+// Cheap first look at a channel: is it constant, which fixed predictor
+// leaves the smallest residual, and roughly how many bits that costs.
+struct ChannelAnalysis {
+  bool constant = false;
+  int order = 0;
+  uint64_t estimatedBits = 0;
+};
+
+ChannelAnalysis analyseChannel(const int32_t *x, int n, int bps) {
+  ChannelAnalysis analysis;
+  bool constant = true;
+  for (int i = 1; i < n && constant; ++i)
+    constant = (x[i] == x[0]);
+  if (constant) {
+    analysis.constant = true;
+    analysis.estimatedBits = 8 + uint64_t(bps);
+    return analysis;
+  }
+
+  // Order with the smallest total residual, as the reference encoder does
+  // for its fixed predictors. Residuals of up to 25-bit input fit in 32
+  // bits, which keeps the loop vectorisable.
+  uint64_t error[maxFixedOrder + 1] = {0};
+  for (int i = maxFixedOrder; i < n; ++i) {
+    int32_t e0 = x[i];
+    int32_t e1 = e0 - x[i - 1];
+    int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+    int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+    int32_t e4 = e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+    error[0] += static_cast<uint32_t>(e0 < 0 ? -e0 : e0);
+    error[1] += static_cast<uint32_t>(e1 < 0 ? -e1 : e1);
+    error[2] += static_cast<uint32_t>(e2 < 0 ? -e2 : e2);
+    error[3] += static_cast<uint32_t>(e3 < 0 ? -e3 : e3);
+    error[4] += static_cast<uint32_t>(e4 < 0 ? -e4 : e4);
+  }
+  const int maxOrder = std::min(maxFixedOrder, n - 1);
+  for (int o = 1; o <= maxOrder; ++o)
+    if (error[o] < error[analysis.order])
+      analysis.order = o;
+
+  // Rice cost of residuals with this mean magnitude (zigzag doubles it).
+  const uint64_t count = static_cast<uint64_t>(n - analysis.order);
+  const uint64_t sum = 2 * error[analysis.order];
+  int k = 0;
+  while (k < 30 && (count << (k + 1)) < sum)
+    ++k;
+  analysis.estimatedBits = std::min<uint64_t>(
+      8 + uint64_t(n) * uint64_t(bps),
+      8 + uint64_t(analysis.order) * uint64_t(bps) + count * uint64_t(k + 1) +
+          (sum >> k));
+  return analysis;
+}
+
+SubframePlan planSubframe(const int32_t *x, int n, int bps,
+                          const ChannelAnalysis &analysis,
+                          std::vector<uint32_t> &residual) {
+  SubframePlan plan;
+  plan.kind = SubframePlan::Verbatim;
+  plan.bits = 8 + uint64_t(n) * uint64_t(bps);
+  if (analysis.constant) {
+    plan.kind = SubframePlan::Constant;
+    plan.bits = 8 + uint64_t(bps);
+    return plan;
+  }
+  const int order = analysis.order;
+
+  residual.resize(static_cast<size_t>(n));
+  for (int i = order; i < n; ++i)
+    residual[(size_t)i] = zigzag(fixedResidual(x, i, order));
+
+  // Partition order and Rice parameters from the estimate
+  // count * (k + 1) + sum >> k, which is within `count` bits of exact.
+  // Sums for the finest partitioning are added pairwise for the coarser
+  // ones.
+  int finest = 0;
+  while (finest < maxPartitionOrder && n % (2 << finest) == 0 &&
+         n / (2 << finest) > order)
+    ++finest;
+  uint64_t sums[2 << maxPartitionOrder];
+  {
+    const int partitions = 1 << finest;
+    const int length = n / partitions;
+    uint64_t *level = sums + partitions;
+    for (int part = 0; part < partitions; ++part) {
+      uint64_t sum = 0;
+      for (int i = std::max(order, part * length); i < (part + 1) * length;
+           ++i)
+        sum += residual[(size_t)i];
+      level[part] = sum;
+    }
+    // sums[(1 << p) + part] holds partition `part` at order p.
+    for (int p = finest - 1; p >= 0; --p)
+      for (int part = 0; part < (1 << p); ++part)
+        sums[(1 << p) + part] = sums[(2 << p) + 2 * part] +
+                                sums[(2 << p) + 2 * part + 1];
+  }
+
+  SubframePlan best;
+  best.bits = ~uint64_t(0);
+  for (int p = 0; p <= finest; ++p) {
+    const int partitions = 1 << p;
+    SubframePlan candidate;
+    candidate.kind = SubframePlan::Fixed;
+    candidate.order = order;
+    candidate.partitionOrder = p;
+    uint64_t bits = 8 + uint64_t(order) * uint64_t(bps) + 6;
+    bool wideParams = false;
+    for (int part = 0; part < partitions; ++part) {
+      const uint64_t sum = sums[partitions + part];
+      const uint64_t count =
+          static_cast<uint64_t>(n / partitions - (part == 0 ? order : 0));
+      // The estimate is convex in k; start near log2(mean) and walk.
+      int k = 0;
+      while (k < 30 && (count << (k + 1)) < sum)
+        ++k;
+      auto estimate = [&](int kk) {
+        return count * uint64_t(kk + 1) + (sum >> kk);
+      };
+      while (k > 0 && estimate(k - 1) <= estimate(k))
+        --k;
+      while (k < 30 && estimate(k + 1) < estimate(k))
+        ++k;
+      candidate.riceParams[part] = k;
+      wideParams = wideParams || k > 14;
+      bits += estimate(k);
+    }
+    bits += uint64_t(partitions) * (wideParams ? 5 : 4);
+    if (bits < best.bits) {
+      best = candidate;
+      best.bits = bits;
+    }
+  }
+  if (best.bits < plan.bits)
+    return best;
+  return plan;
+}
+
+void writeSubframe(BitWriter &bits, const SubframePlan &plan,
+                   const int32_t *x, int n, int bps,
+                   const std::vector<uint32_t> &residual) {
+  switch (plan.kind) {
+  case SubframePlan::Constant:
+    bits.write(0x00, 8);
+    bits.writeSigned(x[0], bps);
+    return;
+  case SubframePlan::Verbatim:
+    bits.write(0x02, 8);
+    for (int i = 0; i < n; ++i)
+      bits.writeSigned(x[i], bps);
+    return;
+  case SubframePlan::Fixed:
+    break;
+  }
+
+  // Type 001xxx with the order, no wasted bits.
+  bits.write(static_cast<uint32_t>((0x08 | plan.order) << 1), 8);
+  for (int i = 0; i < plan.order; ++i)
+    bits.writeSigned(x[i], bps);
+
+  const int partitions = 1 << plan.partitionOrder;
+  bool wideParams = false;
+  for (int part = 0; part < partitions; ++part)
+    wideParams = wideParams || plan.riceParams[part] > 14;
+  bits.write(wideParams ? 1 : 0, 2);
+  bits.write(static_cast<uint32_t>(plan.partitionOrder), 4);
+  for (int part = 0; part < partitions; ++part) {
+    const int k = plan.riceParams[part];
+    bits.write(static_cast<uint32_t>(k), wideParams ? 5 : 4);
+    const int start = (part == 0) ? plan.order : part * (n / partitions);
+    const int end = (part + 1) * (n / partitions);
+    for (int i = start; i < end; ++i) {
+      const uint32_t u = residual[(size_t)i];
+      const uint32_t q = u >> k;
+      // Unary quotient and remainder in one go when they fit.
+      if (q + 1 + static_cast<uint32_t>(k) <= 32) {
+        bits.write((1u << k) | (u & ((1u << k) - 1)),
+                   static_cast<int>(q) + 1 + k);
+      } else {
+        bits.writeUnary(q);
+        bits.write(u, k);
+      }
+    }
+  }
+}
+
+// MD5 (RFC 1321) compression of one 64-byte block, unrolled so every
+// rotation is a constant.
+inline uint32_t rotl(uint32_t x, int c) { return (x << c) | (x >> (32 - c)); }
+
+inline uint32_t md5F(uint32_t x, uint32_t y, uint32_t z) {
+  return z ^ (x & (y ^ z));
+}
+inline uint32_t md5G(uint32_t x, uint32_t y, uint32_t z) {
+  return y ^ (z & (x ^ y));
+}
+inline uint32_t md5H(uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; }
+inline uint32_t md5I(uint32_t x, uint32_t y, uint32_t z) {
+  return y ^ (x | ~z);
+}
+
+template <uint32_t (*F)(uint32_t, uint32_t, uint32_t)>
+inline void md5Step(uint32_t &a, uint32_t b, uint32_t c, uint32_t d,
+                    uint32_t x, uint32_t t, int r) {
+  a = b + rotl(a + F(b, c, d) + x + t, r);
+}
+
+void md5Transform(uint32_t state[4], const uint8_t block[64]) {
+  uint32_t w[16];
+  for (int i = 0; i < 16; ++i)
+    w[i] = uint32_t(block[4 * i]) | uint32_t(block[4 * i + 1]) << 8 |
+           uint32_t(block[4 * i + 2]) << 16 | uint32_t(block[4 * i + 3]) << 24;
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+  md5Step<md5F>(a, b, c, d, w[0], 0xd76aa478, 7);
+  md5Step<md5F>(d, a, b, c, w[1], 0xe8c7b756, 12);
+  md5Step<md5F>(c, d, a, b, w[2], 0x242070db, 17);
+  md5Step<md5F>(b, c, d, a, w[3], 0xc1bdceee, 22);
+  md5Step<md5F>(a, b, c, d, w[4], 0xf57c0faf, 7);
+  md5Step<md5F>(d, a, b, c, w[5], 0x4787c62a, 12);
+  md5Step<md5F>(c, d, a, b, w[6], 0xa8304613, 17);
+  md5Step<md5F>(b, c, d, a, w[7], 0xfd469501, 22);
+  md5Step<md5F>(a, b, c, d, w[8], 0x698098d8, 7);
+  md5Step<md5F>(d, a, b, c, w[9], 0x8b44f7af, 12);
+  md5Step<md5F>(c, d, a, b, w[10], 0xffff5bb1, 17);
+  md5Step<md5F>(b, c, d, a, w[11], 0x895cd7be, 22);
+  md5Step<md5F>(a, b, c, d, w[12], 0x6b901122, 7);
+  md5Step<md5F>(d, a, b, c, w[13], 0xfd987193, 12);
+  md5Step<md5F>(c, d, a, b, w[14], 0xa679438e, 17);
+  md5Step<md5F>(b, c, d, a, w[15], 0x49b40821, 22);
+
+  md5Step<md5G>(a, b, c, d, w[1], 0xf61e2562, 5);
+  md5Step<md5G>(d, a, b, c, w[6], 0xc040b340, 9);
+  md5Step<md5G>(c, d, a, b, w[11], 0x265e5a51, 14);
+  md5Step<md5G>(b, c, d, a, w[0], 0xe9b6c7aa, 20);
+  md5Step<md5G>(a, b, c, d, w[5], 0xd62f105d, 5);
+  md5Step<md5G>(d, a, b, c, w[10], 0x02441453, 9);
+  md5Step<md5G>(c, d, a, b, w[15], 0xd8a1e681, 14);
+  md5Step<md5G>(b, c, d, a, w[4], 0xe7d3fbc8, 20);
+  md5Step<md5G>(a, b, c, d, w[9], 0x21e1cde6, 5);
+  md5Step<md5G>(d, a, b, c, w[14], 0xc33707d6, 9);
+  md5Step<md5G>(c, d, a, b, w[3], 0xf4d50d87, 14);
+  md5Step<md5G>(b, c, d, a, w[8], 0x455a14ed, 20);
+  md5Step<md5G>(a, b, c, d, w[13], 0xa9e3e905, 5);
+  md5Step<md5G>(d, a, b, c, w[2], 0xfcefa3f8, 9);
+  md5Step<md5G>(c, d, a, b, w[7], 0x676f02d9, 14);
+  md5Step<md5G>(b, c, d, a, w[12], 0x8d2a4c8a, 20);
+
+  md5Step<md5H>(a, b, c, d, w[5], 0xfffa3942, 4);
+  md5Step<md5H>(d, a, b, c, w[8], 0x8771f681, 11);
+  md5Step<md5H>(c, d, a, b, w[11], 0x6d9d6122, 16);
+  md5Step<md5H>(b, c, d, a, w[14], 0xfde5380c, 23);
+  md5Step<md5H>(a, b, c, d, w[1], 0xa4beea44, 4);
+  md5Step<md5H>(d, a, b, c, w[4], 0x4bdecfa9, 11);
+  md5Step<md5H>(c, d, a, b, w[7], 0xf6bb4b60, 16);
+  md5Step<md5H>(b, c, d, a, w[10], 0xbebfbc70, 23);
+  md5Step<md5H>(a, b, c, d, w[13], 0x289b7ec6, 4);
+  md5Step<md5H>(d, a, b, c, w[0], 0xeaa127fa, 11);
+  md5Step<md5H>(c, d, a, b, w[3], 0xd4ef3085, 16);
+  md5Step<md5H>(b, c, d, a, w[6], 0x04881d05, 23);
+  md5Step<md5H>(a, b, c, d, w[9], 0xd9d4d039, 4);
+  md5Step<md5H>(d, a, b, c, w[12], 0xe6db99e5, 11);
+  md5Step<md5H>(c, d, a, b, w[15], 0x1fa27cf8, 16);
+  md5Step<md5H>(b, c, d, a, w[2], 0xc4ac5665, 23);
+
+  md5Step<md5I>(a, b, c, d, w[0], 0xf4292244, 6);
+  md5Step<md5I>(d, a, b, c, w[7], 0x432aff97, 10);
+  md5Step<md5I>(c, d, a, b, w[14], 0xab9423a7, 15);
+  md5Step<md5I>(b, c, d, a, w[5], 0xfc93a039, 21);
+  md5Step<md5I>(a, b, c, d, w[12], 0x655b59c3, 6);
+  md5Step<md5I>(d, a, b, c, w[3], 0x8f0ccc92, 10);
+  md5Step<md5I>(c, d, a, b, w[10], 0xffeff47d, 15);
+  md5Step<md5I>(b, c, d, a, w[1], 0x85845dd1, 21);
+  md5Step<md5I>(a, b, c, d, w[8], 0x6fa87e4f, 6);
+  md5Step<md5I>(d, a, b, c, w[15], 0xfe2ce6e0, 10);
+  md5Step<md5I>(c, d, a, b, w[6], 0xa3014314, 15);
+  md5Step<md5I>(b, c, d, a, w[13], 0x4e0811a1, 21);
+  md5Step<md5I>(a, b, c, d, w[4], 0xf7537e82, 6);
+  md5Step<md5I>(d, a, b, c, w[11], 0xbd3af235, 10);
+  md5Step<md5I>(c, d, a, b, w[2], 0x2ad7d2bb, 15);
+  md5Step<md5I>(b, c, d, a, w[9], 0xeb86d391, 21);
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+}
+
+void putBigEndian(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; --i)
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+} // namespace
+
+FlacWriter::FlacWriter(juce::OutputStream *stream, double sampleRateHz,
+                       unsigned channels, unsigned bits,
+                       int64_t expectedSamples, int numThreads)
+    : juce::AudioFormatWriter(stream, "FLAC", sampleRateHz, channels, bits),
+      pending(static_cast<size_t>(channels) * frameLength) {
+  // The frame header's 4-bit rate codes (RFC 9639, 9.1.2). Codes 12 to 14
+  // would need extra header bytes, so other rates use 0, "as in
+  // STREAMINFO".
+  switch (static_cast<int>(sampleRateHz)) {
+  case 88200:
+    sampleRateCode = 1;
+    break;
+  case 176400:
+    sampleRateCode = 2;
+    break;
+  case 192000:
+    sampleRateCode = 3;
+    break;
+  case 8000:
+    sampleRateCode = 4;
+    break;
+  case 16000:
+    sampleRateCode = 5;
+    break;
+  case 22050:
+    sampleRateCode = 6;
+    break;
+  case 24000:
+    sampleRateCode = 7;
+    break;
+  case 32000:
+    sampleRateCode = 8;
+    break;
+  case 44100:
+    sampleRateCode = 9;
+    break;
+  case 48000:
+    sampleRateCode = 10;
+    break;
+  case 96000:
+    sampleRateCode = 11;
+    break;
+  default:
+    sampleRateCode = 0;
+  }
+
+  // Probing with the current position changes nothing on a file and fails
+  // on a pipe.
+  seekable = output->setPosition(output->getPosition());
+  if (seekable && expectedSamples > 0) {
+    seekInterval = static_cast<uint64_t>(sampleRateHz * 10.0);
+    seekPointsReserved = static_cast<size_t>(
+        (static_cast<uint64_t>(expectedSamples) + seekInterval - 1) /
+        seekInterval);
+  }
+
+  md5State[0] = 0x67452301;
+  md5State[1] = 0xefcdab89;
+  md5State[2] = 0x98badcfe;
+  md5State[3] = 0x10325476;
+  writeHeader();
+
+  const int threads = std::max(1, numThreads);
+  ring.resize(threads > 1 ? static_cast<size_t>(4 * threads) : 1);
+  for (auto &frame : ring)
+    frame.samples.resize(pending.size());
+  if (threads > 1)
+    for (int i = 0; i < threads; ++i)
+      encoders.emplace_back([this] { encoderLoop(); });
+}
+
+FlacWriter::~FlacWriter() {
+  if (pendingLength > 0)
+    submitFrame();
+  while (emitted < submitted)
+    emitOldest();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work.notify_all();
+  for (auto &t : encoders)
+    t.join();
+
+  if (!seekable)
+    return;
+  const int64_t end = output->getPosition();
+
+  std::vector<uint8_t> info;
+  putBigEndian(info, frameLength, 2);
+  putBigEndian(info, frameLength, 2);
+  putBigEndian(info, samplesWritten > 0 ? minFrameBytes : 0, 3);
+  putBigEndian(info, maxFrameBytes, 3);
+  // 20 bits rate, 3 bits channels - 1, 5 bits bps - 1, 36 bits length.
+  const uint64_t packed =
+      (uint64_t(static_cast<uint32_t>(sampleRate)) << 44) |
+      (uint64_t(numChannels - 1) << 41) | (uint64_t(bitsPerSample - 1) << 36) |
+      (samplesWritten & 0xFFFFFFFFFull);
+  putBigEndian(info, packed, 8);
+  uint8_t digest[16];
+  finishMd5(digest);
+  info.insert(info.end(), digest, digest + 16);
+  output->setPosition(streamInfoPosition);
+  output->write(info.data(), info.size());
+
+  if (seekPointsReserved > 0) {
+    std::vector<uint8_t> table;
+    for (size_t i = 0; i < seekPointsReserved; ++i) {
+      if (i < seekPoints.size()) {
+        putBigEndian(table, seekPoints[i].sample, 8);
+        putBigEndian(table, seekPoints[i].offset, 8);
+        putBigEndian(table, static_cast<uint64_t>(seekPoints[i].length), 2);
+      } else {
+        // Placeholder point.
+        putBigEndian(table, ~uint64_t(0), 8);
+        putBigEndian(table, 0, 8);
+        putBigEndian(table, 0, 2);
+      }
+    }
+    output->setPosition(seekTablePosition);
+    output->write(table.data(), table.size());
+  }
+  output->setPosition(end);
+  output->flush();
+}
+
+void FlacWriter::writeHeader() {
+  std::vector<uint8_t> header = {'f', 'L', 'a', 'C'};
+  const bool hasSeekTable = seekPointsReserved > 0;
+
+  // STREAMINFO, filled in by the destructor where the stream allows it.
+  header.push_back(hasSeekTable ? 0x00 : 0x80);
+  putBigEndian(header, 34, 3);
+  streamInfoPosition = output->getPosition() + (int64_t)header.size();
+  putBigEndian(header, frameLength, 2);
+  putBigEndian(header, frameLength, 2);
+  putBigEndian(header, 0, 3);
+  putBigEndian(header, 0, 3);
+  const uint64_t packed =
+      (uint64_t(static_cast<uint32_t>(sampleRate)) << 44) |
+      (uint64_t(numChannels - 1) << 41) | (uint64_t(bitsPerSample - 1) << 36);
+  putBigEndian(header, packed, 8);
+  header.insert(header.end(), 16, 0);
+
+  if (hasSeekTable) {
+    header.push_back(0x80 | 3);
+    putBigEndian(header, 18 * seekPointsReserved, 3);
+    seekTablePosition = output->getPosition() + (int64_t)header.size();
+    header.insert(header.end(), 18 * seekPointsReserved, 0);
+  }
+  if (!output->write(header.data(), header.size()))
+    failed = true;
+}
+
+bool FlacWriter::write(const int **samples, int numSamples) {
+  const int shift = 32 - static_cast<int>(bitsPerSample);
+  const int numCh = static_cast<int>(numChannels);
+  for (int done = 0; done < numSamples;) {
+    const int n = std::min(numSamples - done, frameLength - pendingLength);
+    const int32_t *channelData[8];
+    for (int c = 0; c < numCh; ++c) {
+      int32_t *dst = pending.data() + c * frameLength + pendingLength;
+      const int *src = samples[c] ? samples[c] + done : nullptr;
+      for (int i = 0; i < n; ++i)
+        dst[i] = src ? (src[i] >> shift) : 0;
+      channelData[c] = dst;
+    }
+    updateMd5(channelData, n);
+    pendingLength += n;
+    done += n;
+    if (pendingLength == frameLength)
+      submitFrame();
+  }
+  return !failed;
+}
+
+bool FlacWriter::flush() {
+  output->flush();
+  return !failed;
+}
+
+void FlacWriter::submitFrame() {
+  if (submitted - emitted == ring.size())
+    emitOldest();
+  Frame &frame = ring[submitted % ring.size()];
+  frame.samples.swap(pending);
+  frame.length = pendingLength;
+  frame.number = submitted;
+  frame.encoded = false;
+  pendingLength = 0;
+  if (encoders.empty()) {
+    encode(frame);
+    frame.encoded = true;
+    ++submitted;
+    emitOldest();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++submitted;
+  }
+  work.notify_one();
+  // The next frame fills the buffer this slot gave up.
+  pending.resize(frame.samples.size());
+}
+
+void FlacWriter::emitOldest() {
+  Frame &frame = ring[emitted % ring.size()];
+  if (!encoders.empty()) {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return frame.encoded; });
+  }
+  const uint32_t size = static_cast<uint32_t>(frame.bytes.size());
+  if (seekPoints.size() < seekPointsReserved &&
+      samplesWritten >= nextSeekSample) {
+    seekPoints.push_back({samplesWritten,
+                          static_cast<uint64_t>(bytesSinceFirstFrame),
+                          frame.length});
+    nextSeekSample += seekInterval;
+  }
+  if (!output->write(frame.bytes.data(), frame.bytes.size()))
+    failed = true;
+  bytesSinceFirstFrame += size;
+  samplesWritten += static_cast<uint64_t>(frame.length);
+  minFrameBytes = std::min(minFrameBytes, size);
+  maxFrameBytes = std::max(maxFrameBytes, size);
+  ++emitted;
+}
+
+void FlacWriter::encoderLoop() {
+  for (;;) {
+    Frame *frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work.wait(lock, [&] { return stopping || nextToEncode < submitted; });
+      if (nextToEncode == submitted)
+        return;
+      frame = &ring[nextToEncode++ % ring.size()];
+    }
+    encode(*frame);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      frame->encoded = true;
+    }
+    done.notify_all();
+  }
+}
+
+void FlacWriter::encode(Frame &frame) const {
+  const int n = frame.length;
+  const int bps = static_cast<int>(bitsPerSample);
+  const int numCh = static_cast<int>(numChannels);
+  std::vector<int32_t> mid, side;
+
+  // Pick the stereo decorrelation from the estimates, then plan only the
+  // channels that get coded.
+  int assignment = numCh - 1;
+  const int32_t *coded[8];
+  int codedBps[8];
+  ChannelAnalysis analyses[8];
+  for (int c = 0; c < numCh; ++c) {
+    coded[c] = frame.samples.data() + c * frameLength;
+    codedBps[c] = bps;
+    analyses[c] = analyseChannel(coded[c], n, bps);
+  }
+  if (numCh == 2) {
+    const int32_t *left = coded[0], *right = coded[1];
+    mid.resize(static_cast<size_t>(n));
+    side.resize(static_cast<size_t>(n));
+    for (int i = 0; i < n; ++i) {
+      mid[(size_t)i] = (left[i] + right[i]) >> 1;
+      side[(size_t)i] = left[i] - right[i];
+    }
+    const ChannelAnalysis midAnalysis = analyseChannel(mid.data(), n, bps);
+    const ChannelAnalysis sideAnalysis =
+        analyseChannel(side.data(), n, bps + 1);
+    const uint64_t costs[4] = {
+        analyses[0].estimatedBits + analyses[1].estimatedBits,
+        analyses[0].estimatedBits + sideAnalysis.estimatedBits,
+        sideAnalysis.estimatedBits + analyses[1].estimatedBits,
+        midAnalysis.estimatedBits + sideAnalysis.estimatedBits};
+    const int choice =
+        static_cast<int>(std::min_element(costs, costs + 4) - costs);
+    if (choice == 1) {
+      assignment = 8;
+      coded[1] = side.data();
+      codedBps[1] = bps + 1;
+      analyses[1] = sideAnalysis;
+    } else if (choice == 2) {
+      assignment = 9;
+      coded[0] = side.data();
+      codedBps[0] = bps + 1;
+      analyses[0] = sideAnalysis;
+    } else if (choice == 3) {
+      assignment = 10;
+      coded[0] = mid.data();
+      analyses[0] = midAnalysis;
+      coded[1] = side.data();
+      codedBps[1] = bps + 1;
+      analyses[1] = sideAnalysis;
+    }
+  }
+  SubframePlan plans[8];
+  std::vector<uint32_t> residuals[8];
+  for (int c = 0; c < numCh; ++c)
+    plans[c] =
+        planSubframe(coded[c], n, codedBps[c], analyses[c], residuals[c]);
+
+  std::vector<uint8_t> &out = frame.bytes;
+  out.clear();
+  uint64_t estimate = 0;
+  for (int c = 0; c < numCh; ++c)
+    estimate += plans[c].bits;
+  out.reserve(static_cast<size_t>(estimate / 8) + 64);
+  BitWriter bits(out);
+  bits.write(0xFFF8, 16); // sync, fixed block size
+  const bool fullFrame = (n == frameLength);
+  bits.write(fullFrame ? 12 : 7, 4); // 4096, or 16-bit length at the end
+  bits.write(static_cast<uint32_t>(sampleRateCode), 4);
+  bits.write(static_cast<uint32_t>(assignment), 4);
+  bits.write(bps == 16 ? 4 : bps == 24 ? 6 : 0, 3);
+  bits.write(0, 1);
+  writeUtf8(bits, frame.number);
+  if (!fullFrame)
+    bits.write(static_cast<uint32_t>(n - 1), 16);
+  bits.sync();
+  bits.write(crc8(out.data(), out.size()), 8);
+
+  for (int c = 0; c < numCh; ++c)
+    writeSubframe(bits, plans[c], coded[c], n, codedBps[c], residuals[c]);
+  bits.alignToByte();
+  bits.sync();
+  bits.write(crc16(out.data(), out.size()), 16);
+  bits.sync();
+}
+
+void FlacWriter::updateMd5(const int32_t *const *channelData, int numSamples) {
+  // The signature covers the interleaved little-endian samples.
+  const size_t bytesPerSample = bitsPerSample / 8;
+  const int numCh = static_cast<int>(numChannels);
+  md5Scratch.resize(static_cast<size_t>(numSamples) * numChannels *
+                    bytesPerSample);
+  uint8_t *p = md5Scratch.data();
+  if (bytesPerSample == 3) {
+    for (int i = 0; i < numSamples; ++i)
+      for (int c = 0; c < numCh; ++c, p += 3) {
+        const uint32_t v = static_cast<uint32_t>(channelData[c][i]);
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+        p[2] = static_cast<uint8_t>(v >> 16);
+      }
+  } else {
+    for (int i = 0; i < numSamples; ++i)
+      for (int c = 0; c < numCh; ++c) {
+        const uint32_t v = static_cast<uint32_t>(channelData[c][i]);
+        for (size_t b = 0; b < bytesPerSample; ++b)
+          *p++ = static_cast<uint8_t>(v >> (8 * b));
+      }
+  }
+
+  const uint8_t *data = md5Scratch.data();
+  size_t length = md5Scratch.size();
+  size_t used = static_cast<size_t>(md5Bytes % 64);
+  md5Bytes += length;
+  if (used > 0) {
+    const size_t take = std::min(length, 64 - used);
+    std::memcpy(md5Block + used, data, take);
+    data += take;
+    length -= take;
+    if (used + take < 64)
+      return;
+    md5Transform(md5State, md5Block);
+  }
+  for (; length >= 64; data += 64, length -= 64)
+    md5Transform(md5State, data);
+  std::memcpy(md5Block, data, length);
+}
+
+void FlacWriter::finishMd5(uint8_t digest[16]) {
+  const uint64_t bitLength = md5Bytes * 8;
+  size_t used = static_cast<size_t>(md5Bytes % 64);
+  md5Block[used++] = 0x80;
+  if (used > 56) {
+    std::memset(md5Block + used, 0, 64 - used);
+    md5Transform(md5State, md5Block);
+    used = 0;
+  }
+  std::memset(md5Block + used, 0, 56 - used);
+  for (int i = 0; i < 8; ++i)
+    md5Block[56 + i] = static_cast<uint8_t>(bitLength >> (8 * i));
+  md5Transform(md5State, md5Block);
+  for (int i = 0; i < 4; ++i)
+    for (int b = 0; b < 4; ++b)
+      digest[4 * i + b] = static_cast<uint8_t>(md5State[i] >> (8 * b));
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Writes a FLAC stream with its own encoder. FLAC frames don't depend on
+// each other, so full frames go to a pool of encoder threads and come back
+// to the calling thread, which writes them in order. Each frame picks the
+// best of independent, left/side, right/side and mid/side stereo and a
+// fixed predictor of order 0 to 4 with partitioned Rice residuals.
+//
+// On a seekable stream the destructor goes back and fills in STREAMINFO
+// (length, frame sizes, MD5) and the seek table. On a pipe those fields are
+// left as "unknown", which decoders accept.
+class FlacWriter : public juce::AudioFormatWriter {
+public:
+  // Takes ownership of the stream. expectedSamples sizes the seek table
+  // (one point every 10 seconds); 0 leaves it out. With numThreads <= 1
+  // frames are encoded inline.
+  FlacWriter(juce::OutputStream *stream, double sampleRateHz,
+             unsigned channels, unsigned bits, int64_t expectedSamples,
+             int numThreads);
+  ~FlacWriter() override;
+
+  // Left-justified 32-bit samples, as for any integer AudioFormatWriter.
+  bool write(const int **samples, int numSamples) override;
+  bool flush() override;
+
+private:
+  static constexpr int frameLength = 4096;
+
+  struct Frame {
+    std::vector<int32_t> samples; // planar, frameLength per channel
+    int length = 0;
+    uint64_t number = 0;
+    std::vector<uint8_t> bytes;
+    bool encoded = false;
+  };
+
+  struct SeekPoint {
+    uint64_t sample, offset;
+    int length;
+  };
+
+  void writeHeader();
+  void submitFrame();
+  void emitOldest();
+  void encoderLoop();
+  void encode(Frame &frame) const;
+  void updateMd5(const int32_t *const *channelData, int numSamples);
+  void finishMd5(uint8_t digest[16]);
+
+  int sampleRateCode = 0;
+  bool seekable = false;
+  int64_t streamInfoPosition = 0, seekTablePosition = 0;
+  int64_t bytesSinceFirstFrame = 0;
+  uint64_t samplesWritten = 0;
+  uint32_t minFrameBytes = 0xFFFFFF, maxFrameBytes = 0;
+  std::vector<SeekPoint> seekPoints;
+  size_t seekPointsReserved = 0;
+  uint64_t seekInterval = 0, nextSeekSample = 0;
+  bool failed = false;
+
+  // Frame being filled, then the ring of frames in flight.
+  std::vector<int32_t> pending;
+  int pendingLength = 0;
+  std::vector<Frame> ring;
+  uint64_t submitted = 0, nextToEncode = 0, emitted = 0;
+  std::mutex mutex;
+  std::condition_variable work, done;
+  bool stopping = false;
+  std::vector<std::thread> encoders;
+
+  uint32_t md5State[4];
+  uint64_t md5Bytes = 0;
+  uint8_t md5Block[64];
+  std::vector<uint8_t> md5Scratch;
+};
@@ -0,0 +1,154 @@
+#include "InputMixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Narration louder than this ducks the tones.
+constexpr float duckThreshold = 0.01f;
+
+// Frames read from the file at a time when resampling.
+constexpr int sourceChunk = 4096;
+
+// One-pole smoothing coefficient for a time constant in seconds.
+float smoothing(double seconds, double sampleRate) {
+  return (float)std::exp(-1.0 / (seconds * sampleRate));
+}
+
+std::unique_ptr<juce::AudioFormatReader> openReader(const std::string &path) {
+  const juce::File file(path);
+  if (!file.existsAsFile())
+    throw std::runtime_error("Input " + path + " does not exist");
+
+  // Mapped readers only come from the formats that store plain PCM.
+  juce::WavAudioFormat wav;
+  juce::AiffAudioFormat aiff;
+  for (juce::AudioFormat *format :
+       {static_cast<juce::AudioFormat *>(&wav),
+        static_cast<juce::AudioFormat *>(&aiff)}) {
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(
+        format->createMemoryMappedReader(file));
+    if (mapped && mapped->mapEntireFile())
+      return mapped;
+  }
+
+  juce::AudioFormatManager formats;
+  formats.registerBasicFormats();
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      formats.createReaderFor(file));
+  if (!reader)
+    throw std::runtime_error("Could not read " + path);
+  return reader;
+}
+
+} // namespace
+
+MixSource::MixSource(const std::string &path, double sampleRate, float g,
+                     int64_t startSample)
+    : reader(openReader(path)), scratch(2, sourceChunk), gain(g) {
+  const double fileRate = reader->sampleRate;
+  position = std::llround((double)startSample * fileRate / sampleRate);
+  if (fileRate != sampleRate) {
+    try {
+      resampler =
+          std::make_unique<PolyphaseResampler>(fileRate, sampleRate, 2);
+    } catch (const std::invalid_argument &e) {
+      throw std::runtime_error(path + ": " + e.what());
+    }
+  }
+}
+
+double MixSource::lengthSeconds(const std::string &path) {
+  auto reader = openReader(path);
+  return (double)reader->lengthInSamples / reader->sampleRate;
+}
+
+void MixSource::readSource(float *const *output, int numSamples) {
+  // Reads past the end of the file come back as silence.
+  reader->read(output, 2, position, numSamples);
+  if (reader->numChannels == 1)
+    std::copy(output[0], output[0] + numSamples, output[1]);
+  position += numSamples;
+}
+
+void MixSource::read(float *const *output, int numSamples) {
+  if (!resampler) {
+    readSource(output, numSamples);
+  } else {
+    int done = 0;
+    while (done < numSamples) {
+      float *const at[2] = {output[0] + done, output[1] + done};
+      const int n = resampler->pull(at, numSamples - done);
+      done += n;
+      if (n == 0) {
+        readSource(scratch.getArrayOfWritePointers(), sourceChunk);
+        resampler->push(scratch.getArrayOfReadPointers(), sourceChunk);
+      }
+    }
+  }
+  if (gain != 1.0f)
+    for (int c = 0; c < 2; ++c)
+      juce::FloatVectorOperations::multiply(output[c], gain, numSamples);
+}
+
+MixingWriter::MixingWriter(std::unique_ptr<juce::AudioFormatWriter> target,
+                           std::vector<std::unique_ptr<MixSource>> voices,
+                           std::vector<std::unique_ptr<MixSource>> beds,
+                           double duckDb)
+    : juce::AudioFormatWriter(nullptr, "Mixer", target->getSampleRate(),
+                              (unsigned)target->getNumChannels(), 32),
+      writer(std::move(target)), narration(std::move(voices)),
+      background(std::move(beds)),
+      duckGain(juce::Decibels::decibelsToGain((float)-std::abs(duckDb))),
+      levelAttack(smoothing(0.001, sampleRate)),
+      levelRelease(smoothing(0.1, sampleRate)),
+      duckAttack(smoothing(0.01, sampleRate)),
+      duckRelease(smoothing(0.5, sampleRate)) {
+  usesFloatingPointData = true;
+}
+
+bool MixingWriter::write(const int **samples, int numSamples) {
+  auto tones = reinterpret_cast<const float *const *>(samples);
+  mix.setSize(2, numSamples, false, false, true);
+  voice.setSize(2, numSamples, false, false, true);
+  input.setSize(2, numSamples, false, false, true);
+  float *const out[2] = {mix.getWritePointer(0), mix.getWritePointer(1)};
+
+  voice.clear();
+  for (auto &source : narration) {
+    source->read(input.getArrayOfWritePointers(), numSamples);
+    for (int c = 0; c < 2; ++c)
+      voice.addFrom(c, 0, input, c, 0, numSamples);
+  }
+
+  if (narration.empty()) {
+    for (int c = 0; c < 2; ++c)
+      std::copy(tones[c], tones[c] + numSamples, out[c]);
+  } else {
+    // The gain follows the narration's level sample by sample; both are
+    // one-pole smoothers, fast to react and slow to let go.
+    const float *vl = voice.getReadPointer(0);
+    const float *vr = voice.getReadPointer(1);
+    for (int i = 0; i < numSamples; ++i) {
+      const float peak = std::max(std::abs(vl[i]), std::abs(vr[i]));
+      level = peak +
+              (level - peak) * (peak > level ? levelAttack : levelRelease);
+      const float target = level > duckThreshold ? duckGain : 1.0f;
+      toneGain = target + (toneGain - target) *
+                              (target < toneGain ? duckAttack : duckRelease);
+      out[0][i] = tones[0][i] * toneGain + vl[i];
+      out[1][i] = tones[1][i] * toneGain + vr[i];
+    }
+  }
+
+  for (auto &source : background) {
+    source->read(input.getArrayOfWritePointers(), numSamples);
+    for (int c = 0; c < 2; ++c)
+      mix.addFrom(c, 0, input, c, 0, numSamples);
+  }
+
+  return writer->writeFromFloatArrays(mix.getArrayOfReadPointers(), 2,
+                                      numSamples);
+}
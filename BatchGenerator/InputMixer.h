@@ -0,0 +1,68 @@
+#pragma once
+
+#include "PolyphaseResampler.h"
+
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// An audio file streamed into a render a block at a time, as stereo at the
+// session's rate. WAV and AIFF files are read through a memory mapping of
+// the whole file, so the page cache does the buffering and nothing is
+// decoded ahead; other formats JUCE knows (FLAC, Ogg) go through an
+// ordinary reader. Mono is copied to both channels and channels past the
+// second are ignored. A file at another rate goes through a
+// PolyphaseResampler. Past its end the input is silent.
+class MixSource {
+public:
+  // startSample is the session sample the first read lines up with.
+  // Throws std::runtime_error if the file can't be read.
+  MixSource(const std::string &path, double sampleRate, float gain,
+            int64_t startSample);
+
+  // Writes the next numSamples frames, times the gain.
+  void read(float *const *output, int numSamples);
+
+  // Length of the file in seconds. Throws like the constructor.
+  static double lengthSeconds(const std::string &path);
+
+private:
+  void readSource(float *const *output, int numSamples);
+
+  std::unique_ptr<juce::AudioFormatReader> reader;
+  std::unique_ptr<PolyphaseResampler> resampler;
+  juce::AudioBuffer<float> scratch;
+  float gain;
+  // Next frame to read from the file, at the file's rate.
+  int64_t position;
+};
+
+// Mixes the inputs into the render on its way to another writer, so the
+// tones, the narration and any background bed leave in one output without
+// temporary files or a second pass. Narration ducks the tones: while it is
+// above about -40 dBFS the tones glide down by duckDb over 10 ms, and back
+// up over 500 ms once it stops. Background inputs are mixed in as they are.
+// Takes float data like the writers it wraps, and doesn't clip.
+class MixingWriter : public juce::AudioFormatWriter {
+public:
+  MixingWriter(std::unique_ptr<juce::AudioFormatWriter> target,
+               std::vector<std::unique_ptr<MixSource>> narration,
+               std::vector<std::unique_ptr<MixSource>> background,
+               double duckDb);
+
+  bool write(const int **samples, int numSamples) override;
+  bool flush() override { return writer->flush(); }
+
+private:
+  std::unique_ptr<juce::AudioFormatWriter> writer;
+  std::vector<std::unique_ptr<MixSource>> narration, background;
+  juce::AudioBuffer<float> mix, voice, input;
+
+  float duckGain;
+  // The narration's level follower and the smoothed gain on the tones.
+  float level = 0.0f, toneGain = 1.0f;
+  float levelAttack, levelRelease, duckAttack, duckRelease;
+};
@@ -0,0 +1,161 @@
+#include "MappedWavWriter.h"
+#include "PcmStreamWriter.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int64_t headerBytes = PcmStreamWriter::seekableHeaderBytes;
+
+// Bytes mapped at a time.
+constexpr int64_t windowBytes = 64 << 20;
+
+} // namespace
+
+MappedWavWriter::MappedWavWriter(const std::string &path, double sampleRateHz,
+                                 unsigned channels, PcmFormat sampleFormat,
+                                 int64_t expectedFrames, bool dither)
+    : juce::AudioFormatWriter(nullptr, "Mapped WAV", sampleRateHz, channels,
+                              pcmBits(sampleFormat)),
+      file(path), format(sampleFormat),
+      packer(sampleFormat, channels, dither), channelData(channels) {
+  usesFloatingPointData = true;
+  // Until the destructor writes the sizes, the header says "until end of
+  // file", so an interrupted render can still be read.
+  file.deleteFile();
+  {
+    juce::FileOutputStream stream(file);
+    if (stream.failedToOpen() ||
+        !writeWavHeader(stream, sampleRate, numChannels, format, true, -1))
+      throw std::runtime_error("Could not create " + path);
+  }
+  fileBytes = headerBytes;
+  const int64_t expectedBytes =
+      std::max<int64_t>(0, expectedFrames) * (int64_t)packer.bytesPerFrame();
+  if (!reserve(headerBytes + expectedBytes))
+    throw std::runtime_error("Could not allocate " +
+                             std::to_string(expectedBytes >> 20) +
+                             " MB for " + path);
+}
+
+MappedWavWriter::~MappedWavWriter() {
+  window.reset();
+  {
+    juce::FileOutputStream stream(file);
+    if (!stream.failedToOpen() && stream.setPosition(headerBytes + dataBytes))
+      stream.truncate();
+  }
+  writeHeader();
+}
+
+// Allocates real blocks, not a sparse file, so running out of space shows
+// up here and not as a SIGBUS from a page written later.
+bool MappedWavWriter::reserve(int64_t bytes) {
+  if (bytes <= fileBytes)
+    return true;
+#if defined(__APPLE__)
+  const int fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY);
+  if (fd < 0)
+    return false;
+  // F_PEOFPOSMODE counts from the blocks already allocated, which cover
+  // fileBytes.
+  fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, bytes - fileBytes, 0};
+  const bool allocated = ::fcntl(fd, F_PREALLOCATE, &store) != -1 &&
+                         ::ftruncate(fd, bytes) == 0;
+  ::close(fd);
+  if (allocated)
+    fileBytes = bytes;
+  return allocated;
+#else
+#if defined(__linux__)
+  const int fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY);
+  if (fd < 0)
+    return false;
+  const int result = ::posix_fallocate(fd, 0, bytes);
+  ::close(fd);
+  if (result == 0) {
+    fileBytes = bytes;
+    return true;
+  }
+  // Only a file system that can't preallocate falls back to a sparse file;
+  // ENOSPC and anything else is a real failure.
+  if (result != EOPNOTSUPP && result != EINVAL)
+    return false;
+#endif
+  std::error_code error;
+  std::filesystem::resize_file(file.getFullPathName().toStdString(),
+                               static_cast<uintmax_t>(bytes), error);
+  if (error)
+    return false;
+  fileBytes = bytes;
+  return true;
+#endif
+}
+
+// Maps a window starting at position, growing the file first if it ends
+// less than bytesWanted past it.
+bool MappedWavWriter::mapAt(int64_t position, int64_t bytesWanted) {
+  window.reset();
+  windowData = nullptr;
+  windowStart = windowEnd = position;
+  if (position + bytesWanted > fileBytes &&
+      !reserve(std::max(position + bytesWanted, fileBytes + fileBytes / 4)))
+    return false;
+
+  // JUCE moves the start of the range down to a page boundary.
+  window = std::make_unique<juce::MemoryMappedFile>(
+      file,
+      juce::Range<juce::int64>(position,
+                               std::min(fileBytes, position + windowBytes)),
+      juce::MemoryMappedFile::readWrite, false);
+  if (window->getData() == nullptr)
+    return false;
+  windowData = static_cast<unsigned char *>(window->getData());
+  windowStart = window->getRange().getStart();
+  windowEnd = window->getRange().getEnd();
+  return true;
+}
+
+bool MappedWavWriter::write(const int **samples, int numSamples) {
+  auto channels = reinterpret_cast<const float *const *>(samples);
+  const int64_t frameBytes = static_cast<int64_t>(packer.bytesPerFrame());
+  int done = 0;
+  while (done < numSamples) {
+    const int64_t position = headerBytes + dataBytes;
+    const int64_t room = (windowEnd - position) / frameBytes;
+    if (room <= 0) {
+      if (!mapAt(position, (numSamples - done) * frameBytes))
+        return false;
+      continue;
+    }
+    const int n = static_cast<int>(std::min<int64_t>(room, numSamples - done));
+    for (unsigned c = 0; c < numChannels; ++c)
+      channelData[c] = channels[c] + done;
+    packer.pack(channelData.data(), n, framesWritten,
+                windowData + (position - windowStart));
+    done += n;
+    framesWritten += n;
+    dataBytes += n * frameBytes;
+  }
+  return true;
+}
+
+bool MappedWavWriter::writeHeader() {
+  juce::FileOutputStream stream(file);
+  if (stream.failedToOpen() || !stream.setPosition(0) ||
+      !writeWavHeader(stream, sampleRate, numChannels, format, true,
+                      dataBytes))
+    return false;
+  stream.flush();
+  return stream.getStatus().wasOk();
+}
+
+bool MappedWavWriter::flush() { return writeHeader(); }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PcmPacker.h"
+
+#include <cstdint>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Writes a WAV file by packing samples straight into a memory mapping of
+// it, so there is no staging buffer and no write() per block; the kernel
+// writes the dirty pages back on its own. The file is allocated at its
+// expected size up front, which keeps it in few extents and makes a full
+// disk fail when the writer is created rather than halfway through a
+// render. It is mapped 64 MB at a time and grows if more arrives than
+// expected. The destructor unmaps it, writes the 80-byte header with the
+// real sizes (RF64 past 4 GB) and cuts the file to its length.
+//
+// Takes float data, converted by a PcmPacker, so the samples are the same
+// bits PcmStreamWriter or JUCE's WAV writer would produce.
+class MappedWavWriter : public juce::AudioFormatWriter {
+public:
+  // Replaces any existing file. Throws std::runtime_error if it can't be
+  // created or allocated.
+  MappedWavWriter(const std::string &path, double sampleRateHz,
+                  unsigned channels, PcmFormat sampleFormat,
+                  int64_t expectedFrames, bool dither);
+  ~MappedWavWriter() override;
+
+  bool write(const int **samples, int numSamples) override;
+
+  // Writes the header for the samples so far.
+  bool flush() override;
+
+private:
+  bool reserve(int64_t bytes);
+  bool mapAt(int64_t position, int64_t bytesWanted);
+  bool writeHeader();
+
+  juce::File file;
+  PcmFormat format;
+  PcmPacker packer;
+  int64_t dataBytes = 0, framesWritten = 0, fileBytes = 0;
+  std::unique_ptr<juce::MemoryMappedFile> window;
+  unsigned char *windowData = nullptr;
+  int64_t windowStart = 0, windowEnd = 0;
+  std::vector<const float *> channelData;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <juce_core/juce_core.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PCM_PACKER_SSE2 1
+#endif
+
+// Sample encodings for PCM output, all little-endian.
+enum class PcmFormat { S16, S24, S32, F32 };
+
+inline unsigned pcmBits(PcmFormat format) {
+  switch (format) {
+  case PcmFormat::S16:
+    return 16;
+  case PcmFormat::S24:
+    return 24;
+  case PcmFormat::S32:
+  case PcmFormat::F32:
+    break;
+  }
+  return 32;
+}
+
+// Turns float blocks into interleaved PCM. Integer formats round the way
+// JUCE's writers do: the sample is clipped, scaled to 32 bits, rounded to
+// nearest even and shifted down to the format's width. So a file is the
+// same bits whichever writer made it, and render cache entries stay
+// interchangeable. F32 is copied as it is.
+//
+// With dither, TPDF noise of +-1 LSB of the output format is added before
+// rounding: the sum of two uniform values, both taken from a hash of the
+// sample's position in the output. The noise doesn't depend on how the
+// output is split into blocks, so a dithered file is reproducible too.
+//
+// Conversion runs a channel at a time over contiguous arrays, four samples
+// per step with SSE2 on x86 (where every 64-bit CPU has it) and in scalar
+// code elsewhere. It works in doubles, which hold every 32-bit value, so
+// both round alike. Packing then interleaves with one unaligned store per
+// sample, or per frame for stereo 24-bit.
+class PcmPacker {
+public:
+  PcmPacker(PcmFormat sampleFormat, unsigned channels, bool withDither)
+      : format(sampleFormat), numChannels(channels),
+        dither(withDither && sampleFormat != PcmFormat::F32) {}
+
+  size_t bytesPerFrame() const {
+    return (size_t)numChannels * pcmBits(format) / 8;
+  }
+
+  // Packs numFrames frames into out, which must hold
+  // numFrames * bytesPerFrame() bytes. position is the output frame the
+  // first one lands on, for the dither.
+  void pack(const float *const *channels, int numFrames, int64_t position,
+            unsigned char *out) {
+    if (numFrames <= 0)
+      return;
+    unsigned char *const end = out + (size_t)numFrames * bytesPerFrame();
+    if (format == PcmFormat::F32) {
+      for (int i = 0; i < numFrames; ++i)
+        for (unsigned c = 0; c < numChannels; ++c) {
+          uint32_t bits;
+          std::memcpy(&bits, &channels[c][i], 4);
+          bits = juce::ByteOrder::swapIfBigEndian(bits);
+          std::memcpy(out, &bits, 4);
+          out += 4;
+        }
+      return;
+    }
+
+    ints.resize((size_t)numFrames * numChannels);
+    for (unsigned c = 0; c < numChannels; ++c)
+      toInts(channels[c], numFrames, position, c,
+             ints.data() + (size_t)c * (size_t)numFrames);
+
+    const int shift = 32 - (int)pcmBits(format);
+    const size_t bytes = pcmBits(format) / 8;
+    if (numChannels == 2 && format == PcmFormat::S24) {
+      const int32_t *left = ints.data();
+      const int32_t *right = left + numFrames;
+      for (int i = 0; i < numFrames; ++i) {
+        const uint64_t frame = juce::ByteOrder::swapIfBigEndian(
+            (uint64_t)((uint32_t)left[i] >> 8) |
+            (uint64_t)((uint32_t)right[i] >> 8) << 24);
+        std::memcpy(out, &frame, out + 8 <= end ? 8 : 6);
+        out += 6;
+      }
+      return;
+    }
+    for (int i = 0; i < numFrames; ++i)
+      for (unsigned c = 0; c < numChannels; ++c) {
+        const uint32_t value = juce::ByteOrder::swapIfBigEndian(
+            (uint32_t)(ints[c * (size_t)numFrames + (size_t)i] >> shift));
+        // Four bytes go out each time and the next sample overwrites the
+        // spare ones; only the last sample stops at its own.
+        std::memcpy(out, &value, out + 4 <= end ? 4 : bytes);
+        out += bytes;
+      }
+  }
+
+private:
+  static uint32_t hash(uint64_t index) {
+    uint32_t x = (uint32_t)index ^ ((uint32_t)(index >> 32) * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+  }
+
+  // Dither for one channel in units of 1/65536 LSB, from -65535 to 65535.
+  void makeDither(int numFrames, int64_t position, unsigned channel) {
+    noise.resize((size_t)numFrames);
+    const uint64_t first = (uint64_t)position * numChannels + channel;
+    for (int i = 0; i < numFrames; ++i) {
+      const uint32_t h = hash(first + (uint64_t)i * numChannels);
+      noise[(size_t)i] = (int32_t)((h >> 16) + (h & 0xFFFFu)) - 65535;
+    }
+  }
+
+  // 32-bit integers for one channel.
+  void toInts(const float *in, int numFrames, int64_t position,
+              unsigned channel, int32_t *out) {
+    const double maxInt = 2147483647.0, minInt = -2147483648.0;
+    const double ditherScale =
+        dither ? std::ldexp(1.0, 32 - (int)pcmBits(format)) / 65536.0 : 0.0;
+    if (dither)
+      makeDither(numFrames, position, channel);
+    int i = 0;
+#if PCM_PACKER_SSE2
+    // cvtpd2dq rounds to nearest even, like the scalar path below.
+    const __m128d scale = _mm_set1_pd(maxInt), lowest = _mm_set1_pd(minInt),
+                  highest = _mm_set1_pd(maxInt), minusOne = _mm_set1_pd(-1.0),
+                  step = _mm_set1_pd(ditherScale);
+    auto clip = [&](__m128d s) {
+      return _mm_min_pd(_mm_max_pd(s, lowest), highest);
+    };
+    auto convert = [&](__m128 x, const int32_t *n) {
+      const __m128d d = _mm_cvtps_pd(x);
+      // -1.0 itself scales to one above the lowest value; JUCE pins it.
+      const __m128d pinned = _mm_cmple_pd(d, minusOne);
+      __m128d s = clip(_mm_mul_pd(d, scale));
+      s = _mm_or_pd(_mm_andnot_pd(pinned, s), _mm_and_pd(pinned, lowest));
+      if (dither)
+        s = clip(_mm_add_pd(
+            s, _mm_mul_pd(_mm_cvtepi32_pd(_mm_loadl_epi64(
+                              reinterpret_cast<const __m128i *>(n))),
+                          step)));
+      return _mm_cvtpd_epi32(s);
+    };
+    for (; i + 4 <= numFrames; i += 4) {
+      const __m128 x = _mm_loadu_ps(in + i);
+      const int32_t *n = dither ? noise.data() + i : nullptr;
+      const __m128i lo = convert(x, n);
+      const __m128i hi = convert(_mm_movehl_ps(x, x), n ? n + 2 : nullptr);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                       _mm_unpacklo_epi64(lo, hi));
+    }
+#endif
+    for (; i < numFrames; ++i) {
+      const double x = in[i];
+      double s = x <= -1.0 ? minInt : x >= 1.0 ? maxInt : x * maxInt;
+      if (dither)
+        s = std::clamp(s + noise[(size_t)i] * ditherScale, minInt, maxInt);
+      // Adding 1.5 * 2^52 leaves the rounded value in the low word.
+      const double biased = s + 6755399441055744.0;
+      uint64_t bits;
+      std::memcpy(&bits, &biased, sizeof(bits));
+      out[i] = (int32_t)(uint32_t)bits;
+    }
+  }
+
+  PcmFormat format;
+  unsigned numChannels;
+  bool dither;
+  std::vector<int32_t> ints, noise;
+};
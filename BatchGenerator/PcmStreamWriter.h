@@ -0,0 +1,171 @@
+#pragma once
+
+#include "PcmPacker.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <vector>
+
+// An OutputStream over a stdio handle that never seeks, so it works on
+// stdout and named pipes as well as plain files.
+class StdioOutputStream : public juce::OutputStream {
+public:
+  StdioOutputStream(FILE *f, bool closeWhenDone)
+      : file(f), ownsFile(closeWhenDone) {}
+
+  ~StdioOutputStream() override {
+    std::fflush(file);
+    if (ownsFile)
+      std::fclose(file);
+  }
+
+  void flush() override { std::fflush(file); }
+  juce::int64 getPosition() override { return position; }
+  bool setPosition(juce::int64) override { return false; }
+
+  bool write(const void *data, size_t numBytes) override {
+    size_t written = std::fwrite(data, 1, numBytes, file);
+    position += static_cast<juce::int64>(written);
+    return written == numBytes;
+  }
+
+private:
+  FILE *file;
+  bool ownsFile;
+  juce::int64 position = 0;
+};
+
+// RF64 size fields: RIFF size, data size, frame count and table length.
+constexpr int ds64Bytes = 28;
+
+// Writes a WAV header for dataBytes of samples, or for an unknown length
+// (0xFFFFFFFF sizes) when dataBytes is negative. With reserveDs64 a chunk
+// for RF64's ds64 comes before fmt, making the header 80 bytes: JUNK while
+// the sizes fit in 32 bits, ds64 with the real sizes once they don't.
+inline bool writeWavHeader(juce::OutputStream &output, double sampleRate,
+                           unsigned numChannels, PcmFormat format,
+                           bool reserveDs64, int64_t dataBytes) {
+  const int bytesPerFrame =
+      static_cast<int>(numChannels * pcmBits(format) / 8);
+  const short formatTag = (format == PcmFormat::F32) ? 3 : 1;
+  const int64_t riffBytes = (reserveDs64 ? 72 : 36) + dataBytes;
+  const bool rf64 = reserveDs64 && riffBytes > 0xFFFFFFFFLL;
+  const int riffSize =
+      (dataBytes < 0 || rf64) ? -1 : static_cast<int>(riffBytes);
+  const int dataSize =
+      (dataBytes < 0 || rf64) ? -1 : static_cast<int>(dataBytes);
+  bool ok = output.write(rf64 ? "RF64" : "RIFF", 4) &&
+            output.writeInt(riffSize) && output.write("WAVE", 4);
+  if (reserveDs64) {
+    ok = ok && output.write(rf64 ? "ds64" : "JUNK", 4) &&
+         output.writeInt(ds64Bytes);
+    if (rf64)
+      ok = ok && output.writeInt64(riffBytes) &&
+           output.writeInt64(dataBytes) &&
+           output.writeInt64(dataBytes / bytesPerFrame) &&
+           output.writeInt(0);
+    else
+      ok = ok && output.writeRepeatedByte(0, ds64Bytes);
+  }
+  return ok && output.write("fmt ", 4) && output.writeInt(16) &&
+         output.writeShort(formatTag) &&
+         output.writeShort(static_cast<short>(numChannels)) &&
+         output.writeInt(static_cast<int>(sampleRate)) &&
+         output.writeInt(static_cast<int>(sampleRate) * bytesPerFrame) &&
+         output.writeShort(static_cast<short>(bytesPerFrame)) &&
+         output.writeShort(static_cast<short>(pcmBits(format))) &&
+         output.write("data", 4) && output.writeInt(dataSize);
+}
+
+// Writes interleaved PCM in one pass, optionally behind a WAV header. On a
+// stream that can't seek, the header's RIFF and data sizes are set to
+// 0xFFFFFFFF, which readers such as ffmpeg take as "until end of stream".
+// On one that can, the header also reserves a JUNK chunk for RF64's ds64,
+// and flush() and the destructor write the real sizes, switching to RF64
+// once they no longer fit in 32 bits. Takes float data and converts it
+// with a PcmPacker, optionally dithered.
+class PcmStreamWriter : public juce::AudioFormatWriter {
+public:
+  // Takes ownership of the stream, like every AudioFormatWriter. With
+  // existingDataBytes >= 0 the stream is positioned after a seekable WAV
+  // header from an earlier writer and that many bytes of samples, and
+  // writing carries on from there, with the dither where it left off.
+  PcmStreamWriter(juce::OutputStream *stream, double sampleRateHz,
+                  unsigned channels, PcmFormat sampleFormat, bool wavHeader,
+                  int64_t existingDataBytes = -1, bool dither = false)
+      : juce::AudioFormatWriter(stream, wavHeader ? "WAV stream" : "Raw PCM",
+                                sampleRateHz, channels,
+                                pcmBits(sampleFormat)),
+        format(sampleFormat), packer(sampleFormat, channels, dither) {
+    usesFloatingPointData = true;
+    if (existingDataBytes >= 0) {
+      seekable = true;
+      headerBytes = seekableHeaderBytes;
+      dataBytes = existingDataBytes;
+      framesWritten =
+          existingDataBytes / static_cast<int64_t>(packer.bytesPerFrame());
+      headerStart = output->getPosition() - headerBytes - dataBytes;
+      return;
+    }
+    headerStart = output->getPosition();
+    seekable = wavHeader && output->setPosition(headerStart);
+    if (wavHeader)
+      writeWavHeader(*output, sampleRate, numChannels, format, seekable, -1);
+    headerBytes = output->getPosition() - headerStart;
+  }
+
+  ~PcmStreamWriter() override {
+    if (seekable)
+      writeSizes();
+  }
+
+  bool write(const int **samples, int numSamples) override {
+    scratch.resize(static_cast<size_t>(numSamples) * packer.bytesPerFrame());
+    packer.pack(reinterpret_cast<const float *const *>(samples), numSamples,
+                framesWritten, scratch.data());
+    framesWritten += numSamples;
+    dataBytes += static_cast<int64_t>(scratch.size());
+    return output->write(scratch.data(), scratch.size());
+  }
+
+  // Appends interleaved samples that are already in this writer's format,
+  // such as the data chunk of another WAV file.
+  bool writeEncoded(const void *data, size_t numBytes) {
+    dataBytes += static_cast<int64_t>(numBytes);
+    framesWritten += static_cast<int64_t>(numBytes / packer.bytesPerFrame());
+    return output->write(data, numBytes);
+  }
+
+  // Leaves a seekable file playable up to this point.
+  bool flush() override {
+    bool ok = !seekable || writeSizes();
+    output->flush();
+    return ok;
+  }
+
+  // Header plus samples so far, counted from where the header starts.
+  int64_t getBytesWritten() const { return headerBytes + dataBytes; }
+
+  static constexpr int64_t seekableHeaderBytes = 80;
+
+private:
+  // Rewrites the header with the sizes so far.
+  bool writeSizes() {
+    const juce::int64 end = output->getPosition();
+    bool ok = output->setPosition(headerStart) &&
+              writeWavHeader(*output, sampleRate, numChannels, format, true,
+                             dataBytes);
+    return output->setPosition(end) && ok;
+  }
+
+  PcmFormat format;
+  PcmPacker packer;
+  std::vector<unsigned char> scratch;
+  bool seekable = false;
+  juce::int64 headerStart = 0;
+  int64_t headerBytes = 0;
+  int64_t dataBytes = 0;
+  int64_t framesWritten = 0;
+};
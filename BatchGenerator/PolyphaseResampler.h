@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+// Streaming sample rate conversion by a rational factor L / M (output over
+// input rate, reduced). Conceptually the input is stuffed with L - 1 zeros
+// per sample, low-pass filtered and kept every M-th sample; the polyphase
+// form only ever computes the kept samples, each as one dot product of
+// `taps` input samples with one of the filter's L phases.
+//
+// The prototype is a Kaiser-windowed sinc (beta 9, about 90 dB of stopband
+// rejection) cut off a little below the lower of the two Nyquist rates.
+// Each phase is stored reversed and padded to a multiple of eight taps, so
+// the inner loop is a straight dot product over two contiguous arrays,
+// which the compiler turns into SIMD with the eight accumulators below.
+// Phases are normalised to unity gain at DC.
+//
+// Output sample k is the input at time k * M / L, with the filter's delay
+// taken out: the first output lines up with the first input.
+class PolyphaseResampler {
+public:
+  // Rates must be whole numbers of Hz with a ratio that reduces to at most
+  // maxPhases phases. Throws std::invalid_argument otherwise.
+  PolyphaseResampler(double inputRate, double outputRate, int numChannels) {
+    const int64_t in = std::llround(inputRate);
+    const int64_t out = std::llround(outputRate);
+    if (in <= 0 || out <= 0 || (double)in != inputRate ||
+        (double)out != outputRate)
+      throw std::invalid_argument("resampling needs whole-Hz sample rates");
+    const int64_t g = std::gcd(in, out);
+    up = out / g;
+    down = in / g;
+    if (up > maxPhases)
+      throw std::invalid_argument("sample rates too far from a simple ratio");
+
+    // Downsampling narrows the passband in input samples, so the filter
+    // gets longer in proportion to keep the same transition width.
+    const double ratio = std::max(1.0, (double)down / (double)up);
+    taps = (int)std::ceil(baseTaps * ratio / 8.0) * 8;
+    design(0.5 * std::min(1.0, (double)up / (double)down) * cutoff);
+
+    history.assign((size_t)numChannels, std::vector<float>());
+    for (auto &h : history)
+      h.assign((size_t)taps, 0.0f);
+    // Output 0 needs inputs up to taps / 2 past the first one: the
+    // history starts with taps zeros standing for the time before it.
+    nextInput = taps + taps / 2;
+  }
+
+  // Output samples that numInputSamples of input make.
+  int64_t outputLength(int64_t numInputSamples) const {
+    return (numInputSamples * up + down / 2) / down;
+  }
+
+  // The same without a resampler, for whole-Hz rates.
+  static int64_t outputLength(int64_t numInputSamples, double inputRate,
+                              double outputRate) {
+    const int64_t in = std::llround(inputRate);
+    const int64_t out = std::llround(outputRate);
+    const int64_t g = std::gcd(in, out);
+    return (numInputSamples * (out / g) + (in / g) / 2) / (in / g);
+  }
+
+  // Appends numSamples frames of input.
+  void push(const float *const *input, int numSamples) {
+    for (size_t c = 0; c < history.size(); ++c)
+      history[c].insert(history[c].end(), input[c], input[c] + numSamples);
+  }
+
+  // Silence to push after the last input so every output it makes can be
+  // pulled.
+  int flushLength() const { return taps / 2 + 1; }
+
+  // Appends numSamples frames of silence.
+  void pushSilence(int numSamples) {
+    for (auto &h : history)
+      h.insert(h.end(), (size_t)numSamples, 0.0f);
+  }
+
+  // Writes up to maxSamples frames that the input so far is enough for and
+  // returns how many.
+  int pull(float *const *output, int maxSamples) {
+    const int64_t available = historyStart + (int64_t)history[0].size();
+    int produced = 0;
+    while (produced < maxSamples && nextInput < available) {
+      const float *coeffs = &coefficients[(size_t)(phase * taps)];
+      const size_t first = (size_t)(nextInput - taps + 1 - historyStart);
+      for (size_t c = 0; c < history.size(); ++c)
+        output[c][produced] = dot(coeffs, &history[c][first]);
+      ++produced;
+      phase += down;
+      nextInput += phase / up;
+      phase %= up;
+    }
+    discardUsedInput();
+    return produced;
+  }
+
+private:
+  static constexpr int64_t maxPhases = 4096;
+  static constexpr double baseTaps = 64.0;
+  // Centre of the transition band, relative to the lower Nyquist rate.
+  static constexpr double cutoff = 0.91;
+  static constexpr double beta = 9.0;
+
+  float dot(const float *a, const float *b) const {
+    float acc[8] = {};
+    for (int j = 0; j < taps; j += 8)
+      for (int k = 0; k < 8; ++k)
+        acc[k] += a[j + k] * b[j + k];
+    return ((acc[0] + acc[4]) + (acc[1] + acc[5])) +
+           ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+  }
+
+  static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+      if (term < sum * 1e-17)
+        break;
+    }
+    return sum;
+  }
+
+  // fc is the cutoff in cycles per input sample.
+  void design(double fc) {
+    const double pi = 3.14159265358979323846;
+    const int64_t length = up * taps;
+    const double centre = (double)length / 2.0;
+    // Cutoff in cycles per sample of the zero-stuffed signal.
+    const double f = fc / (double)up;
+    const double norm = besselI0(beta);
+    coefficients.assign((size_t)length, 0.0f);
+    for (int64_t p = 0; p < up; ++p) {
+      std::vector<double> row((size_t)taps);
+      double sum = 0.0;
+      for (int j = 0; j < taps; ++j) {
+        const double x = (double)(j * up + p) - centre;
+        const double sinc =
+            (x == 0.0) ? 2.0 * f : std::sin(2.0 * pi * f * x) / (pi * x);
+        const double r = x / centre;
+        const double w =
+            besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / norm;
+        row[(size_t)j] = sinc * w;
+        sum += row[(size_t)j];
+      }
+      // Stored reversed, so the dot product runs forward through the input.
+      for (int j = 0; j < taps; ++j)
+        coefficients[(size_t)(p * taps + (taps - 1 - j))] =
+            (float)(row[(size_t)j] / sum);
+    }
+  }
+
+  // Drops the input no later output reads, once there's a block of it.
+  void discardUsedInput() {
+    const int64_t keepFrom = nextInput - taps + 1;
+    const int64_t drop = keepFrom - historyStart;
+    if (drop < 8192)
+      return;
+    for (auto &h : history)
+      h.erase(h.begin(), h.begin() + (ptrdiff_t)drop);
+    historyStart = keepFrom;
+  }
+
+  int64_t up = 1, down = 1;
+  int taps = 64;
+  // [phase * taps + tap], each phase reversed.
+  std::vector<float> coefficients;
+
+  // Input per channel from absolute index historyStart on, where index 0
+  // is the first of the taps leading zeros.
+  std::vector<std::vector<float>> history;
+  int64_t historyStart = 0;
+  // The newest input the next output reads, and that output's phase.
+  int64_t nextInput = 0;
+  int64_t phase = 0;
+};
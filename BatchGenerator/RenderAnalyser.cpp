@@ -0,0 +1,281 @@
+#include "RenderAnalyser.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Above these outputs, tanh's input was over 1 and over 2.
+const float kneeOutput = (float)std::tanh(1.0);
+const float hardOutput = (float)std::tanh(2.0);
+
+// ITU-R BS.1770-4 Annex 2's 4x oversampling filter, one phase per row.
+const float truePeakFilter[4][12] = {
+    {0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
+     -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f,
+     0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f},
+    {-0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f,
+     -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f,
+     0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f},
+    {-0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f,
+     -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f,
+     0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f},
+    {-0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
+     -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f,
+     0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f}};
+constexpr int truePeakTaps = 12;
+
+double toDb(double gain) {
+  return gain > 0.0 ? 20.0 * std::log10(gain) : -1000.0;
+}
+
+// Squared magnitude of x at f Hz.
+double goertzel(const std::vector<float> &x, double f, double sampleRate) {
+  const double coeff = 2.0 * std::cos(2.0 * pi * f / sampleRate);
+  double s1 = 0.0, s2 = 0.0;
+  for (float v : x) {
+    const double s = (double)v + coeff * s1 - s2;
+    s2 = s1;
+    s1 = s;
+  }
+  return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+// The strongest frequency in [lo, hi]: a scan at one-bin steps, then a
+// parabola through the log magnitudes around the largest.
+double peakFrequency(std::vector<float> x, double sampleRate, double lo,
+                     double hi) {
+  double mean = 0.0;
+  for (float v : x)
+    mean += v;
+  mean /= (double)x.size();
+  const double n = (double)x.size();
+  for (size_t i = 0; i < x.size(); ++i)
+    x[i] = (float)(((double)x[i] - mean) *
+                   (0.5 - 0.5 * std::cos(2.0 * pi * (double)i / n)));
+
+  const double bin = sampleRate / n;
+  lo = std::max(lo, bin);
+  if (hi <= lo)
+    return lo;
+  double best = lo, bestPower = -1.0;
+  for (double f = lo; f <= hi; f += bin) {
+    const double p = goertzel(x, f, sampleRate);
+    if (p > bestPower) {
+      bestPower = p;
+      best = f;
+    }
+  }
+  const double a = std::log(goertzel(x, best - bin, sampleRate) + 1e-30);
+  const double b = std::log(bestPower + 1e-30);
+  const double c = std::log(goertzel(x, best + bin, sampleRate) + 1e-30);
+  const double denominator = a - 2.0 * b + c;
+  const double offset =
+      denominator < 0.0 ? std::clamp(0.5 * (a - c) / denominator, -0.5, 0.5)
+                        : 0.0;
+  return best + offset * bin;
+}
+
+bool close(double measured, double target) {
+  return std::abs(measured - target) <= std::max(0.05, 0.01 * target);
+}
+
+} // namespace
+
+RenderAnalyser::RenderAnalyser(double rate, bool isBinaural, TargetFn fn,
+                               double start)
+    : sampleRate(rate), binaural(isBinaural), target(std::move(fn)),
+      startSeconds(start),
+      stepLength(std::max(1, (int)std::lround(0.1 * rate))),
+      probeLength((int64_t)(probeSeconds * rate)),
+      probeSpacing((int64_t)(probeInterval * rate)) {
+  // BS.1770's pre-filter and RLB high-pass, derived for this rate.
+  double K = std::tan(pi * 1681.974450955533 / rate);
+  const double Q = 0.7071752369554196;
+  const double Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+  const double Vb = std::pow(Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+  const Biquad shelf{(Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0,
+                     (Vh - Vb * K / Q + K * K) / a0, 2.0 * (K * K - 1.0) / a0,
+                     (1.0 - K / Q + K * K) / a0};
+  K = std::tan(pi * 38.13547087602444 / rate);
+  const double Qh = 0.5003270373238773;
+  a0 = 1.0 + K / Qh + K * K;
+  const Biquad highPass{1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0,
+                        (1.0 - K / Qh + K * K) / a0};
+  for (auto &channel : kWeighting)
+    channel = {shelf, highPass};
+  for (auto &history : truePeakInput)
+    history.assign(truePeakTaps - 1, 0.0f);
+}
+
+void RenderAnalyser::process(const float *left, const float *right,
+                             int numSamples) {
+  const float *channels[2] = {left, right};
+
+  for (int c = 0; c < 2; ++c) {
+    const float *x = channels[c];
+    double sum = 0.0;
+    float peak = samplePeak;
+    int64_t knee = 0, hard = 0;
+    for (int i = 0; i < numSamples; ++i) {
+      const float a = std::abs(x[i]);
+      sum += (double)x[i] * (double)x[i];
+      peak = std::max(peak, a);
+      knee += a > kneeOutput;
+      hard += a > hardOutput;
+    }
+    sumSquares[(size_t)c] += sum;
+    samplePeak = peak;
+    report.samplesPastKnee += knee;
+    report.samplesDrivenHard += hard;
+  }
+
+  for (int c = 0; c < 2; ++c)
+    oversamplePeak(c, channels[c], numSamples);
+
+  // Loudness in 100 ms steps; four make a 400 ms gating block.
+  for (int i = 0; i < numSamples; ++i) {
+    const double l = kWeighting[0][1].process(kWeighting[0][0].process(left[i]));
+    const double r =
+        kWeighting[1][1].process(kWeighting[1][0].process(right[i]));
+    stepEnergy += l * l + r * r;
+    if (++stepPosition == stepLength)
+      closeLoudnessStep();
+  }
+
+  // Frequency probes.
+  for (int i = 0; i < numSamples;) {
+    const int64_t position = report.samples + i;
+    if (position < nextProbe) {
+      i += (int)std::min<int64_t>(numSamples - i, nextProbe - position);
+      continue;
+    }
+    const int n = (int)std::min<int64_t>(
+        numSamples - i, probeLength - (int64_t)probeBuffer[0].size());
+    probeBuffer[0].insert(probeBuffer[0].end(), left + i, left + i + n);
+    probeBuffer[1].insert(probeBuffer[1].end(), right + i, right + i + n);
+    i += n;
+    if ((int64_t)probeBuffer[0].size() == probeLength) {
+      measureProbe();
+      nextProbe += probeSpacing;
+    }
+  }
+
+  report.samples += numSamples;
+}
+
+void RenderAnalyser::oversamplePeak(int channel, const float *x,
+                                    int numSamples) {
+  // Each phase is a short FIR over the input; running it tap by tap over
+  // the whole block keeps the inner loop a vectorisable multiply-add.
+  auto &input = truePeakInput[(size_t)channel];
+  input.insert(input.end(), x, x + numSamples);
+  oversampled.resize((size_t)numSamples);
+  float *out = oversampled.data();
+  // Eight running maxima, so the search isn't one long dependency chain.
+  float peak[8] = {};
+  for (const auto &phase : truePeakFilter) {
+    std::fill(oversampled.begin(), oversampled.end(), 0.0f);
+    for (int k = 0; k < truePeakTaps; ++k) {
+      const float h = phase[k];
+      const float *in = input.data() + (truePeakTaps - 1 - k);
+      for (int i = 0; i < numSamples; ++i)
+        out[i] += h * in[i];
+    }
+    int i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+      for (int j = 0; j < 8; ++j)
+        peak[j] = std::max(peak[j], std::abs(out[i + j]));
+    for (; i < numSamples; ++i)
+      peak[0] = std::max(peak[0], std::abs(out[i]));
+  }
+  truePeak = std::max(truePeak, *std::max_element(peak, peak + 8));
+  input.erase(input.begin(), input.end() - (truePeakTaps - 1));
+}
+
+void RenderAnalyser::closeLoudnessStep() {
+  lastSteps[(size_t)(stepsSeen % 4)] = stepEnergy / (double)stepLength;
+  stepEnergy = 0.0;
+  stepPosition = 0;
+  if (++stepsSeen >= 4)
+    blockEnergies.push_back(
+        (lastSteps[0] + lastSteps[1] + lastSteps[2] + lastSteps[3]) / 4.0);
+}
+
+void RenderAnalyser::measureProbe() {
+  Probe probe;
+  probe.seconds =
+      startSeconds + (double)nextProbe / sampleRate + probeSeconds / 2.0;
+  probe.target = target(probe.seconds);
+  const double pulse = probe.target.pulse;
+  const double carrier = probe.target.carrier;
+
+  if (binaural) {
+    // Each ear's carrier, searched within half the beat of its target.
+    const double span = std::max(0.5, 0.4 * pulse);
+    const double fl = peakFrequency(probeBuffer[0], sampleRate,
+                                    carrier - pulse / 2.0 - span,
+                                    carrier - pulse / 2.0 + span);
+    const double fr = peakFrequency(probeBuffer[1], sampleRate,
+                                    carrier + pulse / 2.0 - span,
+                                    carrier + pulse / 2.0 + span);
+    probe.measured = {fr - fl, (fl + fr) / 2.0};
+  } else {
+    // The pulse's sidebands sit a pulse away from the carrier, so the
+    // search stays inside them.
+    const double span = std::max(0.5, std::min(0.4 * pulse, 0.05 * carrier));
+    const double fc = peakFrequency(probeBuffer[0], sampleRate,
+                                    carrier - span, carrier + span);
+    std::vector<float> power(probeBuffer[0].size());
+    for (size_t i = 0; i < power.size(); ++i)
+      power[i] = probeBuffer[0][i] * probeBuffer[0][i];
+    const double fp =
+        peakFrequency(std::move(power), sampleRate, 0.75 * pulse, 1.25 * pulse);
+    probe.measured = {fp, fc};
+  }
+  probe.pulseOk = close(probe.measured.pulse, pulse);
+  probe.carrierOk = close(probe.measured.carrier, carrier);
+  report.probes.push_back(probe);
+
+  for (auto &b : probeBuffer)
+    b.clear();
+}
+
+RenderAnalyser::Report RenderAnalyser::finish() {
+  const std::vector<float> silence(truePeakTaps - 1, 0.0f);
+  for (int c = 0; c < 2; ++c)
+    oversamplePeak(c, silence.data(), (int)silence.size());
+
+  report.samplePeakDb = toDb(samplePeak);
+  report.truePeakDb = toDb(std::max(truePeak, samplePeak));
+  for (int c = 0; c < 2; ++c)
+    if (report.samples > 0)
+      report.rmsDb[(size_t)c] = toDb(
+          std::sqrt(sumSquares[(size_t)c] / (double)report.samples));
+
+  auto loudness = [](double energy) {
+    return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -1000.0;
+  };
+  double sum = 0.0;
+  int count = 0;
+  for (double e : blockEnergies)
+    if (loudness(e) > -70.0) {
+      sum += e;
+      ++count;
+    }
+  if (count > 0) {
+    const double relativeGate = loudness(sum / count) - 10.0;
+    sum = 0.0;
+    count = 0;
+    for (double e : blockEnergies)
+      if (loudness(e) > -70.0 && loudness(e) > relativeGate) {
+        sum += e;
+        ++count;
+      }
+    report.integratedLufs = loudness(sum / count);
+  }
+  return report;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Quality checks on a stereo render, computed from its blocks as they go
+// to the writer so nothing is read back from disk:
+//
+// - sample peak, and true peak from BS.1770's 4x oversampling filter;
+// - RMS per channel, and integrated loudness (BS.1770 K-weighting, 400 ms
+//   blocks with 75% overlap, -70 LUFS absolute and -10 LU relative gates);
+// - how many samples left the saturator past its knee. The saturator is
+//   tanh, so an output above tanh(x) means an input above x: "past the
+//   knee" is an input over 1.0, "driven hard" one over 2.0;
+// - probes of a few seconds at a fixed interval that measure the pulse and
+//   carrier frequencies and compare them with what the session asked for.
+//
+// Frequencies are measured with Goertzel filters over a Hann window, a
+// scan at one-bin steps around the target and a parabolic fit to the
+// peak. The carrier is the strongest line near its target. For isochronic
+// output the pulse is the strongest line of the squared signal near its
+// target; for binaural output it is the difference of the two channels'
+// carriers.
+class RenderAnalyser {
+public:
+  // Pulse and carrier the session asks for at a time in seconds.
+  struct Target {
+    double pulse;
+    double carrier;
+  };
+  using TargetFn = std::function<Target(double seconds)>;
+
+  struct Probe {
+    double seconds;
+    Target target;
+    Target measured;
+    bool pulseOk;
+    bool carrierOk;
+  };
+
+  struct Report {
+    int64_t samples = 0;
+    double samplePeakDb = -1000.0;
+    double truePeakDb = -1000.0;
+    std::array<double, 2> rmsDb{-1000.0, -1000.0};
+    // -1000 when every block is below the absolute gate.
+    double integratedLufs = -1000.0;
+    int64_t samplesPastKnee = 0;
+    int64_t samplesDrivenHard = 0;
+    std::vector<Probe> probes;
+  };
+
+  // startSeconds is where the first block sits on the session's timeline,
+  // for excerpts.
+  RenderAnalyser(double sampleRate, bool binaural, TargetFn target,
+                 double startSeconds = 0.0);
+
+  void process(const float *left, const float *right, int numSamples);
+
+  Report finish();
+
+  // Seconds of audio between the starts of two probes, and each probe's
+  // length.
+  static constexpr double probeInterval = 60.0;
+  static constexpr double probeSeconds = 4.0;
+
+private:
+  struct Biquad {
+    double b0, b1, b2, a1, a2;
+    double z1 = 0.0, z2 = 0.0;
+    double process(double x) {
+      const double y = b0 * x + z1;
+      z1 = b1 * x - a1 * y + z2;
+      z2 = b2 * x - a2 * y;
+      return y;
+    }
+  };
+
+  void oversamplePeak(int channel, const float *x, int numSamples);
+  void measureProbe();
+  void closeLoudnessStep();
+
+  double sampleRate;
+  bool binaural;
+  TargetFn target;
+  double startSeconds;
+  Report report;
+
+  std::array<double, 2> sumSquares{};
+  float samplePeak = 0.0f;
+
+  // The last taps - 1 samples of each channel, then the block.
+  std::array<std::vector<float>, 2> truePeakInput;
+  std::vector<float> oversampled;
+  float truePeak = 0.0f;
+
+  // Two K-weighting stages per channel.
+  std::array<std::array<Biquad, 2>, 2> kWeighting;
+  int stepLength;
+  int stepPosition = 0;
+  double stepEnergy = 0.0;
+  std::array<double, 4> lastSteps{};
+  int stepsSeen = 0;
+  std::vector<double> blockEnergies;
+
+  int64_t probeLength;
+  int64_t probeSpacing;
+  int64_t nextProbe = 0;
+  std::array<std::vector<float>, 2> probeBuffer;
+};
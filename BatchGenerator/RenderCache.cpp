@@ -0,0 +1,235 @@
+#include "RenderCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char *pendingMarker = ".partial-";
+// Pending files this old belong to renders that died.
+constexpr auto abandonedAfter = std::chrono::hours(24);
+
+std::string sessionName(uint64_t session) {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+                static_cast<unsigned long long>(session));
+  return name;
+}
+
+void touch(const fs::path &path) {
+  std::error_code error;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+}
+
+} // namespace
+
+RenderCache::RenderCache(fs::path dir, int64_t limit)
+    : directory(std::move(dir)), maxBytes(limit) {
+  std::error_code error;
+  fs::create_directories(directory, error);
+}
+
+fs::path RenderCache::pathFor(const Key &key) const {
+  return directory / (sessionName(key.session) + "-" +
+                      std::to_string(key.samples) + "." + key.extension);
+}
+
+std::optional<RenderCache::Entry> RenderCache::find(const Key &key,
+                                                    bool allowPrefix) {
+  std::error_code error;
+  const fs::path exact = pathFor(key);
+  if (fs::is_regular_file(exact, error)) {
+    touch(exact);
+    return Entry{exact, key.samples};
+  }
+  if (!allowPrefix)
+    return std::nullopt;
+
+  const std::string prefix = sessionName(key.session) + "-";
+  const std::string suffix = "." + key.extension;
+  std::optional<Entry> best;
+  for (const auto &item : fs::directory_iterator(directory, error)) {
+    const std::string name = item.path().filename().string();
+    if (name.size() <= prefix.size() + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+    const std::string digits = name.substr(
+        prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos)
+      continue;
+    const int64_t samples = std::stoll(digits);
+    if (samples >= key.samples && (!best || samples < best->samples))
+      best = Entry{item.path(), samples};
+  }
+  if (best)
+    touch(best->path);
+  return best;
+}
+
+fs::path RenderCache::pendingPath(const Key &key) const {
+  std::random_device random;
+  const uint64_t token = (uint64_t(random()) << 32) | random();
+  return pathFor(key).string() + pendingMarker + sessionName(token);
+}
+
+void RenderCache::add(const Key &key, const fs::path &pending) {
+  std::error_code error;
+  fs::permissions(pending,
+                  fs::perms::owner_read | fs::perms::group_read |
+                      fs::perms::others_read,
+                  error);
+  fs::rename(pending, pathFor(key), error);
+  if (error)
+    fs::remove(pending, error);
+  trim();
+}
+
+void RenderCache::addCopyOf(const Key &key, const fs::path &output) {
+  const fs::path pending = pendingPath(key);
+  if (cloneFile(output, pending))
+    add(key, pending);
+}
+
+void RenderCache::trim() {
+  struct Item {
+    fs::path path;
+    fs::file_time_type modified;
+    int64_t bytes;
+  };
+  std::vector<Item> items;
+  int64_t total = 0;
+  std::error_code error;
+  const auto now = fs::file_time_type::clock::now();
+  for (const auto &item : fs::directory_iterator(directory, error)) {
+    if (!item.is_regular_file(error))
+      continue;
+    const auto modified = item.last_write_time(error);
+    if (item.path().filename().string().find(pendingMarker) !=
+        std::string::npos) {
+      if (now - modified > abandonedAfter)
+        fs::remove(item.path(), error);
+      continue;
+    }
+    const auto bytes = static_cast<int64_t>(item.file_size(error));
+    items.push_back({item.path(), modified, bytes});
+    total += bytes;
+  }
+
+  std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+    return a.modified < b.modified;
+  });
+  for (const auto &item : items) {
+    if (total <= maxBytes)
+      break;
+    if (fs::remove(item.path, error))
+      total -= item.bytes;
+  }
+}
+
+namespace {
+
+uint32_t readLE32(const unsigned char *p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+         uint32_t(p[3]) << 24;
+}
+
+uint64_t readLE64(const unsigned char *p) {
+  return uint64_t(readLE32(p)) | uint64_t(readLE32(p + 4)) << 32;
+}
+
+} // namespace
+
+bool copyCachedSamples(const fs::path &source, int64_t numBytes,
+                       PcmStreamWriter &target) {
+  std::ifstream in(source, std::ios::binary);
+  unsigned char header[12];
+  if (!in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      (std::memcmp(header, "RIFF", 4) != 0 &&
+       std::memcmp(header, "RF64", 4) != 0) ||
+      std::memcmp(header + 8, "WAVE", 4) != 0)
+    return false;
+
+  // Walk the chunks to "data". In RF64 its size is in the ds64 chunk.
+  uint64_t rf64DataBytes = 0;
+  uint64_t dataBytes = 0;
+  for (;;) {
+    unsigned char chunk[8];
+    if (!in.read(reinterpret_cast<char *>(chunk), sizeof(chunk)))
+      return false;
+    const uint32_t size = readLE32(chunk + 4);
+    if (std::memcmp(chunk, "data", 4) == 0) {
+      dataBytes = (size == 0xFFFFFFFFu && rf64DataBytes > 0) ? rf64DataBytes
+                                                              : size;
+      break;
+    }
+    if (std::memcmp(chunk, "ds64", 4) == 0 && size >= 16) {
+      unsigned char ds64[16];
+      if (!in.read(reinterpret_cast<char *>(ds64), sizeof(ds64)))
+        return false;
+      rf64DataBytes = readLE64(ds64 + 8);
+      in.seekg(static_cast<std::streamoff>(size + (size & 1) - 16),
+               std::ios::cur);
+    } else {
+      in.seekg(static_cast<std::streamoff>(size + (size & 1)), std::ios::cur);
+    }
+  }
+  if (dataBytes < static_cast<uint64_t>(numBytes))
+    return false;
+
+  std::vector<char> buffer(1 << 20);
+  while (numBytes > 0) {
+    const auto n = static_cast<std::streamsize>(
+        std::min<int64_t>(numBytes, static_cast<int64_t>(buffer.size())));
+    if (!in.read(buffer.data(), n) ||
+        !target.writeEncoded(buffer.data(), static_cast<size_t>(n)))
+      return false;
+    numBytes -= n;
+  }
+  return true;
+}
+
+bool cloneFile(const fs::path &source, const fs::path &target) {
+  std::error_code error;
+  fs::remove(target, error);
+#if defined(__linux__) && defined(FICLONE)
+  const int in = ::open(source.c_str(), O_RDONLY);
+  if (in >= 0) {
+    const int out = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    bool cloned = false;
+    if (out >= 0) {
+      cloned = ::ioctl(out, FICLONE, in) == 0;
+      ::close(out);
+      if (!cloned)
+        fs::remove(target, error);
+    }
+    ::close(in);
+    if (cloned)
+      return true;
+  }
+#elif defined(__APPLE__)
+  if (::clonefile(source.c_str(), target.c_str(), 0) == 0)
+    return true;
+#endif
+  fs::create_hard_link(source, target, error);
+  if (!error)
+    return true;
+  return fs::copy_file(source, target, fs::copy_options::overwrite_existing,
+                       error);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "PcmStreamWriter.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// A directory of finished renders, addressed by what they contain. Each
+// entry is named "<session>-<samples>.<extension>", where session hashes
+// every parameter that reaches the samples except the length. The engine
+// only looks backwards, so the first N samples of a session don't depend
+// on how long it runs: an entry can serve any shorter request of the same
+// session as its prefix.
+//
+// Entries are only ever added whole (written elsewhere, then renamed in),
+// so several processes can share a cache. Each hit refreshes the entry's
+// modification time, and the oldest entries go once the cache is over its
+// size limit. Entries are read-only: an output hard-linked to one shares
+// its bytes, and must be replaced rather than rewritten in place.
+class RenderCache {
+public:
+  struct Key {
+    uint64_t session = 0;
+    int64_t samples = 0;
+    // "wav" or "flac".
+    std::string extension;
+  };
+
+  struct Entry {
+    std::filesystem::path path;
+    int64_t samples = 0;
+  };
+
+  // Creates the directory if it doesn't exist yet.
+  RenderCache(std::filesystem::path directory, int64_t maxBytes);
+
+  // The entry for exactly this key or, with allowPrefix, the shortest
+  // longer entry of the same session.
+  std::optional<Entry> find(const Key &key, bool allowPrefix);
+
+  // Where to write a new entry before add() renames it into the cache.
+  std::filesystem::path pendingPath(const Key &key) const;
+
+  // Moves a finished pending file into the cache, or clones a finished
+  // output into it, then trims the cache to its size limit.
+  void add(const Key &key, const std::filesystem::path &pending);
+  void addCopyOf(const Key &key, const std::filesystem::path &output);
+
+private:
+  std::filesystem::path pathFor(const Key &key) const;
+  void trim();
+
+  std::filesystem::path directory;
+  int64_t maxBytes;
+};
+
+// Writes the first numBytes of a cached WAV file's sample data to target,
+// which must use the same sample format. Returns false if the file isn't a
+// WAV or RF64 file with that much data, or writing fails.
+bool copyCachedSamples(const std::filesystem::path &source, int64_t numBytes,
+                       PcmStreamWriter &target);
+
+// Puts a copy of `source` at `target` (replacing it) as cheaply as the
+// filesystem allows: a copy-on-write clone, a hard link, else a real copy.
+// Returns false if all three failed.
+bool cloneFile(const std::filesystem::path &source,
+               const std::filesystem::path &target);
@@ -0,0 +1,125 @@
+#include "RenderCheckpoint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr char magic[8] = {'I', 'B', 'G', 'C', 'K', 'P', 'T', '1'};
+// Enough of the output's tail to notice it was rewritten or truncated.
+constexpr int64_t tailHashBytes = 64 * 1024;
+
+// Hash of [end - tailHashBytes, end) of the file, or 0 if it can't be read.
+uint64_t hashTail(const juce::File &file, int64_t end) {
+  auto in = file.createInputStream();
+  if (!in)
+    return 0;
+  const int64_t start = std::max<int64_t>(0, end - tailHashBytes);
+  std::vector<char> bytes(static_cast<size_t>(end - start));
+  if (!in->setPosition(start) ||
+      in->read(bytes.data(), bytes.size()) != static_cast<int>(bytes.size()))
+    return 0;
+  return hashBytes(bytes.data(), bytes.size());
+}
+
+} // namespace
+
+uint64_t hashBytes(const void *data, size_t numBytes, uint64_t hash) {
+  const auto *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < numBytes; ++i)
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+juce::File checkpointFileFor(const std::string &outputPath) {
+  return juce::File(juce::File(outputPath).getFullPathName() + ".checkpoint");
+}
+
+RenderCheckpoint loadCheckpoint(const std::string &outputPath,
+                                uint64_t jobHash) {
+  const juce::File file = checkpointFileFor(outputPath);
+  juce::MemoryBlock data;
+  if (!file.existsAsFile() || !file.loadFileAsData(data))
+    throw std::runtime_error("No checkpoint for " + outputPath +
+                             "; nothing to resume");
+  const std::string where = file.getFullPathName().toStdString() + ": ";
+
+  juce::MemoryInputStream in(data, false);
+  char header[sizeof(magic)];
+  if (in.read(header, sizeof(header)) != static_cast<int>(sizeof(header)) ||
+      std::memcmp(header, magic, sizeof(magic)) != 0)
+    throw std::runtime_error(where + "not a checkpoint file");
+
+  RenderCheckpoint checkpoint;
+  checkpoint.jobHash = static_cast<uint64_t>(in.readInt64());
+  checkpoint.samplesWritten = in.readInt64();
+  checkpoint.byteOffset = in.readInt64();
+  checkpoint.tailHash = static_cast<uint64_t>(in.readInt64());
+  const int64_t stateBytes = in.readInt64();
+  if (stateBytes < 0 || stateBytes > in.getNumBytesRemaining())
+    throw std::runtime_error(where + "checkpoint is truncated");
+  checkpoint.engineState.setSize(static_cast<size_t>(stateBytes));
+  in.read(checkpoint.engineState.getData(), static_cast<size_t>(stateBytes));
+
+  if (checkpoint.jobHash != jobHash)
+    throw std::runtime_error(where +
+                             "saved by a different session; the arguments "
+                             "must match the interrupted render");
+
+  // The output must still hold our WAV header and at least the data the
+  // checkpoint covers, ending in the same bytes.
+  const juce::File output(outputPath);
+  if (output.getSize() < checkpoint.byteOffset ||
+      checkpoint.byteOffset < PcmStreamWriter::seekableHeaderBytes)
+    throw std::runtime_error(outputPath + " is shorter than its checkpoint");
+  char wavHeader[PcmStreamWriter::seekableHeaderBytes];
+  auto stream = output.createInputStream();
+  if (!stream ||
+      stream->read(wavHeader, sizeof(wavHeader)) !=
+          static_cast<int>(sizeof(wavHeader)) ||
+      std::memcmp(wavHeader + 8, "WAVE", 4) != 0 ||
+      std::memcmp(wavHeader + sizeof(wavHeader) - 8, "data", 4) != 0)
+    throw std::runtime_error(outputPath +
+                             " is not the WAV file its checkpoint was for");
+  if (hashTail(output, checkpoint.byteOffset) != checkpoint.tailHash)
+    throw std::runtime_error(outputPath +
+                             " has changed since its last checkpoint");
+  return checkpoint;
+}
+
+CheckpointWriter::CheckpointWriter(std::string path, uint64_t hash,
+                                   PcmStreamWriter &w, int64_t intervalSamples,
+                                   int64_t startSample)
+    : outputPath(std::move(path)), jobHash(hash), writer(w),
+      interval(std::max<int64_t>(1, intervalSamples)),
+      next(startSample + interval) {}
+
+bool CheckpointWriter::claim(int64_t samplesWritten) {
+  if (samplesWritten < next)
+    return false;
+  next = samplesWritten + interval;
+  return true;
+}
+
+bool CheckpointWriter::write(int64_t samplesWritten,
+                             juce::MemoryBlock engineState) {
+  if (!writer.flush())
+    return false;
+  const int64_t byteOffset = writer.getBytesWritten();
+
+  juce::MemoryOutputStream out;
+  out.write(magic, sizeof(magic));
+  out.writeInt64(static_cast<juce::int64>(jobHash));
+  out.writeInt64(samplesWritten);
+  out.writeInt64(byteOffset);
+  out.writeInt64(static_cast<juce::int64>(
+      hashTail(juce::File(outputPath), byteOffset)));
+  out.writeInt64(static_cast<juce::int64>(engineState.getSize()));
+  out.write(engineState.getData(), engineState.getSize());
+  return checkpointFileFor(outputPath)
+      .replaceWithData(out.getData(), out.getDataSize());
+}
+
+void CheckpointWriter::remove() { checkpointFileFor(outputPath).deleteFile(); }
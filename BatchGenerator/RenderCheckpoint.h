@@ -0,0 +1,64 @@
+#pragma once
+
+#include "PcmStreamWriter.h"
+
+#include <cstdint>
+#include <juce_core/juce_core.h>
+#include <string>
+
+// Where a render stood when it last checkpointed. It is saved next to the
+// output as "<output>.checkpoint" so that a render killed part way can
+// carry on with --resume instead of starting again.
+struct RenderCheckpoint {
+  // Hash of the arguments that shape the audio, so a resume can't carry on
+  // a different session.
+  uint64_t jobHash = 0;
+  int64_t samplesWritten = 0;
+  // Size of the output once those samples are in it.
+  int64_t byteOffset = 0;
+  // Hash of the output's last bytes before byteOffset, to catch a file
+  // that changed since.
+  uint64_t tailHash = 0;
+  // ToneEngine::saveState after samplesWritten. Empty for segmented
+  // renders, which seek and warm up at any position anyway.
+  juce::MemoryBlock engineState;
+};
+
+// 64-bit FNV-1a, continuing from `hash`.
+uint64_t hashBytes(const void *data, size_t numBytes,
+                   uint64_t hash = 0xcbf29ce484222325ULL);
+
+juce::File checkpointFileFor(const std::string &outputPath);
+
+// Reads the checkpoint for outputPath and checks it against jobHash and
+// the output on disk. Throws std::runtime_error saying why it can't be
+// used.
+RenderCheckpoint loadCheckpoint(const std::string &outputPath,
+                                uint64_t jobHash);
+
+// Saves checkpoints of one render every intervalSamples. The output is
+// flushed (and with it synced to disk) before each checkpoint replaces the
+// previous one, so a checkpoint never points past data that could be lost.
+class CheckpointWriter {
+public:
+  CheckpointWriter(std::string outputPath, uint64_t jobHash,
+                   PcmStreamWriter &writer, int64_t intervalSamples,
+                   int64_t startSample);
+
+  // True, once per interval, when a checkpoint is due at samplesWritten.
+  bool claim(int64_t samplesWritten);
+
+  // Call from the thread that writes the output, after samplesWritten
+  // samples have gone to the writer. Returns false if anything failed.
+  bool write(int64_t samplesWritten, juce::MemoryBlock engineState);
+
+  // The render finished, so the checkpoint has nothing left to resume.
+  void remove();
+
+private:
+  std::string outputPath;
+  uint64_t jobHash;
+  PcmStreamWriter &writer;
+  int64_t interval;
+  int64_t next;
+};
@@ -0,0 +1,363 @@
+#include "RenderScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr double segmentSeconds = 60.0;
+constexpr double warmUpSeconds = 4.0;
+constexpr int64_t bytesPerFrame = 2 * sizeof(float);
+
+using Clock = std::chrono::steady_clock;
+
+struct ActiveJob {
+  RenderJob *spec = nullptr;
+  size_t index = 0;
+  std::unique_ptr<juce::AudioFormatWriter> writer;
+  int64_t segmentLength = 0;
+  int64_t numSegments = 0;
+  int64_t window = 0;
+  int64_t reservedBytes = 0;
+  Clock::time_point start;
+
+  std::mutex mutex;
+  std::vector<juce::AudioBuffer<float>> segments;
+  std::vector<char> ready;
+  int64_t nextToWrite = 0;
+  int64_t samplesWritten = 0;
+  bool writing = false;
+  std::string error;
+  // Tasks queued or running. The job is done when this drops to zero.
+  std::atomic<int64_t> outstanding{0};
+  std::atomic<bool> failed{false};
+};
+
+// A segment of a job, or the whole job when segment is -1.
+struct Task {
+  ActiveJob *job;
+  int64_t segment;
+};
+
+class Scheduler {
+public:
+  Scheduler(std::vector<RenderJob> &jobsToRun, const SchedulerOptions &opts)
+      : jobs(jobsToRun), options(opts) {
+    numThreads = std::max(1, options.numThreads);
+    for (int i = 0; i < numThreads; ++i)
+      queues.push_back(std::make_unique<Queue>());
+  }
+
+  std::vector<JobReport> run() {
+    std::vector<JobReport> reports(jobs.size());
+    std::vector<std::thread> pool;
+    for (int i = 0; i < numThreads; ++i)
+      pool.emplace_back([this, i] { workerLoop(i); });
+
+    std::vector<std::unique_ptr<ActiveJob>> active;
+    int64_t reservedBytes = 0;
+    size_t nextJob = 0;
+    while (nextJob < jobs.size() || !active.empty()) {
+      // Start as many jobs as the memory budget allows, and always at
+      // least one so a single oversized job still runs.
+      while (nextJob < jobs.size()) {
+        int64_t need = reservationFor(jobs[nextJob]);
+        if (!active.empty() &&
+            reservedBytes + need > options.memoryBudgetBytes)
+          break;
+        auto job = start(jobs[nextJob], nextJob, need);
+        ++nextJob;
+        if (job->failed) {
+          finish(*job, reports);
+          continue;
+        }
+        reservedBytes += need;
+        active.push_back(std::move(job));
+      }
+      // Every job left may have failed to open.
+      if (active.empty())
+        continue;
+
+      std::unique_lock<std::mutex> lock(doneMutex);
+      jobDone.wait(lock, [&] { return !doneJobs.empty(); });
+      auto finished = std::move(doneJobs);
+      doneJobs.clear();
+      lock.unlock();
+      for (ActiveJob *job : finished) {
+        reservedBytes -= job->reservedBytes;
+        finish(*job, reports);
+        active.erase(std::find_if(active.begin(), active.end(),
+                                  [job](const auto &a) {
+                                    return a.get() == job;
+                                  }));
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(idleMutex);
+      stopping = true;
+    }
+    idle.notify_all();
+    for (auto &t : pool)
+      t.join();
+    return reports;
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  int64_t segmentLengthFor(const RenderJob &job) const {
+    return static_cast<int64_t>(job.settings.sampleRate * segmentSeconds);
+  }
+
+  // Whole-job renders hold about one segment (the loop tile); segmented
+  // jobs hold up to their window of finished and in-progress segments.
+  int64_t reservationFor(const RenderJob &job) const {
+    const int64_t segmentBytes = segmentLengthFor(job) * bytesPerFrame;
+    if (job.renderWhole)
+      return segmentBytes;
+    return windowFor(job) * segmentBytes;
+  }
+
+  int64_t numSegmentsFor(const RenderJob &job) const {
+    const int64_t segmentLength = segmentLengthFor(job);
+    const int64_t remaining =
+        std::max<int64_t>(0, job.settings.totalSamples - job.firstSample);
+    return (remaining + segmentLength - 1) / segmentLength;
+  }
+
+  int64_t windowFor(const RenderJob &job) const {
+    const int64_t segmentLength = segmentLengthFor(job);
+    const int64_t numSegments = numSegmentsFor(job);
+    const int64_t byBudget =
+        options.memoryBudgetBytes / (segmentLength * bytesPerFrame);
+    return std::clamp<int64_t>(std::min<int64_t>(2 * numThreads, byBudget), 1,
+                               std::max<int64_t>(1, numSegments));
+  }
+
+  std::unique_ptr<ActiveJob> start(RenderJob &spec, size_t index,
+                                   int64_t reservation) {
+    auto job = std::make_unique<ActiveJob>();
+    job->spec = &spec;
+    job->index = index;
+    job->reservedBytes = reservation;
+    job->start = Clock::now();
+    try {
+      job->writer = spec.openWriter();
+    } catch (const std::exception &e) {
+      job->error = e.what();
+      job->failed = true;
+      return job;
+    }
+
+    if (spec.renderWhole) {
+      push({job.get(), -1}, static_cast<int>(index % queues.size()));
+      return job;
+    }
+
+    job->segmentLength = segmentLengthFor(spec);
+    job->numSegments = numSegmentsFor(spec);
+    job->samplesWritten = spec.firstSample;
+    job->window = windowFor(spec);
+    job->segments.resize(static_cast<size_t>(job->numSegments));
+    job->ready.assign(static_cast<size_t>(job->numSegments), 0);
+    if (job->numSegments == 0) {
+      signalDone(*job);
+      return job;
+    }
+    // Spread the first window over the workers; thieves even it out.
+    for (int64_t s = 0; s < std::min(job->window, job->numSegments); ++s)
+      push({job.get(), s}, static_cast<int>((index + s) % queues.size()));
+    return job;
+  }
+
+  void finish(ActiveJob &job, std::vector<JobReport> &reports) {
+    job.writer.reset();
+    JobReport &report = reports[job.index];
+    report.name = job.spec->name;
+    report.note = job.spec->note;
+    report.audioSeconds =
+        (double)(job.spec->settings.totalSamples - job.spec->firstSample) /
+        job.spec->settings.sampleRate;
+    report.wallSeconds =
+        std::chrono::duration<double>(Clock::now() - job.start).count();
+    report.succeeded = !job.failed;
+    report.error = job.error;
+    if (options.onJobDone)
+      options.onJobDone(report);
+  }
+
+  void push(Task task, int queueIndex) {
+    task.job->outstanding.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(queues[(size_t)queueIndex]->mutex);
+      queues[(size_t)queueIndex]->tasks.push_back(task);
+    }
+    {
+      std::lock_guard<std::mutex> lock(idleMutex);
+      ++queued;
+    }
+    idle.notify_one();
+  }
+
+  // Newest task from our own queue, else the oldest from someone else's.
+  bool take(int self, Task &task) {
+    {
+      Queue &own = *queues[(size_t)self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        task = own.tasks.back();
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (int i = 1; i < numThreads; ++i) {
+      Queue &other = *queues[(size_t)((self + i) % numThreads)];
+      std::lock_guard<std::mutex> lock(other.mutex);
+      if (!other.tasks.empty()) {
+        task = other.tasks.front();
+        other.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void workerLoop(int self) {
+    juce::AudioBuffer<float> warmUp(2, 8192);
+    for (;;) {
+      // Claim a task first, then find it. Every claim is backed by a task
+      // already sitting in some queue, so the search can only lose races
+      // for a moment, never come back empty for good.
+      {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idle.wait(lock, [&] { return stopping || queued > 0; });
+        if (queued == 0)
+          return;
+        --queued;
+      }
+      Task task;
+      while (!take(self, task))
+        std::this_thread::yield();
+      execute(task, self, warmUp);
+      if (task.job->outstanding.fetch_sub(1) == 1)
+        signalDone(*task.job);
+    }
+  }
+
+  void execute(Task task, int self, juce::AudioBuffer<float> &warmUp) {
+    ActiveJob &job = *task.job;
+    if (job.failed)
+      return;
+    try {
+      if (task.segment < 0)
+        job.spec->renderWhole(*job.writer);
+      else
+        renderSegment(job, task.segment, self, warmUp);
+    } catch (const std::exception &e) {
+      std::lock_guard<std::mutex> lock(job.mutex);
+      if (!job.failed.exchange(true))
+        job.error = e.what();
+    }
+  }
+
+  void renderSegment(ActiveJob &job, int64_t index, int self,
+                     juce::AudioBuffer<float> &warmUp) {
+    const SessionSettings &settings = job.spec->settings;
+    const int64_t warmUpLength =
+        static_cast<int64_t>(settings.sampleRate * warmUpSeconds);
+    const int64_t start = job.spec->firstSample + index * job.segmentLength;
+    const int length = static_cast<int>(
+        std::min(job.segmentLength, settings.totalSamples - start));
+    const int64_t warmUpStart = std::max<int64_t>(0, start - warmUpLength);
+
+    auto engine = createToneEngine(settings);
+    engine->seek(warmUpStart);
+    for (int64_t pos = warmUpStart; pos < start;) {
+      int n = static_cast<int>(
+          std::min<int64_t>(warmUp.getNumSamples(), start - pos));
+      engine->render(warmUp.getWritePointer(0), warmUp.getWritePointer(1), n);
+      pos += n;
+    }
+    juce::AudioBuffer<float> audio(2, length);
+    engine->render(audio.getWritePointer(0), audio.getWritePointer(1), length);
+
+    // Hand the segment over. Whoever finds the writer idle writes every
+    // segment that is ready in order; the others just leave theirs.
+    {
+      std::lock_guard<std::mutex> lock(job.mutex);
+      job.segments[(size_t)index] = std::move(audio);
+      job.ready[(size_t)index] = 1;
+      if (job.writing)
+        return;
+      job.writing = true;
+    }
+    for (;;) {
+      juce::AudioBuffer<float> next;
+      int64_t writeIndex;
+      {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        writeIndex = job.nextToWrite;
+        if (job.failed || writeIndex >= job.numSegments ||
+            !job.ready[(size_t)writeIndex]) {
+          job.writing = false;
+          return;
+        }
+        next = std::move(job.segments[(size_t)writeIndex]);
+      }
+      if (!job.writer->writeFromAudioSampleBuffer(next, 0,
+                                                  next.getNumSamples()))
+        throw std::runtime_error("Writing the output failed");
+      int64_t written;
+      {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.nextToWrite = writeIndex + 1;
+        job.samplesWritten += next.getNumSamples();
+        written = job.samplesWritten;
+      }
+      // The written segment's slot in the window is free again.
+      if (writeIndex + job.window < job.numSegments)
+        push({&job, writeIndex + job.window}, self);
+      if (options.onProgress)
+        options.onProgress(*job.spec, written);
+    }
+  }
+
+  void signalDone(ActiveJob &job) {
+    {
+      std::lock_guard<std::mutex> lock(doneMutex);
+      doneJobs.push_back(&job);
+    }
+    jobDone.notify_one();
+  }
+
+  std::vector<RenderJob> &jobs;
+  const SchedulerOptions &options;
+  int numThreads = 1;
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  std::mutex idleMutex;
+  std::condition_variable idle;
+  int64_t queued = 0;
+  bool stopping = false;
+
+  std::mutex doneMutex;
+  std::condition_variable jobDone;
+  std::vector<ActiveJob *> doneJobs;
+};
+
+} // namespace
+
+std::vector<JobReport> runRenderJobs(std::vector<RenderJob> &jobs,
+                                     const SchedulerOptions &options) {
+  return Scheduler(jobs, options).run();
+}
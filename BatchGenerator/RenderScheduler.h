@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ToneEngine.h"
+
+#include <cstdint>
+#include <functional>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One session to render as part of a batch.
+struct RenderJob {
+  std::string name;
+  SessionSettings settings;
+  // First sample to render: what an earlier run already wrote, or the
+  // start of an excerpt. settings.totalSamples is where rendering stops.
+  int64_t firstSample = 0;
+  // Called when the job starts, so waiting jobs don't hold files open.
+  std::function<std::unique_ptr<juce::AudioFormatWriter>()> openWriter;
+  // If set, the job runs as one task that calls this instead of being
+  // split into segments. The loop cache uses it.
+  std::function<void(juce::AudioFormatWriter &)> renderWhole;
+  // Free text for the report, e.g. why the loop cache was or wasn't used.
+  std::string note;
+};
+
+struct JobReport {
+  std::string name;
+  std::string note;
+  double audioSeconds = 0.0;
+  double wallSeconds = 0.0;
+  bool succeeded = false;
+  std::string error;
+};
+
+struct SchedulerOptions {
+  int numThreads = 1;
+  // Upper bound for rendered audio held in memory across all running jobs.
+  // A job is only started when its share fits, except that one job always
+  // runs.
+  int64_t memoryBudgetBytes = int64_t(2) << 30;
+  // Called from a worker after each block of a job is written. No other
+  // thread touches the job's writer until it returns.
+  std::function<void(const RenderJob &, int64_t samplesWritten)> onProgress;
+  // Called from the calling thread as each job finishes.
+  std::function<void(const JobReport &)> onJobDone;
+};
+
+// Renders every job on one pool of worker threads and returns a report
+// per job, in job order.
+//
+// Jobs are split into 60 second segments. Each segment seeks its own
+// engine and plays a 4 second warm-up so the reverb tails carry across the
+// seam. Every worker has its own deque: it takes its newest task first and,
+// when it runs dry, steals the oldest task of another worker, so the cores
+// stay busy across job boundaries. Finished segments go to the job's
+// writer in order, written by whichever worker completes the next one.
+// Each job keeps only a window of segments in flight, sized to the thread
+// count and the memory budget. A new segment is queued as an old one is
+// written.
+std::vector<JobReport> runRenderJobs(std::vector<RenderJob> &jobs,
+                                     const SchedulerOptions &options);
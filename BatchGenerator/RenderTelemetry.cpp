@@ -0,0 +1,118 @@
+#include "RenderTelemetry.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if JUCE_WINDOWS
+#include <io.h>
+#define fdopen _fdopen
+#endif
+
+RenderTelemetry::RenderTelemetry(const std::string &target,
+                                 double intervalSeconds)
+    : interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(std::max(0.05, intervalSeconds)))) {
+  if (target.rfind("fd:", 0) == 0) {
+    file = fdopen(std::stoi(target.substr(3)), "w");
+  } else {
+    file = std::fopen(target.c_str(), "w");
+    ownsFile = true;
+  }
+  if (!file)
+    throw std::runtime_error("Could not open telemetry output " + target);
+}
+
+RenderTelemetry::~RenderTelemetry() {
+  if (thread.joinable())
+    finish(false, "render abandoned");
+  // A descriptor handed over by the caller stays open; only flush it.
+  if (ownsFile)
+    std::fclose(file);
+  else
+    std::fflush(file);
+}
+
+void RenderTelemetry::start(int64_t total, double rate) {
+  totalSamples = total;
+  sampleRate = rate;
+  startTime = lastTime = std::chrono::steady_clock::now();
+  emit("start", true, {});
+  thread = std::thread([this] { run(); });
+}
+
+void RenderTelemetry::finish(bool succeeded, const std::string &error) {
+  if (thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeUp.notify_all();
+    thread.join();
+  }
+  emit("done", succeeded, error);
+}
+
+void RenderTelemetry::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto next = startTime + interval;
+  while (!wakeUp.wait_until(lock, next, [this] { return stopping; })) {
+    emit("progress", true, {});
+    next += interval;
+  }
+}
+
+void RenderTelemetry::emit(const char *event, bool succeeded,
+                           const std::string &error) {
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed = std::chrono::duration<double>(now - startTime).count();
+  const double sinceLast =
+      std::chrono::duration<double>(now - lastTime).count();
+  const int64_t done = samplesDone.load(std::memory_order_relaxed);
+
+  const double rate = elapsed > 0.0 ? (double)done / elapsed : 0.0;
+  const double recentRate =
+      sinceLast > 0.0 ? (double)(done - lastSamples) / sinceLast : 0.0;
+  lastTime = now;
+  lastSamples = done;
+
+  auto *stages = new juce::DynamicObject();
+  const std::pair<const char *, StageTimes::Stage> engine[] = {
+      {"synthesis", StageTimes::Synthesis},
+      {"noise", StageTimes::Noise},
+      {"reverb", StageTimes::Reverb},
+      {"saturation", StageTimes::Saturation}};
+  for (const auto &[name, stage] : engine)
+    stages->setProperty(name, engineStages.seconds(stage));
+  const int64_t write = writeNs.load(std::memory_order_relaxed);
+  const int64_t output = outputNs.load(std::memory_order_relaxed);
+  stages->setProperty("encode",
+                      (double)std::max<int64_t>(0, output - write) * 1e-9);
+  stages->setProperty("write", (double)write * 1e-9);
+
+  auto *line = new juce::DynamicObject();
+  line->setProperty("event", juce::String(event));
+  line->setProperty("elapsed_seconds", elapsed);
+  line->setProperty("samples_done", (juce::int64)done);
+  line->setProperty("total_samples", (juce::int64)totalSamples);
+  line->setProperty("fraction",
+                    totalSamples > 0 ? (double)done / (double)totalSamples
+                                     : 1.0);
+  line->setProperty("samples_per_second", rate);
+  line->setProperty("recent_samples_per_second", recentRate);
+  line->setProperty("realtime_factor", rate / sampleRate);
+  if (rate > 0.0)
+    line->setProperty("eta_seconds",
+                      (double)std::max<int64_t>(0, totalSamples - done) /
+                          rate);
+  line->setProperty("stage_seconds", juce::var(stages));
+  if (std::string(event) == "done") {
+    line->setProperty("succeeded", succeeded);
+    if (!error.empty())
+      line->setProperty("error", juce::String(error));
+  }
+
+  const std::string text =
+      juce::JSON::toString(juce::var(line), true).toStdString();
+  std::fprintf(file, "%s\n", text.c_str());
+  std::fflush(file);
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "ToneEngine.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Machine-readable progress for render farms. A reporter thread writes one
+// JSON object per line to a file or file descriptor at a fixed wall-clock
+// interval, whether or not the render moved, so a stuck job shows up as
+// lines whose sample count stops growing:
+//
+//   {"event":"progress","elapsed_seconds":12.0,"samples_done":...,
+//    "total_samples":...,"fraction":0.02,"samples_per_second":...,
+//    "recent_samples_per_second":...,"realtime_factor":...,
+//    "eta_seconds":...,"stage_seconds":{"synthesis":...,"noise":...,
+//    "reverb":...,"saturation":...,"encode":...,"write":...}}
+//
+// A "start" line comes first and a "done" line, with "succeeded" and any
+// "error", last. Stage times are cumulative thread time summed over every
+// thread, so with --threads they can add up to more than elapsed_seconds.
+// The engine's stages come from its StageTimes; "write" is time in the
+// output streams and "encode" the rest of the time in the output writers.
+// FLAC encodes on threads of its own, so its encode time isn't counted.
+class RenderTelemetry {
+public:
+  // target is "fd:<n>" for an open file descriptor, or a file path.
+  // Throws std::runtime_error if it can't be opened.
+  RenderTelemetry(const std::string &target, double intervalSeconds);
+  ~RenderTelemetry();
+
+  // Writes the start line and starts reporting.
+  void start(int64_t totalSamples, double sampleRate);
+
+  // Samples finished since the last call, from any thread.
+  void addSamples(int64_t numSamples) {
+    samplesDone.fetch_add(numSamples, std::memory_order_relaxed);
+  }
+
+  // Stops reporting and writes the done line.
+  void finish(bool succeeded, const std::string &error = {});
+
+  // For SessionSettings::stageTimes.
+  StageTimes &getEngineStages() { return engineStages; }
+
+  // Time in the output writers, streams included.
+  void addOutputTime(int64_t ns) {
+    outputNs.fetch_add(ns, std::memory_order_relaxed);
+  }
+  // Time in the output streams alone.
+  void addWriteTime(int64_t ns) {
+    writeNs.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+private:
+  void run();
+  void emit(const char *event, bool succeeded, const std::string &error);
+
+  FILE *file = nullptr;
+  bool ownsFile = false;
+  std::chrono::steady_clock::duration interval;
+  double sampleRate = 44100.0;
+  int64_t totalSamples = 0;
+
+  std::atomic<int64_t> samplesDone{0};
+  StageTimes engineStages;
+  std::atomic<int64_t> outputNs{0}, writeNs{0};
+
+  std::chrono::steady_clock::time_point startTime, lastTime;
+  int64_t lastSamples = 0;
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+  std::thread thread;
+};
+
+// Passes everything to another stream and adds the time its writes take
+// to the telemetry's write stage.
+class TimedOutputStream : public juce::OutputStream {
+public:
+  TimedOutputStream(juce::OutputStream *s, RenderTelemetry &t)
+      : stream(s), telemetry(t) {}
+
+  void flush() override {
+    Timer timer(telemetry);
+    stream->flush();
+  }
+  bool setPosition(juce::int64 newPosition) override {
+    return stream->setPosition(newPosition);
+  }
+  juce::int64 getPosition() override { return stream->getPosition(); }
+  bool write(const void *data, size_t numBytes) override {
+    Timer timer(telemetry);
+    return stream->write(data, numBytes);
+  }
+
+private:
+  struct Timer {
+    explicit Timer(RenderTelemetry &t)
+        : telemetry(t), start(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+      telemetry.addWriteTime(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count());
+    }
+    RenderTelemetry &telemetry;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  std::unique_ptr<juce::OutputStream> stream;
+  RenderTelemetry &telemetry;
+};
+
+// Wraps the writer a render hands its float blocks to and adds the time
+// each block spends in it to the telemetry. Like FanOutWriter it takes
+// float data, so nothing is converted twice.
+class TimedWriter : public juce::AudioFormatWriter {
+public:
+  TimedWriter(std::unique_ptr<juce::AudioFormatWriter> w, RenderTelemetry &t)
+      : juce::AudioFormatWriter(nullptr, "Timed", w->getSampleRate(),
+                                (unsigned)w->getNumChannels(), 32),
+        writer(std::move(w)), telemetry(t) {
+    usesFloatingPointData = true;
+  }
+
+  bool write(const int **samples, int numSamples) override {
+    return timed([&] {
+      return writer->writeFromFloatArrays(
+          reinterpret_cast<const float *const *>(samples),
+          (int)numChannels, numSamples);
+    });
+  }
+
+  bool flush() override {
+    return timed([&] { return writer->flush(); });
+  }
+
+private:
+  template <typename F> bool timed(F f) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = f();
+    telemetry.addOutputTime(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    return ok;
+  }
+
+  std::unique_ptr<juce::AudioFormatWriter> writer;
+  RenderTelemetry &telemetry;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "PolyphaseResampler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+
+// Takes float blocks at the render rate and passes them to a writer at
+// another rate through a PolyphaseResampler. The target gets exactly
+// PolyphaseResampler::outputLength of whatever was written here: the
+// filter's tail is flushed when this writer is destroyed, before the
+// target is, so its header is finalised with the full length.
+class ResamplingWriter : public juce::AudioFormatWriter {
+public:
+  ResamplingWriter(std::unique_ptr<juce::AudioFormatWriter> target,
+                   double inputRate)
+      : juce::AudioFormatWriter(nullptr, "Resampler", inputRate,
+                                (unsigned)target->getNumChannels(), 32),
+        writer(std::move(target)),
+        resampler(inputRate, writer->getSampleRate(), (int)numChannels),
+        scratch((int)numChannels, scratchSize) {
+    usesFloatingPointData = true;
+  }
+
+  ~ResamplingWriter() override {
+    resampler.pushSilence(resampler.flushLength());
+    drain(resampler.outputLength(inputSamples) - outputSamples);
+  }
+
+  bool write(const int **samples, int numSamples) override {
+    resampler.push(reinterpret_cast<const float *const *>(samples),
+                   numSamples);
+    inputSamples += numSamples;
+    return drain(resampler.outputLength(inputSamples) - outputSamples);
+  }
+
+  bool flush() override { return writer->flush(); }
+
+private:
+  static constexpr int scratchSize = 8192;
+
+  // Pulls and writes up to maxSamples frames.
+  bool drain(int64_t maxSamples) {
+    bool ok = true;
+    while (maxSamples > 0) {
+      const int n = resampler.pull(
+          scratch.getArrayOfWritePointers(),
+          (int)std::min<int64_t>(maxSamples, scratchSize));
+      if (n == 0)
+        break;
+      ok &= writer->writeFromFloatArrays(scratch.getArrayOfReadPointers(),
+                                         (int)numChannels, n);
+      outputSamples += n;
+      maxSamples -= n;
+    }
+    return ok;
+  }
+
+  std::unique_ptr<juce::AudioFormatWriter> writer;
+  PolyphaseResampler resampler;
+  juce::AudioBuffer<float> scratch;
+  int64_t inputSamples = 0;
+  int64_t outputSamples = 0;
+};
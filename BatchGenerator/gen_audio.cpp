@@ -1,144 +1,44 @@
+#include "AnalysisWriter.h"
+#include "AsyncBlockWriter.h"
+#include "CommandLine.h"
+#include "FanOutWriter.h"
+#include "FlacWriter.h"
+#include "InputMixer.h"
+#include "MappedWavWriter.h"
+#include "PcmStreamWriter.h"
+#include "PolyphaseResampler.h"
+#include "RenderCache.h"
+#include "RenderCheckpoint.h"
+#include "RenderScheduler.h"
+#include "RenderTelemetry.h"
+#include "ResamplingWriter.h"
+#include "ToneEngine.h"
+
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_audio_formats/juce_audio_formats.h>
 #include <juce_core/juce_core.h>
-#include <random>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-// --- Organic Noise Synthesizer ---
-class OrganicNoiseSynth {
-public:
-  enum Type { Brown, Pink, White };
-
-  void prepare(double sampleRateHz, Type noiseType,
-               float targetEntrainmentFreq) {
-    this->sampleRate = sampleRateHz;
-    this->type = noiseType;
-    lastOut = 0.0f;
-    for (int i = 0; i < 7; ++i)
-      pinkRows[i] = 0.0f;
-
-    // Contextual LFO: Higher frequencies get faster "shimming" wind
-    // Lower frequencies get slow, heavy wave swells
-    float lfoHz = (targetEntrainmentFreq < 8.0f) ? 0.05f : 0.2f;
-    lfoPhase = 0.0;
-    lfoIncr =
-        (2.0 * juce::MathConstants<double>::pi * (double)lfoHz) / sampleRate;
-  }
-
-  float process() {
-    float raw = 0.0f;
-    if (type == White) {
-      raw = static_cast<float>(dist(gen));
-    } else if (type == Brown) {
-      float r = static_cast<float>(dist(gen));
-      lastOut = (lastOut + (0.05f * r)) / 1.01f;
-      raw = lastOut * 3.5f;
-    } else if (type == Pink) {
-      float r = static_cast<float>(dist(gen));
-      float sum = 0.0f;
-      for (int i = 0; i < 7; ++i) {
-        if ((pinkCount & (1 << i)) != 0)
-          pinkRows[i] = r;
-        sum += pinkRows[i];
-      }
-      pinkCount++;
-      raw = sum * 0.12f;
-    }
-
-    float lfo = static_cast<float>((std::sin(lfoPhase) + 1.0) * 0.5);
-    lfoPhase += lfoIncr;
-    if (lfoPhase > 2.0 * juce::MathConstants<double>::pi)
-      lfoPhase -= 2.0 * juce::MathConstants<double>::pi;
-
-    // Dynamic Filter: Sweeps the "air" or "depth" of the noise
-    float alpha = 0.005f + (lfo * 0.05f);
-    filterLast = filterLast + alpha * (raw - filterLast);
-    return filterLast;
-  }
-
-private:
-  double sampleRate = 44100.0;
-  Type type = White;
-  float lastOut = 0.0f;
-  float pinkRows[7] = {0};
-  int pinkCount = 0;
-  float filterLast = 0.0f;
-  double lfoPhase = 0.0, lfoIncr = 0.0;
-  std::mt19937 gen{std::random_device{}()};
-  std::uniform_real_distribution<float> dist{-1.0f, 1.0f};
-};
-
-// --- Mastering Chain ---
-class SimpleReverb {
-public:
-  void prepare(double sampleRateHz) {
-    float combTimes[] = {0.0297f, 0.0371f, 0.0411f, 0.0437f};
-    combs.clear();
-    for (float t : combTimes)
-      combs.emplace_back(static_cast<int>(t * sampleRateHz));
-    allPass.prepare(static_cast<int>(0.005f * sampleRateHz), 0.7f);
-  }
-  float process(float input) {
-    if (combs.empty())
-      return input;
-    float combined = 0.0f;
-    for (auto &c : combs)
-      combined += c.process(input);
-    return allPass.process(combined * 0.25f);
-  }
-
-private:
-  struct Comb {
-    std::vector<float> buffer;
-    int idx = 0;
-    float feedback = 0.84f;
-    Comb(int size) : buffer(std::max(1, size), 0.0f) {}
-    float process(float in) {
-      float out = buffer[static_cast<size_t>(idx)];
-      buffer[static_cast<size_t>(idx)] = in + (out * feedback);
-      if (++idx >= static_cast<int>(buffer.size()))
-        idx = 0;
-      return out;
-    }
-  };
-  struct AllPass {
-    std::vector<float> buffer;
-    int idx = 0;
-    float g = 0.5f;
-    void prepare(int size, float gain) {
-      if (size > 0)
-        buffer.assign(static_cast<size_t>(size), 0.0f);
-      g = gain;
-    }
-    float process(float in) {
-      if (buffer.empty())
-        return in;
-      float v = buffer[static_cast<size_t>(idx)];
-      float out = -g * in + v;
-      buffer[static_cast<size_t>(idx)] = in + g * out;
-      if (++idx >= static_cast<int>(buffer.size()))
-        idx = 0;
-      return out;
-    }
-  };
-  std::vector<Comb> combs;
-  AllPass allPass;
-};
-
-struct JourneyPoint {
-  double timeSec;
-  float pulseFreq;
-  float carrierFreq;
-};
+// Time for the reverb tails to fall below -120 dB after a change of state.
+static constexpr double reverbSettleSeconds = 4.0;
 
-std::vector<JourneyPoint> parseJourney(const std::string &pulseStr,
-                                       const std::string &carrierStr,
-                                       double duration) {
+// The original "Quarter Point" journey: five comma separated values each
+// for pulse and carrier, placed at 0, 25, 50, 75 and 100% of the session
+// with linear ramps between them. Returns false on a malformed list.
+static bool parseJourney(const std::string &pulseStr,
+                         const std::string &carrierStr, double duration,
+                         Journey &journey) {
   auto split = [](const std::string &s) {
     std::vector<float> v;
     std::stringstream ss(s);
@@ -150,162 +50,1316 @@ std::vector<JourneyPoint> parseJourney(const std::string &pulseStr,
 
   std::vector<float> pulses = split(pulseStr);
   std::vector<float> carriers = split(carrierStr);
-  std::vector<JourneyPoint> points;
 
   // We expect exactly 5 points for a "Quarter Point" journey
   if (pulses.size() != 5 || carriers.size() != 5)
-    return points;
+    return false;
 
   double milestones[5] = {0.0, 0.25, 0.5, 0.75, 1.0};
   for (int i = 0; i < 5; ++i) {
-    points.push_back({milestones[i] * duration, pulses[i], carriers[i]});
+    journey.pulse.addKeyframe(milestones[i] * duration, pulses[i]);
+    journey.carrier.addKeyframe(milestones[i] * duration, carriers[i]);
   }
-  return points;
+  return true;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc < 7) {
-    std::cout << "Usage: IsochronicBatchGen <output_wav> <duration_seconds> "
-                 "<pulse_freq_or_points> <carrier_freq_or_points> <softness> "
-                 "<type> [gain_db] [noise_type] [noise_level]"
-              << std::endl;
-    return 1;
+// Reads a keyframe file. Each line is
+//
+//   <time> <parameter> <value> [linear|exp|hold]
+//
+// where time is in seconds, may carry an s, m or h suffix, or is a
+// percentage of the session ("75%"). Parameters are pulse and carrier (Hz),
+// gain (dB), softness (0-1) and noise (level). The curve describes how the
+// parameter gets from its previous keyframe to this one and defaults to
+// linear. Blank lines and anything after '#' are ignored. Throws on a bad
+// line.
+static void parseJourneyFile(const std::string &path, double duration,
+                             Journey &journey) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error("Could not open journey file " + path);
+
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(in, line)) {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string timeStr, param, valueStr, curveStr;
+    if (!(fields >> timeStr))
+      continue;
+    auto fail = [&](const std::string &why) {
+      return std::runtime_error(path + ":" + std::to_string(lineNumber) +
+                                ": " + why);
+    };
+    if (!(fields >> param >> valueStr))
+      throw fail("expected <time> <parameter> <value> [curve]");
+    fields >> curveStr;
+
+    double timeSec;
+    try {
+      timeSec = parseTime(timeStr, duration);
+    } catch (const std::runtime_error &e) {
+      throw fail(e.what());
+    }
+
+    CurveShape curve = CurveShape::Linear;
+    if (curveStr == "exp")
+      curve = CurveShape::Exponential;
+    else if (curveStr == "hold")
+      curve = CurveShape::Hold;
+    else if (!curveStr.empty() && curveStr != "linear")
+      throw fail("unknown curve '" + curveStr + "'");
+
+    double value = std::stod(valueStr);
+    if (param == "pulse")
+      journey.pulse.addKeyframe(timeSec, value, curve);
+    else if (param == "carrier")
+      journey.carrier.addKeyframe(timeSec, value, curve);
+    else if (param == "gain")
+      journey.gain.addKeyframe(
+          timeSec, juce::Decibels::decibelsToGain(value, -1000.0), curve);
+    else if (param == "softness")
+      journey.softness.addKeyframe(timeSec, value, curve);
+    else if (param == "noise")
+      journey.noiseLevel.addKeyframe(timeSec, value, curve);
+    else
+      throw fail("unknown parameter '" + param + "'");
   }
+}
 
-  try {
-    juce::File outputFile(argv[1]);
-    double durationSeconds = std::stod(argv[2]);
-    std::string pulseArg = argv[3];
-    std::string carrierArg = argv[4];
-    float softness = std::stof(argv[5]);
-    int entrainmentType = std::stoi(argv[6]);
-    float gainDb = (argc >= 8) ? std::stof(argv[7]) : -10.0f;
-    float gain = juce::Decibels::decibelsToGain(gainDb);
-    int noiseTypeIdx = (argc >= 9) ? std::stoi(argv[8]) : -1;
-    float noiseLevel = (argc >= 10) ? std::stof(argv[9]) : 0.3f;
-
-    bool isJourney = (pulseArg.find(',') != std::string::npos);
-    std::vector<JourneyPoint> journeyPoints;
-    if (isJourney) {
-      journeyPoints = parseJourney(pulseArg, carrierArg, durationSeconds);
-      if (journeyPoints.empty()) {
-        std::cerr << "Error: Invalid journey points (expected 5 values)."
-                  << std::endl;
-        return 1;
-      }
+// Set by --telemetry. Render loops report finished samples to it, engines
+// their stage times, and outputs their encode and write times.
+static std::unique_ptr<RenderTelemetry> telemetry;
+
+// The stream itself, or a wrapper that times its writes for telemetry.
+static juce::OutputStream *timeWrites(juce::OutputStream *stream) {
+  if (!telemetry)
+    return stream;
+  return new TimedOutputStream(stream, *telemetry);
+}
+
+static std::unique_ptr<juce::AudioFormatWriter>
+timeOutput(std::unique_ptr<juce::AudioFormatWriter> writer) {
+  if (!telemetry)
+    return writer;
+  return std::make_unique<TimedWriter>(std::move(writer), *telemetry);
+}
+
+static void printProgress(int64_t samplesProcessed, int64_t totalSamples) {
+  console() << "\rProgress: " << std::fixed << std::setprecision(1)
+            << (100.0 * (double)samplesProcessed / (double)totalSamples)
+            << "%" << std::flush;
+}
+
+// Seeks a new engine to `sample` the way a segment starts: the reverb
+// settle time before it is rendered and thrown away.
+static void warmUpTo(ToneEngine &engine, int64_t sample, double sampleRate) {
+  const int64_t settle = static_cast<int64_t>(sampleRate * reverbSettleSeconds);
+  juce::AudioBuffer<float> warmUp(2, 8192);
+  int64_t pos = std::max<int64_t>(0, sample - settle);
+  engine.seek(pos);
+  while (pos < sample) {
+    int n = static_cast<int>(
+        std::min<int64_t>(warmUp.getNumSamples(), sample - pos));
+    engine.render(warmUp.getWritePointer(0), warmUp.getWritePointer(1), n);
+    pos += n;
+  }
+}
+
+// Brings a new engine to where a checkpoint left off. Serial renders save
+// the engine state, which carries on with the exact samples; segmented
+// renders don't, so the engine warms up the way a segment would.
+static void resumeEngine(ToneEngine &engine, const RenderCheckpoint &from,
+                         double sampleRate) {
+  if (from.engineState.getSize() > 0) {
+    juce::MemoryInputStream state(from.engineState, false);
+    if (!engine.restoreState(state))
+      throw std::runtime_error("The checkpoint's engine state doesn't fit "
+                               "this session");
+    return;
+  }
+  warmUpTo(engine, from.samplesWritten, sampleRate);
+}
+
+// Synthesis runs on this thread and the WAV conversion and disk writes on
+// the writer's, so the render takes about as long as the slower of the two.
+// Checkpoints are taken between blocks: the engine state is copied here
+// and the writer thread saves it once the block before it is on disk. The
+// output starts at firstSample, and ends at settings.totalSamples.
+static void renderSerial(const SessionSettings &settings,
+                         juce::AudioFormatWriter &writer, int blockSize,
+                         int queueDepth, int64_t firstSample = 0,
+                         const RenderCheckpoint *resumeFrom = nullptr,
+                         CheckpointWriter *checkpoints = nullptr) {
+  auto engine = createToneEngine(settings);
+  int64_t samplesProcessed = firstSample;
+  if (resumeFrom) {
+    resumeEngine(*engine, *resumeFrom, settings.sampleRate);
+    samplesProcessed = resumeFrom->samplesWritten;
+  } else if (firstSample > 0) {
+    warmUpTo(*engine, firstSample, settings.sampleRate);
+  }
+  AsyncBlockWriter output(writer, 2, blockSize, queueDepth);
+
+  const int64_t progressInterval =
+      static_cast<int64_t>(settings.sampleRate) * 5;
+  int64_t nextProgress = samplesProcessed + progressInterval;
+  const int64_t totalSamples = settings.totalSamples;
+  while (samplesProcessed < totalSamples) {
+    int64_t samplesThisBlock = std::min(static_cast<int64_t>(blockSize),
+                                        totalSamples - samplesProcessed);
+    auto &buffer = output.acquire();
+    engine->render(buffer.getWritePointer(0), buffer.getWritePointer(1),
+                   static_cast<int>(samplesThisBlock));
+    samplesProcessed += samplesThisBlock;
+    std::function<bool()> afterWrite;
+    if (checkpoints && samplesProcessed < totalSamples &&
+        checkpoints->claim(samplesProcessed)) {
+      juce::MemoryOutputStream state;
+      engine->saveState(state);
+      afterWrite = [checkpoints, at = samplesProcessed,
+                    block = state.getMemoryBlock()] {
+        return checkpoints->write(at, block);
+      };
+    }
+    output.push(static_cast<int>(samplesThisBlock), std::move(afterWrite));
+    if (telemetry)
+      telemetry->addSamples(samplesThisBlock);
+    if (samplesProcessed >= nextProgress || samplesProcessed == totalSamples) {
+      printProgress(samplesProcessed - firstSample,
+                    totalSamples - firstSample);
+      nextProgress += progressInterval;
     }
+  }
+  if (!output.finish())
+    throw std::runtime_error("Writing the output file failed");
+}
 
-    double sampleRate = 44100.0;
-    int64_t totalSamples = static_cast<int64_t>(durationSeconds * sampleRate);
+// Result of looking for a loop period in a session.
+struct LoopPlan {
+  bool usable = false;
+  std::string reason;
+  int64_t period = 0;
+  // Session settings with the frequencies moved onto the period.
+  SessionSettings settings;
+  double maxShiftHz = 0.0;
+};
 
-    juce::WavAudioFormat wavFormat;
-    auto stream = outputFile.createOutputStream();
-    if (!stream) {
-      std::cerr << "Error: Could not create output stream" << std::endl;
-      return 1;
+// Frequencies may move this far to land on a whole number of cycles per
+// period. It covers the rounding from storing values like 7.83 Hz as
+// floats (under 0.06 ppm) and is far below anything audible.
+static constexpr double loopTolerancePpm = 0.1;
+
+// Fixed sessions without noise are periodic once the reverb has settled:
+// the oscillators repeat every P samples when each makes a whole number of
+// cycles in P, and the reverb and saturation then repeat with them. This
+// finds the shortest such P up to maxSeconds.
+static LoopPlan planLoop(const SessionSettings &settings, double maxSeconds) {
+  LoopPlan plan;
+  plan.settings = settings;
+  if (settings.isJourney) {
+    plan.reason = "journey parameters change over time";
+    return plan;
+  }
+  if (settings.noiseTypeIdx >= 0) {
+    plan.reason = "noise beds never repeat";
+    return plan;
+  }
+
+  // The two oscillators of the engine, as in IsochronicEngine::increments.
+  const double sr = settings.sampleRate;
+  const bool binaural = settings.mode == EntrainmentMode::Binaural;
+  double freqs[2] = {settings.carrierFreq, settings.pulseFreq};
+  if (binaural) {
+    freqs[0] = settings.carrierFreq - settings.pulseFreq / 2.0;
+    freqs[1] = settings.carrierFreq + settings.pulseFreq / 2.0;
+  }
+
+  // A period P works if every oscillator is within tolerance of a whole
+  // number of cycles in P samples. Checking each P in turn is a few
+  // milliseconds even for a 60 second limit, and finds the shortest one.
+  const int64_t maxPeriod = static_cast<int64_t>(maxSeconds * sr);
+  double cycles[2];
+  int64_t period = 0;
+  for (int64_t p = 1; p <= maxPeriod && period == 0; ++p) {
+    bool fits = true;
+    for (int i = 0; i < 2 && fits; ++i) {
+      double exact = freqs[i] * (double)p / sr;
+      cycles[i] = std::round(exact);
+      double tolerance =
+          std::abs(freqs[i]) * loopTolerancePpm * 1e-6 * (double)p / sr;
+      fits = std::abs(exact - cycles[i]) <= tolerance;
     }
+    if (fits)
+      period = p;
+  }
+  if (period == 0) {
+    std::ostringstream why;
+    why << std::setprecision(8) << "no common period of " << maxSeconds
+        << " s or less for " << freqs[0] << " and " << freqs[1] << " Hz";
+    plan.reason = why.str();
+    return plan;
+  }
+
+  const int64_t settle = static_cast<int64_t>(sr * reverbSettleSeconds);
+  if (settings.totalSamples < settle + period) {
+    plan.reason = "session is shorter than the settle time plus one period";
+    return plan;
+  }
+
+  double snapped[2];
+  for (int i = 0; i < 2; ++i) {
+    snapped[i] = cycles[i] * sr / (double)period;
+    plan.maxShiftHz =
+        std::max(plan.maxShiftHz, std::abs(snapped[i] - freqs[i]));
+  }
+  if (binaural) {
+    plan.settings.carrierFreq = (snapped[0] + snapped[1]) / 2.0;
+    plan.settings.pulseFreq = snapped[1] - snapped[0];
+  } else {
+    plan.settings.carrierFreq = snapped[0];
+    plan.settings.pulseFreq = snapped[1];
+  }
+  plan.period = period;
+  plan.usable = true;
+  return plan;
+}
+
+// Synthesises the settle time and one tile of whole periods, then writes
+// the tile over and over. The tile is at least a second long so the copies
+// go to the writer in large chunks.
+static void renderLooped(const LoopPlan &plan, juce::AudioFormatWriter &writer,
+                         bool showProgress) {
+  const SessionSettings &settings = plan.settings;
+  const int64_t totalSamples = settings.totalSamples;
+  const int64_t settle =
+      static_cast<int64_t>(settings.sampleRate * reverbSettleSeconds);
+  auto engine = createToneEngine(settings);
+
+  juce::AudioBuffer<float> buffer(2, 8192);
+  int64_t samplesWritten = 0;
+  while (samplesWritten < settle) {
+    int n = static_cast<int>(
+        std::min<int64_t>(buffer.getNumSamples(), settle - samplesWritten));
+    engine->render(buffer.getWritePointer(0), buffer.getWritePointer(1), n);
+    if (!writer.writeFromAudioSampleBuffer(buffer, 0, n))
+      throw std::runtime_error("Writing the output failed");
+    samplesWritten += n;
+    if (telemetry)
+      telemetry->addSamples(n);
+  }
+
+  const int64_t second = static_cast<int64_t>(settings.sampleRate);
+  const int64_t tileLength =
+      plan.period * std::max<int64_t>(1, (second + plan.period - 1) / plan.period);
+  juce::AudioBuffer<float> tile(2, static_cast<int>(tileLength));
+  engine->render(tile.getWritePointer(0), tile.getWritePointer(1),
+                 tile.getNumSamples());
+
+  while (samplesWritten < totalSamples) {
+    int n = static_cast<int>(
+        std::min<int64_t>(tileLength, totalSamples - samplesWritten));
+    if (!writer.writeFromAudioSampleBuffer(tile, 0, n))
+      throw std::runtime_error("Writing the output failed");
+    samplesWritten += n;
+    if (telemetry)
+      telemetry->addSamples(n);
+    if (showProgress)
+      printProgress(samplesWritten, totalSamples);
+  }
+}
+
+struct OutputSpec {
+  std::string path;
+  double seconds;
+  // A --deliver output's own sample rate and format. The render is
+  // resampled for it when the rate differs from the session's.
+  double sampleRate = 0.0;
+  std::optional<PcmFormat> sampleFormat;
+};
+
+// JUCE opens an existing file for appending, so a new output deletes it
+// first.
+static std::unique_ptr<juce::FileOutputStream>
+createFileStream(const std::string &path) {
+  juce::File file(path);
+  file.deleteFile();
+  auto stream = file.createOutputStream();
+  if (!stream)
+    throw std::runtime_error("Could not create output stream for " + path);
+  return stream;
+}
+
+// FLAC is picked by --format flac or, without --format, a .flac extension.
+static bool isFlacOutput(const std::string &format, const std::string &path) {
+  return format == "flac" ||
+         (format.empty() && juce::String(path).endsWithIgnoreCase(".flac"));
+}
+
+// stdout for "-", else the file opened for writing in one pass.
+static juce::OutputStream *openStdioStream(const std::string &path) {
+  const bool toStdout = (path == "-");
+  FILE *file = toStdout ? stdout : std::fopen(path.c_str(), "wb");
+  if (!file)
+    throw std::runtime_error("Could not open " + path);
+  return new StdioOutputStream(file, !toStdout);
+}
+
+// Opens one output. "-" is stdout, which is always a stream; with a stream
+// kind set, files are written in one pass too. Otherwise it's a WAV file
+// written through a memory mapping, allocated for lengthSamples up front,
+// whose header gets the real length when the writer is destroyed. FLAC is
+// picked by a .flac extension or --format flac, and encodes on
+// encoderThreads threads.
+static std::unique_ptr<juce::AudioFormatWriter>
+createOutputWriter(const std::string &path, std::string streamKind,
+                   const std::string &format, PcmFormat sampleFormat,
+                   double sampleRate, int64_t lengthSamples,
+                   int encoderThreads, bool dither) {
+  const bool toStdout = (path == "-");
+  if (isFlacOutput(format, path)) {
+    if (sampleFormat != PcmFormat::S16 && sampleFormat != PcmFormat::S24)
+      throw std::runtime_error("FLAC output takes s16 or s24 samples");
+    juce::OutputStream *stream =
+        timeWrites((toStdout || !streamKind.empty())
+                       ? openStdioStream(path)
+                       : createFileStream(path).release());
+    return std::make_unique<FlacWriter>(stream, sampleRate, 2,
+                                        pcmBits(sampleFormat), lengthSamples,
+                                        encoderThreads);
+  }
+
+  if (toStdout && streamKind.empty())
+    streamKind = "wav";
+
+  if (!streamKind.empty())
+    return std::make_unique<PcmStreamWriter>(
+        timeWrites(openStdioStream(path)), sampleRate, 2, sampleFormat,
+        streamKind == "wav", -1, dither);
+
+  return std::make_unique<MappedWavWriter>(path, sampleRate, 2, sampleFormat,
+                                           lengthSamples, dither);
+}
+
+// An audio file mixed into the output. Narration ducks the tones.
+struct MixInput {
+  std::string path;
+  double gainDb;
+  bool narration;
+};
+
+// Everything one command line (or one manifest job) asks for.
+struct JobConfig {
+  SessionSettings settings;
+  std::vector<OutputSpec> outputs;
+  double sessionSeconds = 0.0;
+  // The samples of the session that go to the output. Anything other than
+  // the whole session is an excerpt, rendered by seeking straight to it.
+  int64_t firstSample = 0;
+  int64_t endSample = 0;
+  std::string streamKind;
+  std::string format;
+  PcmFormat sampleFormat = PcmFormat::S24;
+  // TPDF dither on integer outputs.
+  bool dither = false;
+  double fadeOutSeconds = 0.0;
+  bool loop = false;
+  double loopMaxSeconds = 60.0;
+  int numThreads = 1;
+  int blockSize = 8192;
+  int queueDepth = 8;
+  // Seconds of audio between checkpoints; 0 for none.
+  double checkpointSeconds = 0.0;
+  bool resume = false;
+  // Render cache directory; empty for none.
+  std::string cacheDir;
+  double cacheSizeMb = 65536.0;
+  // Write a QA sidecar next to the first output.
+  bool analyse = false;
+  std::vector<MixInput> inputs;
+  double duckDb = 12.0;
+
+  bool isExcerpt() const {
+    return firstSample > 0 || endSample < settings.totalSamples;
+  }
+};
+
+// Checkpoint interval for --resume without --checkpoint.
+static constexpr double defaultCheckpointSeconds = 300.0;
+
+static const char *usageText =
+    "Usage: IsochronicBatchGen <output_wav> <duration_seconds> "
+    "<pulse_freq_or_points> <carrier_freq_or_points> <softness> "
+    "<type> [gain_db] [noise_type] [noise_level] "
+    "[--threads <n, 0 = all cores>] [--fast] "
+    "[--isa scalar|sse2|avx2|avx512] [--journey <keyframe_file>] "
+    "[--control-rate <hz>] [--loop] [--loop-max <seconds>] "
+    "[--block-size <samples>] [--queue-depth <blocks>] "
+    "[--stream wav|raw] [--format wav|flac] "
+    "[--sample-format s16|s24|s32|f32] [--dither] "
+    "[--also-write <output> <duration_seconds>]... [--rate <hz>] "
+    "[--deliver <output> <rate_hz> s16|s24|s32|f32]... "
+    "[--fade-out <seconds>] [--seed <n>] [--reverb classic|fdn] "
+    "[--checkpoint <seconds>] [--resume] [--cache <dir>] "
+    "[--cache-size <MB>] [--start <time>] [--length <time>] "
+    "[--telemetry fd:<n>|<file>] [--telemetry-interval <seconds>] "
+    "[--analyse] [--narration <file> <gain_db>]... "
+    "[--mix <file> <gain_db>]... [--duck <db>]\n"
+    "       IsochronicBatchGen --manifest <jobs.json> [--threads <n>] "
+    "[--memory-budget <MB>] [--telemetry fd:<n>|<file>] "
+    "[--telemetry-interval <seconds>]\n"
+    "An output of - writes to stdout. --stream writes without "
+    "seeking, for pipes and FIFOs. --dither adds TPDF dither when "
+    "converting to s16, s24 or s32. Each --also-write adds an "
+    "output cut from the same render; outputs shorter than the "
+    "longest one get the --fade-out tail. Noise beds are "
+    "reproducible: the same --seed (default 0) gives the same file. "
+    "--checkpoint saves the render's state next to a WAV output every "
+    "so many seconds of audio; after a crash, the same command with "
+    "--resume carries on from the last checkpoint. --cache keeps finished "
+    "renders in a directory (up to --cache-size, default 64 GB) and answers "
+    "a repeated or shorter session from it instead of rendering. --start "
+    "and --length render only that part of the session (times in seconds "
+    "or with an s, m, h or % suffix), seeking straight to it. --telemetry "
+    "writes JSON lines with progress, throughput, ETA and time per stage to "
+    "a file or an open file descriptor every --telemetry-interval seconds "
+    "(default 1). --rate sets the rate the session is rendered at (default "
+    "44100); each --deliver adds a whole-session output at its own rate and "
+    "sample format, resampled from the same render. --analyse measures the "
+    "render as it goes (true peak, loudness, saturation, and the pulse and "
+    "carrier against their targets) and writes <output>.analysis.json. "
+    "--narration and --mix stream audio files (WAV, AIFF, FLAC or Ogg) into "
+    "the output at their gain; narration ducks the tones by --duck dB "
+    "(default 12) while it speaks. A duration of auto runs the session as "
+    "long as the longest input.";
 
-    std::unique_ptr<juce::AudioFormatWriter> writer(
-        wavFormat.createWriterFor(stream.release(), sampleRate, 2, 24, {}, 0));
-    if (!writer) {
-      std::cerr << "Error: Could not create WAV writer" << std::endl;
-      return 1;
+// Options may appear anywhere; everything else is positional. Throws
+// UsageError when positional arguments are missing and runtime_error (or
+// the std::sto* exceptions) on bad values.
+static JobConfig parseJobArgs(const std::vector<std::string> &argv) {
+  JobConfig job;
+  std::vector<std::string> args;
+  std::string journeyFile;
+  std::string sampleFormatName = "s24";
+  std::string startTime, lengthTime;
+  std::vector<OutputSpec> deliveries;
+  double controlRate = 0.0;
+  bool fastMath = false;
+  auto isaLimit = BlockKernels::InstructionSet::AVX512;
+  const size_t argc = argv.size();
+  for (size_t i = 0; i < argc; ++i) {
+    const std::string &arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      job.numThreads = std::stoi(argv[++i]);
+      if (job.numThreads <= 0)
+        job.numThreads = static_cast<int>(
+            std::max(1u, std::thread::hardware_concurrency()));
+    } else if (arg == "--journey" && i + 1 < argc) {
+      journeyFile = argv[++i];
+    } else if (arg == "--control-rate" && i + 1 < argc) {
+      controlRate = std::stod(argv[++i]);
+    } else if (arg == "--loop") {
+      job.loop = true;
+    } else if (arg == "--loop-max" && i + 1 < argc) {
+      job.loopMaxSeconds = std::stod(argv[++i]);
+    } else if (arg == "--block-size" && i + 1 < argc) {
+      job.blockSize = std::max(64, std::stoi(argv[++i]));
+    } else if (arg == "--queue-depth" && i + 1 < argc) {
+      job.queueDepth = std::max(2, std::stoi(argv[++i]));
+    } else if (arg == "--stream" && i + 1 < argc) {
+      job.streamKind = argv[++i];
+    } else if (arg == "--format" && i + 1 < argc) {
+      job.format = argv[++i];
+    } else if (arg == "--sample-format" && i + 1 < argc) {
+      sampleFormatName = argv[++i];
+    } else if (arg == "--also-write" && i + 2 < argc) {
+      std::string path = argv[++i];
+      job.outputs.push_back({path, std::stod(argv[++i])});
+    } else if (arg == "--deliver" && i + 3 < argc) {
+      // Always the whole session; the length is filled in below.
+      OutputSpec out{argv[++i], 0.0};
+      out.sampleRate = std::stod(argv[++i]);
+      out.sampleFormat = parseSampleFormat(argv[++i]);
+      deliveries.push_back(out);
+    } else if (arg == "--rate" && i + 1 < argc) {
+      job.settings.sampleRate = std::stod(argv[++i]);
+    } else if (arg == "--fade-out" && i + 1 < argc) {
+      job.fadeOutSeconds = std::stod(argv[++i]);
+    } else if (arg == "--reverb" && i + 1 < argc) {
+      std::string kind = argv[++i];
+      if (kind == "classic")
+        job.settings.reverb = ReverbType::Classic;
+      else if (kind == "fdn")
+        job.settings.reverb = ReverbType::FeedbackDelayNetwork;
+      else
+        throw std::runtime_error("Unknown reverb " + kind);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      job.settings.noiseSeed = std::stoull(argv[++i]);
+    } else if (arg == "--checkpoint" && i + 1 < argc) {
+      job.checkpointSeconds = std::stod(argv[++i]);
+    } else if (arg == "--resume") {
+      job.resume = true;
+    } else if (arg == "--analyse") {
+      job.analyse = true;
+    } else if (arg == "--dither") {
+      job.dither = true;
+    } else if (arg == "--narration" && i + 2 < argc) {
+      std::string path = argv[++i];
+      job.inputs.push_back({path, std::stod(argv[++i]), true});
+    } else if (arg == "--mix" && i + 2 < argc) {
+      std::string path = argv[++i];
+      job.inputs.push_back({path, std::stod(argv[++i]), false});
+    } else if (arg == "--duck" && i + 1 < argc) {
+      job.duckDb = std::stod(argv[++i]);
+    } else if (arg == "--cache" && i + 1 < argc) {
+      job.cacheDir = argv[++i];
+    } else if (arg == "--cache-size" && i + 1 < argc) {
+      job.cacheSizeMb = std::stod(argv[++i]);
+    } else if (arg == "--start" && i + 1 < argc) {
+      startTime = argv[++i];
+    } else if (arg == "--length" && i + 1 < argc) {
+      lengthTime = argv[++i];
+    } else if (arg == "--fast") {
+      fastMath = true;
+    } else if (arg == "--isa" && i + 1 < argc) {
+      std::string isa = argv[++i];
+      if (isa == "scalar")
+        isaLimit = BlockKernels::InstructionSet::Scalar;
+      else if (isa == "sse2")
+        isaLimit = BlockKernels::InstructionSet::SSE2;
+      else if (isa == "avx2")
+        isaLimit = BlockKernels::InstructionSet::AVX2;
+      else if (isa == "avx512")
+        isaLimit = BlockKernels::InstructionSet::AVX512;
+      else
+        throw std::runtime_error("Unknown ISA " + isa);
+    } else {
+      args.push_back(arg);
     }
+  }
+
+  if (args.size() < 6)
+    throw UsageError("expected at least 6 positional arguments");
+
+  // "auto" makes the session as long as the longest input.
+  double durationSeconds = 0.0;
+  if (args[1] == "auto") {
+    if (job.inputs.empty())
+      throw std::runtime_error("A duration of auto needs --narration or --mix");
+    for (const auto &in : job.inputs)
+      durationSeconds =
+          std::max(durationSeconds, MixSource::lengthSeconds(in.path));
+  } else {
+    durationSeconds = std::stod(args[1]);
+  }
+  // The session runs as long as the longest output. Shorter ones are
+  // prefixes of it, so journeys follow the longest timeline.
+  job.outputs.insert(job.outputs.begin(), {args[0], durationSeconds});
+  for (const auto &out : job.outputs)
+    job.sessionSeconds = std::max(job.sessionSeconds, out.seconds);
+  // The resampler works between whole-Hz rates.
+  auto checkRate = [](double rate) {
+    if (rate < 8000.0 || rate > 768000.0 || rate != std::floor(rate))
+      throw std::runtime_error("Unsupported sample rate " +
+                               std::to_string(rate));
+  };
+  checkRate(job.settings.sampleRate);
+  for (auto &out : deliveries) {
+    checkRate(out.sampleRate);
+    out.seconds = job.sessionSeconds;
+    job.outputs.push_back(out);
+  }
+
+  std::string pulseArg = args[2];
+  std::string carrierArg = args[3];
+
+  SessionSettings &settings = job.settings;
+  settings.kernels =
+      fastMath ? &BlockKernels::fast(isaLimit) : &BlockKernels::exact();
+  if (telemetry)
+    settings.stageTimes = &telemetry->getEngineStages();
+  settings.softness = std::stof(args[4]);
+  settings.mode = (std::stoi(args[5]) == 0) ? EntrainmentMode::Isochronic
+                                            : EntrainmentMode::Binaural;
+  float gainDb = (args.size() >= 7) ? std::stof(args[6]) : -10.0f;
+  settings.gain = juce::Decibels::decibelsToGain(gainDb);
+  settings.noiseTypeIdx = (args.size() >= 8) ? std::stoi(args[7]) : -1;
+  settings.noiseLevel = (args.size() >= 9) ? std::stof(args[8]) : 0.3f;
+
+  settings.isJourney = (pulseArg.find(',') != std::string::npos);
+  if (settings.isJourney) {
+    if (!parseJourney(pulseArg, carrierArg, job.sessionSeconds,
+                      settings.journey))
+      throw std::runtime_error("Invalid journey points (expected 5 values).");
+  } else {
+    settings.pulseFreq = std::stof(pulseArg);
+    settings.carrierFreq = std::stof(carrierArg);
+  }
+  if (!journeyFile.empty()) {
+    // Lanes in the file replace the matching command line ones.
+    Journey fromFile;
+    parseJourneyFile(journeyFile, job.sessionSeconds, fromFile);
+    auto &journey = settings.journey;
+    for (auto lane : {&Journey::pulse, &Journey::carrier, &Journey::gain,
+                      &Journey::softness, &Journey::noiseLevel})
+      if (!(fromFile.*lane).isEmpty())
+        journey.*lane = fromFile.*lane;
+    settings.isJourney = true;
+  }
+  if (controlRate > 0.0)
+    settings.controlInterval = std::max(
+        1, static_cast<int>(std::lround(settings.sampleRate / controlRate)));
+  settings.totalSamples =
+      static_cast<int64_t>(job.sessionSeconds * settings.sampleRate);
 
-    SimpleReverb reverbL, reverbR;
-    reverbL.prepare(sampleRate);
-    reverbR.prepare(sampleRate);
+  // An excerpt keeps the session's timeline, so a journey is where it would
+  // be in the full render.
+  job.endSample = settings.totalSamples;
+  if (!startTime.empty())
+    job.firstSample = std::clamp<int64_t>(
+        std::llround(parseTime(startTime, job.sessionSeconds) *
+                     settings.sampleRate),
+        0, settings.totalSamples);
+  if (!lengthTime.empty())
+    job.endSample = std::min(
+        settings.totalSamples,
+        job.firstSample +
+            std::max<int64_t>(0, std::llround(parseTime(lengthTime,
+                                                        job.sessionSeconds) *
+                                              settings.sampleRate)));
+  if (job.isExcerpt() && job.outputs.size() > 1)
+    throw std::runtime_error("--start and --length take a single output");
 
-    OrganicNoiseSynth noiseL, noiseR;
-    if (noiseTypeIdx >= 0) {
-      float basePulse = isJourney ? journeyPoints[0].pulseFreq : std::stof(pulseArg);
-      noiseL.prepare(sampleRate, static_cast<OrganicNoiseSynth::Type>(noiseTypeIdx), basePulse);
-      noiseR.prepare(sampleRate, static_cast<OrganicNoiseSynth::Type>(noiseTypeIdx), basePulse);
+  job.sampleFormat = parseSampleFormat(sampleFormatName);
+
+  if (!job.format.empty() && job.format != "wav" && job.format != "flac")
+    throw std::runtime_error("Unknown format " + job.format);
+  if (!job.streamKind.empty() && job.streamKind != "wav" &&
+      job.streamKind != "raw")
+    throw std::runtime_error("Unknown stream kind " + job.streamKind);
+  if (job.resume && job.checkpointSeconds <= 0.0)
+    job.checkpointSeconds = defaultCheckpointSeconds;
+  if (job.isExcerpt() && job.checkpointSeconds > 0.0)
+    throw std::runtime_error(
+        "--checkpoint and --resume cover whole sessions, not excerpts");
+  // A checkpoint doesn't hold the mixer's ducking or resampler state, so a
+  // resumed mix would restart them and leave a seam.
+  if (!job.inputs.empty() && job.checkpointSeconds > 0.0)
+    throw std::runtime_error(
+        "--checkpoint and --resume can't be combined with --narration or "
+        "--mix");
+  if (job.analyse && job.outputs[0].path == "-")
+    throw std::runtime_error("--analyse needs a file output for its sidecar");
+  // A resumed render only sees the audio after the checkpoint.
+  if (job.analyse && job.resume)
+    throw std::runtime_error("--analyse can't be combined with --resume");
+  // The analyser sits before the mixer, so its levels would describe the
+  // tones rather than the file.
+  if (job.analyse && !job.inputs.empty())
+    throw std::runtime_error(
+        "--analyse can't be combined with --narration or --mix");
+  // FLAC encodes from JUCE's conversion, which doesn't dither.
+  if (job.dither)
+    for (const auto &out : job.outputs)
+      if (isFlacOutput(job.format, out.path))
+        throw std::runtime_error("--dither only applies to WAV and raw PCM");
+  return job;
+}
+
+// One writer for a single output, a FanOutWriter for several.
+static std::unique_ptr<juce::AudioFormatWriter>
+openOutputs(const JobConfig &job) {
+  const double sampleRate = job.settings.sampleRate;
+  if (job.outputs.size() == 1)
+    return createOutputWriter(job.outputs[0].path, job.streamKind, job.format,
+                              job.sampleFormat, sampleRate,
+                              job.endSample - job.firstSample,
+                              job.numThreads, job.dither);
+
+  auto fanOut = std::make_unique<FanOutWriter>(sampleRate, 2);
+  const int64_t fadeSamples =
+      static_cast<int64_t>(job.fadeOutSeconds * sampleRate);
+  for (const auto &out : job.outputs) {
+    int64_t length = static_cast<int64_t>(out.seconds * sampleRate);
+    const double rate = out.sampleRate > 0.0 ? out.sampleRate : sampleRate;
+    auto writer = createOutputWriter(
+        out.path, job.streamKind, job.format,
+        out.sampleFormat.value_or(job.sampleFormat), rate,
+        PolyphaseResampler::outputLength(length, sampleRate, rate),
+        job.numThreads, job.dither);
+    if (rate != sampleRate)
+      writer = std::make_unique<ResamplingWriter>(std::move(writer),
+                                                  sampleRate);
+    fanOut->addTarget(std::move(writer), length,
+                      length < job.settings.totalSamples ? fadeSamples : 0);
+  }
+  return fanOut;
+}
+
+// For --analyse, an AnalysisWriter in front of the job's writer. It sees
+// the render at the session's rate, before any fade-out or resampling.
+static std::unique_ptr<juce::AudioFormatWriter>
+analyseOutput(const JobConfig &job,
+              std::unique_ptr<juce::AudioFormatWriter> writer) {
+  if (!job.analyse)
+    return writer;
+  return std::make_unique<AnalysisWriter>(
+      std::move(writer), job.settings, job.firstSample,
+      job.endSample - job.firstSample, job.outputs[0].path + ".analysis.json");
+}
+
+// For --narration and --mix, a MixingWriter in front of the job's writer.
+// The inputs are lined up with the session's timeline, so an excerpt
+// starting at startSample hears them where the full render would.
+static std::unique_ptr<juce::AudioFormatWriter>
+mixInputs(const JobConfig &job, std::unique_ptr<juce::AudioFormatWriter> writer,
+          int64_t startSample) {
+  if (job.inputs.empty())
+    return writer;
+  const double sampleRate = job.settings.sampleRate;
+  std::vector<std::unique_ptr<MixSource>> narration, background;
+  for (const auto &in : job.inputs) {
+    const float gain = juce::Decibels::decibelsToGain((float)in.gainDb);
+    (in.narration ? narration : background)
+        .push_back(std::make_unique<MixSource>(in.path, sampleRate, gain,
+                                               startSample));
+  }
+  return std::make_unique<MixingWriter>(std::move(writer), std::move(narration),
+                                        std::move(background), job.duckDb);
+}
+
+// Hash of the command line without the options that only change how the
+// audio is made, not what it is, so a checkpoint can be matched to its
+// session.
+static uint64_t sessionHash(const std::vector<std::string> &argList) {
+  uint64_t hash = hashBytes(nullptr, 0);
+  for (size_t i = 0; i < argList.size(); ++i) {
+    const std::string &arg = argList[i];
+    if (arg == "--resume" || arg == "--analyse")
+      continue;
+    if ((arg == "--checkpoint" || arg == "--threads" || arg == "--block-size" ||
+         arg == "--queue-depth" || arg == "--cache" ||
+         arg == "--cache-size") &&
+        i + 1 < argList.size()) {
+      ++i;
+      continue;
     }
+    hash = hashBytes(arg.c_str(), arg.size() + 1, hash);
+  }
+  return hash;
+}
 
-    const int blockSize = 8192;
-    juce::AudioBuffer<float> buffer(2, blockSize);
-    double carrierPhase = 0.0, pulsePhase = 0.0, phaseL = 0.0, phaseR = 0.0;
-    const double pi2 = 2.0 * juce::MathConstants<double>::pi;
-    const float softnessExp = 1.0f + (softness * 4.0f);
-
-    int64_t samplesProcessed = 0;
-    while (samplesProcessed < totalSamples) {
-      int64_t samplesThisBlock = std::min(static_cast<int64_t>(blockSize),
-                                          totalSamples - samplesProcessed);
-      buffer.clear();
-      auto *dataL = buffer.getWritePointer(0);
-      auto *dataR = buffer.getWritePointer(1);
-
-      for (int i = 0; i < static_cast<int>(samplesThisBlock); ++i) {
-        double currentTime = (double)(samplesProcessed + i) / sampleRate;
-        float currentPulse = 0.0f;
-        float currentCarrier = 0.0f;
-
-        if (isJourney) {
-          // Linear interpolation for journey
-          int idx = 0;
-          while (idx < 4 && currentTime > journeyPoints[idx + 1].timeSec)
-            idx++;
-          double t1 = journeyPoints[idx].timeSec;
-          double t2 = journeyPoints[idx + 1].timeSec;
-          double alpha = (currentTime - t1) / (t2 - t1);
-          currentPulse = journeyPoints[idx].pulseFreq +
-                         alpha * (journeyPoints[idx + 1].pulseFreq -
-                                  journeyPoints[idx].pulseFreq);
-          currentCarrier = journeyPoints[idx].carrierFreq +
-                           alpha * (journeyPoints[idx + 1].carrierFreq -
-                                    journeyPoints[idx].carrierFreq);
-        } else {
-          currentPulse = std::stof(pulseArg);
-          currentCarrier = std::stof(carrierArg);
-        }
+// A checkpointed render writes a single WAV file through PcmStreamWriter,
+// which can leave the file playable at every checkpoint. On resume the
+// file is cut back to the checkpoint and writing carries on from there.
+static std::unique_ptr<PcmStreamWriter>
+openCheckpointedOutput(const JobConfig &job,
+                       const RenderCheckpoint *resumeFrom) {
+  const std::string &path = job.outputs[0].path;
+  if (job.outputs.size() != 1 || path == "-" || !job.streamKind.empty())
+    throw std::runtime_error(
+        "--checkpoint needs a single output file and no --stream");
+  if (isFlacOutput(job.format, path))
+    throw std::runtime_error("--checkpoint only writes WAV files");
+  if (job.loop)
+    throw std::runtime_error("--checkpoint can't be combined with --loop");
 
-        const double carrierIncr = (pi2 * (double)currentCarrier) / sampleRate;
-        const double pulseIncr = (pi2 * (double)currentPulse) / sampleRate;
-        const double incrL = (pi2 * ((double)currentCarrier - ((double)currentPulse / 2.0))) / sampleRate;
-        const double incrR = (pi2 * ((double)currentCarrier + ((double)currentPulse / 2.0))) / sampleRate;
-
-        float outL = 0.0f, outR = 0.0f;
-        if (entrainmentType == 0) {
-          float c = std::sin(static_cast<float>(carrierPhase));
-          carrierPhase += carrierIncr;
-          float p = std::pow(std::max(0.0f, std::sin(static_cast<float>(pulsePhase))), softnessExp);
-          pulsePhase += pulseIncr;
-          outL = c * p * gain;
-          outR = outL;
-        } else {
-          outL = std::sin(static_cast<float>(phaseL)) * gain;
-          phaseL += incrL;
-          outR = std::sin(static_cast<float>(phaseR)) * gain;
-          phaseR += incrR;
-        }
+  std::unique_ptr<juce::FileOutputStream> stream;
+  int64_t existingDataBytes = -1;
+  if (resumeFrom) {
+    stream = juce::File(path).createOutputStream();
+    if (!stream || !stream->setPosition(resumeFrom->byteOffset) ||
+        stream->truncate().failed())
+      throw std::runtime_error("Could not reopen " + path);
+    existingDataBytes =
+        resumeFrom->byteOffset - PcmStreamWriter::seekableHeaderBytes;
+  } else {
+    stream = createFileStream(path);
+  }
+  return std::make_unique<PcmStreamWriter>(
+      timeWrites(stream.release()), job.settings.sampleRate, 2,
+      job.sampleFormat, true, existingDataBytes, job.dither);
+}
 
-        if (carrierPhase > pi2) carrierPhase -= pi2;
-        if (pulsePhase > pi2) pulsePhase -= pi2;
-        if (phaseL > pi2) phaseL -= pi2;
-        if (phaseR > pi2) phaseR -= pi2;
+// The render cache's key for a command line: every setting that reaches
+// the samples, written out in one canonical form and hashed. Doubles go in
+// as hex floats so equal values always give equal text. How the render is
+// split up is part of it, because segmented renders differ from serial
+// ones in the last bits after each seam.
+static RenderCache::Key cacheKeyFor(const JobConfig &job,
+                                    const LoopPlan &plan) {
+  const SessionSettings &s = plan.usable ? plan.settings : job.settings;
+  std::ostringstream text;
+  text << std::hexfloat << "engine " << toneEngineVersion << " kernels "
+       << s.kernels->name << " rate " << s.sampleRate << " mode "
+       << static_cast<int>(s.mode) << " reverb " << static_cast<int>(s.reverb)
+       << " pulse " << s.pulseFreq << " carrier " << s.carrierFreq
+       << " softness " << s.softness << " gain " << s.gain;
+  if (s.noiseTypeIdx >= 0)
+    text << " noise " << s.noiseTypeIdx << " " << s.noiseLevel << " seed "
+         << s.noiseSeed;
+  if (s.isJourney) {
+    text << " control " << s.controlInterval;
+    for (auto lane : {&Journey::pulse, &Journey::carrier, &Journey::gain,
+                      &Journey::softness, &Journey::noiseLevel}) {
+      text << " lane";
+      for (const auto &k : (s.journey.*lane).getKeyframes())
+        text << " " << k.timeSec << " " << k.value << " "
+             << static_cast<int>(k.curve);
+    }
+  }
+  text << " render "
+       << (plan.usable ? "loop" : job.numThreads > 1 ? "segments" : "serial")
+       << " bits " << pcmBits(job.sampleFormat)
+       << (job.sampleFormat == PcmFormat::F32 ? " float" : " int");
+  if (job.dither && job.sampleFormat != PcmFormat::F32)
+    text << " dither";
 
-        if (noiseTypeIdx >= 0) {
-          outL += noiseL.process() * noiseLevel;
-          outR += noiseR.process() * noiseLevel;
-        }
+  const std::string canonical = text.str();
+  RenderCache::Key key;
+  key.session = hashBytes(canonical.data(), canonical.size());
+  key.samples = s.totalSamples;
+  key.extension =
+      isFlacOutput(job.format, job.outputs[0].path) ? "flac" : "wav";
+  return key;
+}
+
+static bool isStreamOutput(const JobConfig &job, const OutputSpec &out) {
+  return out.path == "-" || !job.streamKind.empty();
+}
+
+// Answers a single-output command from the cache if it can. A WAV or FLAC
+// file of exactly the cached length becomes a clone of the entry. Streams
+// and shorter WAV files get the entry's first samples copied out instead;
+// FLAC entries only serve exact hits, since their headers hold the length.
+static bool serveFromCache(RenderCache &cache, const RenderCache::Key &key,
+                           const JobConfig &job) {
+  const OutputSpec &out = job.outputs[0];
+  const bool stream = isStreamOutput(job, out);
+  const bool flac = key.extension == "flac";
+  if (flac && stream)
+    return false;
+  auto entry = cache.find(key, !flac);
+  if (!entry)
+    return false;
+  if (!stream && entry->samples == key.samples)
+    return cloneFile(entry->path, out.path);
+
+  PcmStreamWriter writer(stream ? openStdioStream(out.path)
+                                : createFileStream(out.path).release(),
+                         job.settings.sampleRate, 2, job.sampleFormat,
+                         job.streamKind != "raw");
+  const int64_t frameBytes = 2 * pcmBits(job.sampleFormat) / 8;
+  if (!copyCachedSamples(entry->path, key.samples * frameBytes, writer))
+    throw std::runtime_error("Could not read " + entry->path.string() +
+                             " from the render cache");
+  return true;
+}
+
+// Keeps a finished render. Streams were copied to pendingEntry as they
+// went; otherwise the first full-length WAV or FLAC file is cloned in.
+static void storeInCache(RenderCache &cache, RenderCache::Key key,
+                         const JobConfig &job,
+                         const std::filesystem::path &pendingEntry) {
+  if (!pendingEntry.empty()) {
+    cache.add(key, pendingEntry);
+    return;
+  }
+  const double sampleRate = job.settings.sampleRate;
+  for (const auto &out : job.outputs) {
+    if (isStreamOutput(job, out) || out.sampleRate > 0.0 ||
+        static_cast<int64_t>(out.seconds * sampleRate) != key.samples)
+      continue;
+    key.extension = isFlacOutput(job.format, out.path) ? "flac" : "wav";
+    cache.addCopyOf(key, out.path);
+    return;
+  }
+}
+
+// Describes the outcome of --loop in one line.
+static std::string describeLoopPlan(const LoopPlan &plan, double sampleRate) {
+  std::ostringstream report;
+  if (!plan.usable) {
+    report << "Loop cache off (" << plan.reason << "); rendering in full.";
+    return report.str();
+  }
+  report << "Loop cache: period of " << plan.period << " samples ("
+         << std::fixed << std::setprecision(3)
+         << (double)plan.period / sampleRate << " s), ";
+  if (plan.maxShiftHz < 1e-9)
+    report << "exact";
+  else
+    report << std::scientific << std::setprecision(2)
+           << "frequencies moved by up to " << plan.maxShiftHz << " Hz";
+  report << std::defaultfloat << "; tiling after " << reverbSettleSeconds
+         << " s of synthesis.";
+  return report.str();
+}
+
+// Reads a manifest of the form
+//
+//   { "threads": 0, "memory_budget_mb": 4096,
+//     "jobs": [ { "name": "alpha_1h", "args": ["out.wav", 3600, 10, 200,
+//                                              0.5, 0, "--loop"] }, ... ] }
+//
+// where each "args" list is exactly what would follow IsochronicBatchGen
+// on the command line. "threads" and "memory_budget_mb" are optional.
+static void loadManifest(const std::string &path, std::vector<RenderJob> &jobs,
+                         SchedulerOptions &options) {
+  juce::File file(path);
+  if (!file.existsAsFile())
+    throw std::runtime_error("Could not open manifest " + path);
+  juce::var root;
+  auto result = juce::JSON::parse(file.loadFileAsString(), root);
+  if (result.failed())
+    throw std::runtime_error(path + ": " +
+                             result.getErrorMessage().toStdString());
+
+  if (root.hasProperty("threads")) {
+    int threads = static_cast<int>(root["threads"]);
+    options.numThreads =
+        threads > 0 ? threads
+                    : static_cast<int>(
+                          std::max(1u, std::thread::hardware_concurrency()));
+  }
+  if (root.hasProperty("memory_budget_mb"))
+    options.memoryBudgetBytes =
+        static_cast<int64_t>(static_cast<double>(root["memory_budget_mb"]) *
+                             1024.0 * 1024.0);
+
+  const juce::var &list = root["jobs"];
+  if (!list.isArray())
+    throw std::runtime_error(path + ": \"jobs\" must be an array");
+  for (int i = 0; i < list.size(); ++i) {
+    const juce::var &entry = list[i];
+    std::vector<std::string> args;
+    if (const auto *values = entry["args"].getArray())
+      for (const auto &v : *values)
+        args.push_back(v.toString().toStdString());
+    std::string name = entry.hasProperty("name")
+                           ? entry["name"].toString().toStdString()
+                           : "job " + std::to_string(i + 1);
 
-        float wetL = reverbL.process(outL);
-        float wetR = reverbR.process(outR);
-        dataL[i] = std::tanh(outL + wetL * 0.12f);
-        dataR[i] = std::tanh(outR + wetR * 0.12f);
+    RenderJob job;
+    job.name = name;
+    try {
+      auto config = std::make_shared<JobConfig>(parseJobArgs(args));
+      for (const auto &out : config->outputs)
+        if (out.path == "-")
+          throw std::runtime_error("stdout output is not allowed in a manifest");
+      if (config->checkpointSeconds > 0.0)
+        throw std::runtime_error(
+            "--checkpoint and --resume are not available in a manifest");
+      if (!config->cacheDir.empty())
+        throw std::runtime_error("--cache is not available in a manifest");
+      job.settings = config->settings;
+      job.settings.totalSamples = config->endSample;
+      job.firstSample = config->firstSample;
+      job.openWriter = [config] {
+        return analyseOutput(
+            *config, mixInputs(*config, timeOutput(openOutputs(*config)),
+                               config->firstSample));
+      };
+      if (config->loop && !config->isExcerpt()) {
+        auto plan = std::make_shared<LoopPlan>(
+            planLoop(config->settings, config->loopMaxSeconds));
+        job.note = describeLoopPlan(*plan, config->settings.sampleRate);
+        if (plan->usable)
+          job.renderWhole = [plan](juce::AudioFormatWriter &writer) {
+            renderLooped(*plan, writer, false);
+          };
       }
-      writer->writeFromAudioSampleBuffer(buffer, 0, static_cast<int>(samplesThisBlock));
-      samplesProcessed += samplesThisBlock;
-      if (samplesProcessed % (static_cast<int64_t>(sampleRate) * 5) == 0) {
-        std::cout << "\rProgress: " << std::fixed << std::setprecision(1)
-                  << (100.0 * (double)samplesProcessed / (double)totalSamples)
-                  << "%" << std::flush;
+    } catch (const std::exception &e) {
+      // Reported like any other failed job; the rest still render.
+      std::string error = e.what();
+      job.openWriter = [error]() -> std::unique_ptr<juce::AudioFormatWriter> {
+        throw std::runtime_error(error);
+      };
+    }
+    jobs.push_back(std::move(job));
+  }
+}
+
+static int runManifest(const std::string &path, int threadsOverride,
+                       double memoryBudgetMb) {
+  std::vector<RenderJob> jobs;
+  SchedulerOptions options;
+  options.numThreads =
+      static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  loadManifest(path, jobs, options);
+  if (threadsOverride >= 0)
+    options.numThreads =
+        threadsOverride > 0
+            ? threadsOverride
+            : static_cast<int>(
+                  std::max(1u, std::thread::hardware_concurrency()));
+  if (memoryBudgetMb > 0.0)
+    options.memoryBudgetBytes =
+        static_cast<int64_t>(memoryBudgetMb * 1024.0 * 1024.0);
+
+  std::cout << "Rendering " << jobs.size() << " job(s) on "
+            << options.numThreads << " thread(s), memory budget "
+            << options.memoryBudgetBytes / (1024 * 1024) << " MB."
+            << std::endl;
+  size_t finished = 0;
+  options.onJobDone = [&](const JobReport &r) {
+    std::cout << "[" << ++finished << "/" << jobs.size() << "] " << r.name
+              << (r.succeeded ? " done" : " FAILED: " + r.error) << std::endl;
+  };
+
+  // Each job's writes are serialised by the scheduler, so its slot is
+  // only ever touched by one thread at a time.
+  std::vector<int64_t> reported(jobs.size());
+  if (telemetry) {
+    int64_t total = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      reported[i] = jobs[i].firstSample;
+      total += jobs[i].settings.totalSamples - jobs[i].firstSample;
+    }
+    options.onProgress = [&](const RenderJob &job, int64_t written) {
+      int64_t &last = reported[(size_t)(&job - jobs.data())];
+      telemetry->addSamples(written - last);
+      last = written;
+    };
+    telemetry->start(total, jobs.empty() ? 44100.0
+                                         : jobs[0].settings.sampleRate);
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  auto reports = runRenderJobs(jobs, options);
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - startTime)
+                       .count();
+
+  std::cout << "\n"
+            << std::left << std::setw(32) << "Job" << std::right
+            << std::setw(12) << "Audio (s)" << std::setw(12) << "Wall (s)"
+            << std::setw(12) << "Realtime" << "  Status" << std::endl;
+  double totalAudio = 0.0;
+  int failures = 0;
+  for (const auto &r : reports) {
+    std::cout << std::left << std::setw(32) << r.name << std::right
+              << std::fixed << std::setprecision(1) << std::setw(12)
+              << r.audioSeconds << std::setw(12) << r.wallSeconds
+              << std::setw(11) << r.audioSeconds / std::max(r.wallSeconds, 1e-9)
+              << "x  " << (r.succeeded ? "ok" : "failed: " + r.error)
+              << std::endl;
+    if (!r.note.empty())
+      std::cout << "    " << r.note << std::endl;
+    if (r.succeeded)
+      totalAudio += r.audioSeconds;
+    else
+      ++failures;
+  }
+  std::cout << "Rendered " << totalAudio << "s of audio in " << elapsed
+            << "s (" << totalAudio / std::max(elapsed, 1e-9)
+            << "x realtime), " << failures << " failed." << std::endl;
+  if (telemetry)
+    telemetry->finish(failures == 0,
+                      failures == 0 ? std::string()
+                                    : std::to_string(failures) +
+                                          " job(s) failed");
+  return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> argList;
+
+  // Telemetry options are taken out here, so they don't change the
+  // arguments a checkpoint is matched against.
+  std::string telemetryTarget;
+  double telemetryInterval = 1.0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--telemetry" && i + 1 < argc)
+      telemetryTarget = argv[++i];
+    else if (arg == "--telemetry-interval" && i + 1 < argc)
+      telemetryInterval = std::stod(argv[++i]);
+    else
+      argList.push_back(arg);
+  }
+
+  // A manifest replaces the single-session command line; only the pool
+  // and telemetry settings may be given next to it.
+  std::string manifest;
+  int threadsOverride = -1;
+  double memoryBudgetMb = 0.0;
+  for (size_t i = 0; i + 1 < argList.size(); ++i) {
+    if (argList[i] == "--manifest")
+      manifest = argList[i + 1];
+    else if (argList[i] == "--threads")
+      threadsOverride = std::stoi(argList[i + 1]);
+    else if (argList[i] == "--memory-budget")
+      memoryBudgetMb = std::stod(argList[i + 1]);
+  }
+
+  try {
+    if (!telemetryTarget.empty())
+      telemetry =
+          std::make_unique<RenderTelemetry>(telemetryTarget, telemetryInterval);
+    if (!manifest.empty())
+      return runManifest(manifest, threadsOverride, memoryBudgetMb);
+
+    JobConfig job = parseJobArgs(argList);
+    for (const auto &out : job.outputs)
+      audioOnStdout = audioOnStdout || out.path == "-";
+    const SessionSettings &settings = job.settings;
+    double sampleRate = settings.sampleRate;
+
+    // Excerpts seek, so they are quick without the loop cache, and they
+    // render the session's exact frequencies rather than snapped ones.
+    LoopPlan plan;
+    if (job.loop) {
+      if (job.isExcerpt())
+        plan.reason = "rendering an excerpt";
+      else
+        plan = planLoop(settings, job.loopMaxSeconds);
+      console() << describeLoopPlan(plan, sampleRate) << std::endl;
+    }
+
+    // Resumed renders are pieced together from two runs, so they neither
+    // come from the cache nor go into it. Excerpts are only worth keeping
+    // as part of a full render. An analysed render has to be rendered, but
+    // its output can still be kept. The cache only knows the tones, so a
+    // mix with other inputs is left out of it.
+    std::unique_ptr<RenderCache> cache;
+    RenderCache::Key cacheKey;
+    if (!job.cacheDir.empty() && !job.resume && !job.isExcerpt() &&
+        job.inputs.empty()) {
+      cache = std::make_unique<RenderCache>(
+          job.cacheDir,
+          static_cast<int64_t>(job.cacheSizeMb * 1024.0 * 1024.0));
+      cacheKey = cacheKeyFor(job, plan);
+      auto lookupStart = std::chrono::steady_clock::now();
+      if (job.outputs.size() == 1 && !job.analyse &&
+          serveFromCache(*cache, cacheKey, job)) {
+        console() << "Served from the render cache in " << std::fixed
+                  << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - lookupStart)
+                         .count()
+                  << " ms." << std::endl;
+        if (telemetry) {
+          const int64_t length = job.endSample - job.firstSample;
+          telemetry->start(length, sampleRate);
+          telemetry->addSamples(length);
+          telemetry->finish(true);
+        }
+        return 0;
       }
     }
-    std::cout << "\nGeneration Successful." << std::endl;
+
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    std::unique_ptr<CheckpointWriter> checkpoints;
+    RenderCheckpoint resumePoint;
+    if (job.checkpointSeconds > 0.0) {
+      const std::string &path = job.outputs[0].path;
+      const uint64_t jobHash = sessionHash(argList);
+      if (job.resume) {
+        resumePoint = loadCheckpoint(path, jobHash);
+        console() << "Resuming at " << std::fixed << std::setprecision(1)
+                  << (double)resumePoint.samplesWritten / sampleRate
+                  << "s from the last checkpoint." << std::endl;
+      }
+      auto output =
+          openCheckpointedOutput(job, job.resume ? &resumePoint : nullptr);
+      checkpoints = std::make_unique<CheckpointWriter>(
+          path, jobHash, *output,
+          static_cast<int64_t>(job.checkpointSeconds * sampleRate),
+          resumePoint.samplesWritten);
+      writer = std::move(output);
+    } else {
+      writer = openOutputs(job);
+    }
+
+    // A streamed WAV can't be cloned afterwards, so the cache gets its own
+    // copy as the render goes.
+    std::filesystem::path pendingEntry;
+    if (cache && job.outputs.size() == 1 &&
+        isStreamOutput(job, job.outputs[0]) && cacheKey.extension == "wav") {
+      pendingEntry = cache->pendingPath(cacheKey);
+      auto tee = std::make_unique<FanOutWriter>(sampleRate, 2);
+      tee->addTarget(std::move(writer), settings.totalSamples, 0);
+      tee->addTarget(std::make_unique<PcmStreamWriter>(
+                         createFileStream(pendingEntry.string()).release(),
+                         sampleRate, 2, job.sampleFormat, true, -1,
+                         job.dither),
+                     settings.totalSamples, 0);
+      writer = std::move(tee);
+    }
+    writer = analyseOutput(
+        job, mixInputs(job, timeOutput(std::move(writer)),
+                       std::max(job.firstSample, resumePoint.samplesWritten)));
+
+    // The render stops at the end of the excerpt; the journey still runs
+    // on the full session's timeline.
+    SessionSettings rendered = settings;
+    rendered.totalSamples = job.endSample;
+    const int64_t firstSample =
+        std::max(job.firstSample, resumePoint.samplesWritten);
+
+    if (telemetry)
+      telemetry->start(job.endSample - firstSample, sampleRate);
+    auto startTime = std::chrono::steady_clock::now();
+    if (plan.usable) {
+      renderLooped(plan, *writer, true);
+    } else if (job.numThreads > 1) {
+      std::vector<RenderJob> jobs(1);
+      jobs[0].settings = rendered;
+      jobs[0].firstSample = firstSample;
+      jobs[0].openWriter = [&writer] { return std::move(writer); };
+      SchedulerOptions options;
+      options.numThreads = job.numThreads;
+      int64_t reported = firstSample;
+      options.onProgress = [&](const RenderJob &, int64_t written) {
+        printProgress(written - job.firstSample,
+                      job.endSample - job.firstSample);
+        if (telemetry)
+          telemetry->addSamples(written - reported);
+        reported = written;
+        // Segments seek and warm up anyway, so these checkpoints carry no
+        // engine state.
+        if (checkpoints && written < settings.totalSamples &&
+            checkpoints->claim(written) && !checkpoints->write(written, {}))
+          throw std::runtime_error("Writing a checkpoint failed");
+      };
+      auto reports = runRenderJobs(jobs, options);
+      if (!reports[0].succeeded)
+        throw std::runtime_error(reports[0].error);
+    } else {
+      renderSerial(rendered, *writer, job.blockSize, job.queueDepth,
+                   job.firstSample, job.resume ? &resumePoint : nullptr,
+                   checkpoints.get());
+    }
+    writer.reset();
+    if (checkpoints)
+      checkpoints->remove();
+    if (cache)
+      storeInCache(*cache, cacheKey, job, pendingEntry);
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - startTime)
+                         .count();
+    if (telemetry)
+      telemetry->finish(true);
+
+    const double renderedSeconds =
+        (double)(job.endSample - firstSample) / sampleRate;
+    console() << "\nGeneration Successful." << std::endl;
+    if (job.analyse)
+      console() << "Analysis written to " << job.outputs[0].path
+                << ".analysis.json" << std::endl;
+    console() << "Rendered " << std::setprecision(1) << renderedSeconds
+              << "s of audio in " << elapsed << "s on " << job.numThreads
+              << " thread(s) with " << settings.kernels->name << " math ("
+              << (renderedSeconds / std::max(elapsed, 1e-9))
+              << "x realtime)." << std::endl;
+  } catch (const UsageError &) {
+    std::cout << usageText << std::endl;
+    return 1;
   } catch (const std::exception &e) {
+    if (telemetry)
+      telemetry->finish(false, e.what());
     std::cerr << "\nRuntime Error: " << e.what() << std::endl;
     return 1;
   }
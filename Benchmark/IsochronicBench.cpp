@@ -0,0 +1,485 @@
+#include "BlockKernels.h"
+#include "Journey.h"
+#include "MappedWavWriter.h"
+#include "OrganicNoiseSynth.h"
+#include "PcmPacker.h"
+#include "PluginProcessor.h"
+#include "StereoReverb.h"
+#include "ToneEngine.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Throughput of each stage of the synthesis path, measured on its own:
+// the kernels, the engine in each mode, journey interpolation, the noise
+// beds, the reverbs, saturation, PCM packing, WAV encoding and writing,
+// and the plugin's processBlock at host block sizes. Results print as a
+// table and can be written as JSON; given an earlier JSON file as a
+// baseline, any stage that got slower by more than the threshold fails the
+// run.
+
+namespace {
+
+// Bumped when stages change meaning, so old baselines aren't compared
+// against numbers that measure something else.
+constexpr int benchVersion = 1;
+
+constexpr double batchSampleRate = 44100.0;
+constexpr double hostSampleRate = 48000.0;
+constexpr int batchBlockSize = 8192;
+
+struct Stage {
+  std::string name;
+  double sampleRate = batchSampleRate;
+  int blockSize = batchBlockSize;
+  // Copy the test signal into the buffers before every block, for stages
+  // that work in place on their input.
+  bool refill = false;
+  // Processes blockSize stereo frames in place.
+  std::function<void(float *left, float *right, int numSamples)> process;
+};
+
+struct Result {
+  std::string name;
+  int blockSize = 0;
+  // Stereo frames per second of wall-clock time.
+  double samplesPerSecond = 0.0;
+  // Seconds of audio per second of wall-clock time at the stage's rate.
+  double realtimeFactor = 0.0;
+};
+
+// Counts the bytes written and keeps none of them, so encoding is timed
+// without the disk.
+class NullOutputStream : public juce::OutputStream {
+public:
+  void flush() override {}
+  bool setPosition(juce::int64 newPosition) override {
+    position = newPosition;
+    return true;
+  }
+  juce::int64 getPosition() override { return position; }
+  bool write(const void *, size_t numBytes) override {
+    position += (juce::int64)numBytes;
+    return true;
+  }
+
+private:
+  juce::int64 position = 0;
+};
+
+// A 440 Hz tone at 1.2, so saturation spends time in its curve rather
+// than near zero.
+std::vector<float> testSignal(int numSamples, double sampleRate) {
+  std::vector<float> signal((size_t)numSamples);
+  const double w = 2.0 * juce::MathConstants<double>::pi * 440.0 / sampleRate;
+  for (int i = 0; i < numSamples; ++i)
+    signal[(size_t)i] = static_cast<float>(1.2 * std::sin(w * i));
+  return signal;
+}
+
+SessionSettings fixedSession(EntrainmentMode mode, const BlockKernels &k) {
+  SessionSettings s;
+  s.sampleRate = batchSampleRate;
+  s.mode = mode;
+  s.pulseFreq = 10.0;
+  s.carrierFreq = 200.0;
+  s.kernels = &k;
+  return s;
+}
+
+// A one-hour descent with ramps on every lane, so the control grid always
+// has something to interpolate.
+Journey benchJourney() {
+  Journey j;
+  const double hour = 3600.0;
+  j.pulse.addKeyframe(0.0, 14.0);
+  j.pulse.addKeyframe(hour, 4.0, CurveShape::Exponential);
+  j.carrier.addKeyframe(0.0, 220.0);
+  j.carrier.addKeyframe(hour, 110.0, CurveShape::Exponential);
+  j.gain.addKeyframe(0.0, 0.5);
+  j.gain.addKeyframe(hour, 0.8);
+  j.softness.addKeyframe(0.0, 0.2);
+  j.softness.addKeyframe(hour, 0.8);
+  j.noiseLevel.addKeyframe(0.0, 0.1);
+  j.noiseLevel.addKeyframe(hour, 0.4);
+  return j;
+}
+
+void addKernelStages(std::vector<Stage> &stages, const char *suffix,
+                     const BlockKernels &k) {
+  const std::string tag = std::string(".") + suffix;
+
+  // Phases and sines covering every quadrant, made once.
+  auto phases = std::make_shared<std::vector<float>>(batchBlockSize);
+  auto sines = std::make_shared<std::vector<float>>(batchBlockSize);
+  for (int i = 0; i < batchBlockSize; ++i) {
+    (*phases)[(size_t)i] = static_cast<float>(
+        -juce::MathConstants<double>::pi +
+        juce::MathConstants<double>::twoPi * (i % 4410) / 4410.0);
+    (*sines)[(size_t)i] = std::sin((*phases)[(size_t)i]);
+  }
+
+  stages.push_back({"kernels.sine" + tag, batchSampleRate, batchBlockSize,
+                    false, [&k, phases](float *l, float *r, int n) {
+                      k.sine(phases->data(), l, n);
+                      k.sine(phases->data(), r, n);
+                    }});
+  stages.push_back({"kernels.pulse_envelope" + tag, batchSampleRate,
+                    batchBlockSize, false,
+                    [&k, sines](float *l, float *, int n) {
+                      k.pulseEnvelope(sines->data(), 3.0f, l, n);
+                    }});
+  stages.push_back({"saturate" + tag, batchSampleRate, batchBlockSize, true,
+                    [&k](float *l, float *r, int n) {
+                      k.saturate(l, l, n);
+                      k.saturate(r, r, n);
+                    }});
+
+  for (auto mode : {EntrainmentMode::Isochronic, EntrainmentMode::Binaural}) {
+    const std::string name = mode == EntrainmentMode::Isochronic
+                                 ? "engine.isochronic"
+                                 : "engine.binaural";
+    std::shared_ptr<ToneEngine> engine =
+        createToneEngine(fixedSession(mode, k));
+    stages.push_back({name + tag, batchSampleRate, batchBlockSize, false,
+                      [engine](float *l, float *r, int n) {
+                        engine->render(l, r, n);
+                      }});
+  }
+
+  auto journey = fixedSession(EntrainmentMode::Isochronic, k);
+  journey.isJourney = true;
+  journey.journey = benchJourney();
+  std::shared_ptr<ToneEngine> engine = createToneEngine(journey);
+  stages.push_back({"engine.journey" + tag, batchSampleRate, batchBlockSize,
+                    false, [engine](float *l, float *r, int n) {
+                      engine->render(l, r, n);
+                    }});
+}
+
+// A MappedWavWriter on a temporary file, which goes when the stage does.
+struct TempWavFile {
+  juce::File file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                        .getNonexistentChildFile("IsochronicBench", ".wav");
+  std::unique_ptr<MappedWavWriter> writer;
+
+  explicit TempWavFile(int64_t expectedFrames)
+      : writer(std::make_unique<MappedWavWriter>(
+            file.getFullPathName().toStdString(), batchSampleRate, 2,
+            PcmFormat::S24, expectedFrames, false)) {}
+  ~TempWavFile() {
+    writer.reset();
+    file.deleteFile();
+  }
+};
+
+// audioSeconds is how much audio all the trials of one stage add up to,
+// which is what the mapped WAV stage allocates up front.
+std::vector<Stage> buildStages(double audioSeconds) {
+  std::vector<Stage> stages;
+  addKernelStages(stages, "exact", BlockKernels::exact());
+  addKernelStages(stages, "fast", BlockKernels::fast());
+
+  // The control grid alone: five lanes stepped once per 64 samples, as a
+  // journey engine does.
+  {
+    auto lanes = std::make_shared<std::array<ControlLane, 5>>();
+    const Journey j = benchJourney();
+    const double ticksPerSecond = batchSampleRate / 64.0;
+    (*lanes)[0].prepare(j.pulse, 10.0, ticksPerSecond);
+    (*lanes)[1].prepare(j.carrier, 200.0, ticksPerSecond);
+    (*lanes)[2].prepare(j.gain, 1.0, ticksPerSecond);
+    (*lanes)[3].prepare(j.softness, 0.5, ticksPerSecond);
+    (*lanes)[4].prepare(j.noiseLevel, 0.3, ticksPerSecond);
+    stages.push_back({"journey.control_lanes", batchSampleRate,
+                      batchBlockSize, false,
+                      [lanes](float *l, float *, int n) {
+                        float sum = 0.0f;
+                        for (int i = 0; i < n; i += 64)
+                          for (auto &lane : *lanes) {
+                            lane.advance();
+                            sum += static_cast<float>(lane.current());
+                          }
+                        l[0] = sum;
+                      }});
+  }
+
+  const std::pair<const char *, OrganicNoiseSynth::Type> noises[] = {
+      {"noise.brown", OrganicNoiseSynth::Brown},
+      {"noise.pink", OrganicNoiseSynth::Pink},
+      {"noise.white", OrganicNoiseSynth::White}};
+  for (const auto &[name, type] : noises) {
+    auto noise = std::make_shared<std::array<OrganicNoiseSynth, 2>>();
+    (*noise)[0].prepare(batchSampleRate, type, 10.0f, 0, 0);
+    (*noise)[1].prepare(batchSampleRate, type, 10.0f, 0, 1);
+    stages.push_back({name, batchSampleRate, batchBlockSize, true,
+                      [noise](float *l, float *r, int n) {
+                        (*noise)[0].addTo(l, 0.3f, n);
+                        (*noise)[1].addTo(r, 0.3f, n);
+                      }});
+  }
+
+  const std::pair<const char *, ReverbType> reverbs[] = {
+      {"reverb.classic", ReverbType::Classic},
+      {"reverb.fdn", ReverbType::FeedbackDelayNetwork}};
+  for (const auto &[name, type] : reverbs) {
+    auto reverb = std::make_shared<StereoReverb>();
+    reverb->prepare(batchSampleRate, type);
+    stages.push_back({name, batchSampleRate, batchBlockSize, true,
+                      [reverb](float *l, float *r, int n) {
+                        reverb->process(l, r, n, 0.12f);
+                      }});
+  }
+
+  {
+    juce::WavAudioFormat wav;
+    std::shared_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(
+        new NullOutputStream(), batchSampleRate, 2, 24, {}, 0));
+    stages.push_back({"encode.wav24", batchSampleRate, batchBlockSize, true,
+                      [writer](float *l, float *r, int n) {
+                        const float *channels[] = {l, r};
+                        writer->writeFromFloatArrays(channels, 2, n);
+                      }});
+  }
+
+  // The batch tool's own conversion, into memory.
+  for (auto format : {PcmFormat::S24, PcmFormat::S32}) {
+    for (bool dither : {false, true}) {
+      auto packer = std::make_shared<PcmPacker>(format, 2, dither);
+      auto out = std::make_shared<std::vector<unsigned char>>(
+          (size_t)batchBlockSize * packer->bytesPerFrame());
+      auto position = std::make_shared<int64_t>(0);
+      std::string name = format == PcmFormat::S24 ? "pack.s24" : "pack.s32";
+      stages.push_back({name + (dither ? ".dither" : ""), batchSampleRate,
+                        batchBlockSize, true,
+                        [packer, out, position](float *l, float *r, int n) {
+                          const float *channels[] = {l, r};
+                          packer->pack(channels, n, *position, out->data());
+                          *position += n;
+                        }});
+    }
+  }
+
+  // Packing into a mapped file, as the batch tool writes WAV files. The
+  // kernel writes the pages back in the background, as it does during a
+  // render, so this is the time the render spends, not the disk's.
+  {
+    auto target = std::make_shared<TempWavFile>(
+        static_cast<int64_t>(audioSeconds * batchSampleRate) +
+        batchBlockSize);
+    stages.push_back({"write.mapped_wav24", batchSampleRate, batchBlockSize,
+                      true, [target](float *l, float *r, int n) {
+                        const float *channels[] = {l, r};
+                        if (!target->writer->writeFromFloatArrays(channels, 2,
+                                                                  n))
+                          throw std::runtime_error("Writing the WAV file "
+                                                   "failed");
+                      }});
+  }
+
+  // The plugin as a host drives it: the main voice alone, then with all
+  // sixteen layers sounding.
+  for (bool layered : {false, true}) {
+    for (int blockSize : {64, 128, 256, 512, 1024}) {
+      auto processor = std::make_shared<IsochronicToneGenAudioProcessor>();
+      for (int layer = 1; layered && layer <= LayerBank::numLayers; ++layer)
+        processor->apvts
+            .getParameter("LAYER" + juce::String(layer) + "_ON")
+            ->setValueNotifyingHost(1.0f);
+      processor->prepareToPlay(hostSampleRate, blockSize);
+      auto midi = std::make_shared<juce::MidiBuffer>();
+      std::string name = layered ? "plugin.process_block.layers."
+                                 : "plugin.process_block.";
+      stages.push_back({name + std::to_string(blockSize), hostSampleRate,
+                        blockSize, false,
+                        [processor, midi](float *l, float *r, int n) {
+                          float *channels[] = {l, r};
+                          juce::AudioBuffer<float> buffer(channels, 2, n);
+                          processor->processBlock(buffer, *midi);
+                        }});
+    }
+  }
+  return stages;
+}
+
+// Runs a stage for `seconds` of audio per trial and keeps the median
+// trial, after one untimed trial to settle caches and clocks.
+Result measure(Stage &stage, double seconds, int trials) {
+  const int n = stage.blockSize;
+  const int64_t blocks = std::max<int64_t>(
+      1, static_cast<int64_t>(seconds * stage.sampleRate / n));
+  std::vector<float> left((size_t)n), right((size_t)n);
+  const std::vector<float> signal = testSignal(n, stage.sampleRate);
+
+  auto run = [&] {
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t b = 0; b < blocks; ++b) {
+      if (stage.refill) {
+        std::copy(signal.begin(), signal.end(), left.begin());
+        std::copy(signal.begin(), signal.end(), right.begin());
+      }
+      stage.process(left.data(), right.data(), n);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return (double)(blocks * n) / std::max(elapsed.count(), 1e-9);
+  };
+
+  run();
+  std::vector<double> rates;
+  for (int t = 0; t < trials; ++t)
+    rates.push_back(run());
+  std::sort(rates.begin(), rates.end());
+
+  Result result;
+  result.name = stage.name;
+  result.blockSize = n;
+  result.samplesPerSecond = rates[rates.size() / 2];
+  result.realtimeFactor = result.samplesPerSecond / stage.sampleRate;
+  return result;
+}
+
+juce::var toJson(const std::vector<Result> &results) {
+  juce::Array<juce::var> list;
+  for (const auto &r : results) {
+    auto *entry = new juce::DynamicObject();
+    entry->setProperty("name", juce::String(r.name));
+    entry->setProperty("block_size", r.blockSize);
+    entry->setProperty("samples_per_second", r.samplesPerSecond);
+    entry->setProperty("realtime_factor", r.realtimeFactor);
+    list.add(juce::var(entry));
+  }
+  auto *root = new juce::DynamicObject();
+  root->setProperty("bench_version", benchVersion);
+  root->setProperty("fast_kernels", juce::String(BlockKernels::fast().name));
+  root->setProperty("stages", list);
+  return juce::var(root);
+}
+
+// Compares every stage present in both runs. Returns the number that fell
+// more than thresholdPercent below the baseline.
+int compareWithBaseline(const std::vector<Result> &results,
+                        const std::string &path, double thresholdPercent) {
+  juce::File file(path);
+  if (!file.existsAsFile())
+    throw std::runtime_error("Could not open baseline " + path);
+  juce::var root;
+  auto parsed = juce::JSON::parse(file.loadFileAsString(), root);
+  if (parsed.failed())
+    throw std::runtime_error(path + ": " +
+                             parsed.getErrorMessage().toStdString());
+  if (static_cast<int>(root["bench_version"]) != benchVersion)
+    throw std::runtime_error(path + " was written by a different version of "
+                                    "the benchmark");
+
+  std::map<std::string, double> baseline;
+  if (const auto *stages = root["stages"].getArray())
+    for (const auto &s : *stages)
+      baseline[s["name"].toString().toStdString()] =
+          static_cast<double>(s["samples_per_second"]);
+
+  std::cout << "\nAgainst " << path << " (fail below -" << thresholdPercent
+            << "%):\n";
+  int regressions = 0;
+  for (const auto &r : results) {
+    auto it = baseline.find(r.name);
+    if (it == baseline.end() || it->second <= 0.0)
+      continue;
+    const double change = (r.samplesPerSecond / it->second - 1.0) * 100.0;
+    const bool regressed = change < -thresholdPercent;
+    regressions += regressed ? 1 : 0;
+    std::cout << "  " << std::left << std::setw(36) << r.name << std::right
+              << std::showpos << std::fixed << std::setprecision(1)
+              << std::setw(8) << change << "%" << std::noshowpos
+              << (regressed ? "  REGRESSION" : "") << "\n";
+  }
+  return regressions;
+}
+
+const char *usageText =
+    "Usage: IsochronicBench [--seconds <audio seconds per trial>] "
+    "[--trials <n>] [--filter <text>] [--json <output.json>] "
+    "[--baseline <baseline.json>] [--threshold <percent>]\n"
+    "Measures each stage's throughput in stereo frames per second and as "
+    "a multiple of realtime. --filter runs only stages whose name contains "
+    "the text. --baseline compares against an earlier --json file and "
+    "exits with status 1 if any stage is more than --threshold percent "
+    "(default 10) slower; usage and other errors exit with status 2.";
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // The plugin's parameters need a message manager to exist.
+  juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+  double seconds = 10.0;
+  int trials = 5;
+  double thresholdPercent = 10.0;
+  std::string filter, jsonPath, baselinePath;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (arg == "--seconds" && hasValue)
+        seconds = std::max(0.01, std::stod(argv[++i]));
+      else if (arg == "--trials" && hasValue)
+        trials = std::max(1, std::stoi(argv[++i]));
+      else if (arg == "--filter" && hasValue)
+        filter = argv[++i];
+      else if (arg == "--json" && hasValue)
+        jsonPath = argv[++i];
+      else if (arg == "--baseline" && hasValue)
+        baselinePath = argv[++i];
+      else if (arg == "--threshold" && hasValue)
+        thresholdPercent = std::stod(argv[++i]);
+      else {
+        std::cout << usageText << std::endl;
+        return 2;
+      }
+    }
+
+    // Each stage runs one untimed trial and then `trials` timed ones.
+    std::vector<Stage> stages = buildStages(seconds * (trials + 1));
+    std::vector<Result> results;
+    std::cout << std::left << std::setw(36) << "stage" << std::right
+              << std::setw(8) << "block" << std::setw(16) << "samples/s"
+              << std::setw(12) << "realtime" << "\n";
+    for (auto &stage : stages) {
+      if (stage.name.find(filter) == std::string::npos)
+        continue;
+      results.push_back(measure(stage, seconds, trials));
+      const auto &r = results.back();
+      std::cout << std::left << std::setw(36) << r.name << std::right
+                << std::setw(8) << r.blockSize << std::fixed
+                << std::setprecision(0) << std::setw(16) << r.samplesPerSecond
+                << std::setprecision(1) << std::setw(11) << r.realtimeFactor
+                << "x" << std::endl;
+    }
+    std::cout << "Fast kernels: " << BlockKernels::fast().name << "\n";
+
+    if (!jsonPath.empty()) {
+      juce::File out(jsonPath);
+      if (!out.replaceWithText(juce::JSON::toString(toJson(results))))
+        throw std::runtime_error("Could not write " + jsonPath);
+    }
+    if (!baselinePath.empty() &&
+        compareWithBaseline(results, baselinePath, thresholdPercent) > 0)
+      return 1;
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
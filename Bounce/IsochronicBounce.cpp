@@ -0,0 +1,282 @@
+#include "CommandLine.h"
+#include "Journey.h"
+#include "MappedWavWriter.h"
+#include "PcmStreamWriter.h"
+#include "PluginProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Renders a plugin preset to a file without a host. The processor is
+// built as the plugin is, given the state a DAW saved through
+// getStateInformation, put in non-realtime mode and driven with large
+// blocks as fast as it will go. Optional automation moves parameters
+// between blocks. The audio goes to disk as it is made, through the same
+// writers as IsochronicBatchGen.
+
+namespace {
+
+// Loads a preset into the processor through setStateInformation. The
+// file is either the binary blob getStateInformation writes or the XML
+// inside it, which is wrapped the same way first.
+void loadPreset(IsochronicToneGenAudioProcessor &processor,
+                const std::string &path) {
+  juce::MemoryBlock data;
+  if (!juce::File(path).loadFileAsData(data))
+    throw std::runtime_error("Could not read preset " + path);
+  if (data.toString().trimStart().startsWithChar('<')) {
+    auto xml = juce::parseXML(data.toString());
+    if (!xml)
+      throw std::runtime_error(path + " is not valid XML");
+    data.reset();
+    juce::AudioProcessor::copyXmlToBinary(*xml, data);
+  }
+  // setStateInformation ignores anything it can't use, so check first.
+  auto xml = juce::AudioProcessor::getXmlFromBinary(data.getData(),
+                                                    (int)data.getSize());
+  if (!xml || !xml->hasTagName(processor.apvts.state.getType()))
+    throw std::runtime_error(path + " is not a preset for this plugin");
+  processor.setStateInformation(data.getData(), (int)data.getSize());
+}
+
+// One automated parameter: its keyframes and the lane that plays them on
+// the block grid.
+struct Automation {
+  juce::RangedAudioParameter *parameter = nullptr;
+  AutomationLane keyframes;
+  ControlLane lane;
+};
+
+// Reads an automation file. Each line is
+//
+//   <time> <PARAMETER_ID> <value> [linear|exp|hold]
+//
+// with times as in journey files (seconds, an s, m or h suffix, or a
+// percentage of the bounce) and values in the parameter's own units: Hz,
+// dB, 0-1 for softness, the choice index for MODE and 0 or 1 for the
+// LAYERn_ON switches. The curve is how the parameter gets from its
+// previous keyframe to this one, linear by default. Before its first
+// keyframe a parameter holds that keyframe's value. Blank lines and
+// anything after '#' are ignored. Throws on a bad line.
+std::map<std::string, Automation>
+parseAutomation(const std::string &path, double duration,
+                IsochronicToneGenAudioProcessor &processor) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error("Could not open automation file " + path);
+
+  std::map<std::string, Automation> automation;
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(in, line)) {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string timeStr, id, valueStr, curveStr;
+    if (!(fields >> timeStr))
+      continue;
+    auto fail = [&](const std::string &why) {
+      return std::runtime_error(path + ":" + std::to_string(lineNumber) +
+                                ": " + why);
+    };
+    if (!(fields >> id >> valueStr))
+      throw fail("expected <time> <parameter> <value> [curve]");
+    fields >> curveStr;
+
+    CurveShape curve = CurveShape::Linear;
+    if (curveStr == "exp")
+      curve = CurveShape::Exponential;
+    else if (curveStr == "hold")
+      curve = CurveShape::Hold;
+    else if (!curveStr.empty() && curveStr != "linear")
+      throw fail("unknown curve '" + curveStr + "'");
+
+    auto *parameter = processor.apvts.getParameter(id);
+    if (parameter == nullptr)
+      throw fail("unknown parameter '" + id + "'");
+    try {
+      Automation &a = automation[id];
+      a.parameter = parameter;
+      a.keyframes.addKeyframe(parseTime(timeStr, duration),
+                              std::stod(valueStr), curve);
+    } catch (const std::logic_error &) {
+      throw fail("bad number");
+    } catch (const std::runtime_error &e) {
+      throw fail(e.what());
+    }
+  }
+  return automation;
+}
+
+// "-" is stdout and a stream kind writes in one pass; otherwise a WAV
+// file written through a memory mapping, sized for lengthSamples.
+std::unique_ptr<juce::AudioFormatWriter>
+openOutput(const std::string &path, const std::string &streamKind,
+           double sampleRate, PcmFormat format, int64_t lengthSamples,
+           bool dither) {
+  if (path == "-" || !streamKind.empty()) {
+    const bool toStdout = (path == "-");
+    FILE *file = toStdout ? stdout : std::fopen(path.c_str(), "wb");
+    if (!file)
+      throw std::runtime_error("Could not open " + path);
+    return std::make_unique<PcmStreamWriter>(
+        new StdioOutputStream(file, !toStdout), sampleRate, 2, format,
+        streamKind != "raw", -1, dither);
+  }
+  return std::make_unique<MappedWavWriter>(path, sampleRate, 2, format,
+                                           lengthSamples, dither);
+}
+
+const char *usageText =
+    "Usage: IsochronicBounce <preset> <output> <duration> [--rate <hz>] "
+    "[--block-size <samples>] [--automation <file>] "
+    "[--control-block <samples>] [--sample-format s16|s24|s32|f32] "
+    "[--dither] [--stream wav|raw]\n"
+    "Renders a preset saved by the plugin (its state blob or the XML in "
+    "it) for <duration> (seconds, or with an s, m or h suffix) as fast as "
+    "the CPU allows, and reports the realtime factor. The processor runs "
+    "in non-realtime mode at --rate (default 44100) in blocks of "
+    "--block-size samples (default 8192). --automation moves parameters "
+    "along keyframes, one line per keyframe: <time> <PARAMETER_ID> <value> "
+    "[linear|exp|hold]. Automation is applied between blocks, so with it "
+    "blocks are at most --control-block samples (default 512). An output "
+    "of - writes a WAV stream to stdout; --stream writes files in one pass "
+    "too. --dither adds TPDF dither when converting to integer samples.";
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // The plugin's parameters need a message manager to exist.
+  juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+  try {
+    std::vector<std::string> args;
+    double sampleRate = 44100.0;
+    int blockSize = 8192;
+    int controlBlock = 512;
+    std::string automationPath, streamKind, sampleFormatName = "s24";
+    bool dither = false;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (arg == "--rate" && hasValue)
+        sampleRate = std::stod(argv[++i]);
+      else if (arg == "--block-size" && hasValue)
+        blockSize = std::max(64, std::stoi(argv[++i]));
+      else if (arg == "--automation" && hasValue)
+        automationPath = argv[++i];
+      else if (arg == "--control-block" && hasValue)
+        controlBlock = std::max(16, std::stoi(argv[++i]));
+      else if (arg == "--sample-format" && hasValue)
+        sampleFormatName = argv[++i];
+      else if (arg == "--dither")
+        dither = true;
+      else if (arg == "--stream" && hasValue)
+        streamKind = argv[++i];
+      else
+        args.push_back(arg);
+    }
+    if (args.size() != 3)
+      throw UsageError("expected <preset> <output> <duration>");
+    if (!streamKind.empty() && streamKind != "wav" && streamKind != "raw")
+      throw std::runtime_error("Unknown stream kind " + streamKind);
+    if (sampleRate < 8000.0 || sampleRate > 768000.0)
+      throw std::runtime_error("Unsupported sample rate " +
+                               std::to_string(sampleRate));
+    const std::string &presetPath = args[0];
+    const std::string &outputPath = args[1];
+    const double seconds = parseTime(args[2], 0.0);
+    const int64_t totalSamples =
+        std::max<int64_t>(0, std::llround(seconds * sampleRate));
+    const PcmFormat sampleFormat = parseSampleFormat(sampleFormatName);
+    audioOnStdout = (outputPath == "-");
+
+    IsochronicToneGenAudioProcessor processor;
+    // Before prepareToPlay, which is where the processor looks at it.
+    processor.setNonRealtime(true);
+    loadPreset(processor, presetPath);
+
+    auto automation =
+        automationPath.empty()
+            ? std::map<std::string, Automation>()
+            : parseAutomation(automationPath, seconds, processor);
+    const int step =
+        automation.empty() ? blockSize : std::min(blockSize, controlBlock);
+    // Tick k of every lane is the start of block k.
+    for (auto &entry : automation)
+      entry.second.lane.prepare(entry.second.keyframes, 0.0,
+                                sampleRate / step);
+
+    processor.setRateAndBufferSizeDetails(sampleRate, step);
+    processor.prepareToPlay(sampleRate, step);
+
+    auto writer = openOutput(outputPath, streamKind, sampleRate, sampleFormat,
+                             totalSamples, dither);
+
+    const int numChannels = std::max(2, processor.getTotalNumOutputChannels());
+    juce::AudioBuffer<float> buffer(numChannels, step);
+    juce::MidiBuffer midi;
+    std::chrono::duration<double> processing{0.0};
+    int lastPercent = -1;
+    const auto start = std::chrono::steady_clock::now();
+    for (int64_t done = 0; done < totalSamples;) {
+      const int n =
+          static_cast<int>(std::min<int64_t>(step, totalSamples - done));
+      for (auto &entry : automation) {
+        Automation &a = entry.second;
+        a.parameter->setValueNotifyingHost(
+            a.parameter->convertTo0to1(static_cast<float>(a.lane.current())));
+        a.lane.advance();
+      }
+
+      juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(),
+                                     numChannels, n);
+      const auto blockStart = std::chrono::steady_clock::now();
+      processor.processBlock(block, midi);
+      processing += std::chrono::steady_clock::now() - blockStart;
+      if (!writer->writeFromFloatArrays(buffer.getArrayOfReadPointers(), 2, n))
+        throw std::runtime_error("Writing the output failed");
+      done += n;
+
+      const int percent = static_cast<int>(100 * done / totalSamples);
+      if (percent != lastPercent) {
+        console() << "\rProgress: " << percent << "%" << std::flush;
+        lastPercent = percent;
+      }
+    }
+    // Closing the writer finishes the file, which is part of the bounce.
+    writer.reset();
+    processor.releaseResources();
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    console() << "\nBounced " << std::fixed << std::setprecision(1) << seconds
+              << "s of audio in " << std::setprecision(2) << elapsed
+              << "s (" << std::setprecision(1)
+              << seconds / std::max(elapsed, 1e-9) << "x realtime; "
+              << "processBlock alone "
+              << seconds / std::max(processing.count(), 1e-9) << "x)."
+              << std::endl;
+  } catch (const UsageError &) {
+    std::cout << usageText << std::endl;
+    return 1;
+  } catch (const std::exception &e) {
+    std::cerr << "\nRuntime Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include "BlockKernels.h"
+#include "FastMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if BLOCK_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+const BlockKernels &blockKernelsSSE2();
+const BlockKernels &blockKernelsAVX2();
+const BlockKernels &blockKernelsAVX512();
+#endif
+
+namespace {
+
+// --- Exact kernels ---
+void exactSine(const float *phase, float *out, int numSamples) {
+  for (int i = 0; i < numSamples; ++i)
+    out[i] = std::sin(phase[i]);
+}
+
+void exactPulseEnvelope(const float *sine, float exponent, float *out,
+                        int numSamples) {
+  for (int i = 0; i < numSamples; ++i)
+    out[i] = std::pow(std::max(0.0f, sine[i]), exponent);
+}
+
+void exactPulseEnvelopeLanes(const float *sine, const float *exponent,
+                             int numLanes, float *out, int numFrames) {
+  for (int f = 0; f < numFrames; ++f)
+    for (int l = 0; l < numLanes; ++l) {
+      const int i = f * numLanes + l;
+      out[i] = std::pow(std::max(0.0f, sine[i]), exponent[l]);
+    }
+}
+
+void exactSaturate(const float *in, float *out, int numSamples) {
+  for (int i = 0; i < numSamples; ++i)
+    out[i] = std::tanh(in[i]);
+}
+
+// --- Scalar fallback for the fast kernels ---
+struct ScalarVec {
+  using F = float;
+  using I = int32_t;
+  using M = bool;
+  static constexpr int width = 1;
+
+  static F load(const float *p) { return *p; }
+  static void store(float *p, F v) { *p = v; }
+  static F set(float v) { return v; }
+  static F add(F a, F b) { return a + b; }
+  static F sub(F a, F b) { return a - b; }
+  static F mul(F a, F b) { return a * b; }
+  static F div(F a, F b) { return a / b; }
+  static F fma(F a, F b, F c) { return a * b + c; }
+  static F min(F a, F b) { return a < b ? a : b; }
+  static F max(F a, F b) { return a > b ? a : b; }
+  static F abs(F a) { return std::fabs(a); }
+  // Adding 1.5 * 2^23 pushes the fraction out of the mantissa, which rounds
+  // to nearest for |a| < 2^22 without a libm call.
+  static F round(F a) { return (a + 12582912.0f) - 12582912.0f; }
+  static M greater(F a, F b) { return a > b; }
+  static F select(M m, F a, F b) { return m ? a : b; }
+  static I toInt(F a) { return static_cast<I>(a); }
+  static F toFloat(I a) { return static_cast<F>(a); }
+  static I asInt(F a) {
+    I i;
+    std::memcpy(&i, &a, sizeof(i));
+    return i;
+  }
+  static F asFloat(I a) {
+    F f;
+    std::memcpy(&f, &a, sizeof(f));
+    return f;
+  }
+  static I setInt(int v) { return v; }
+  static I addInt(I a, I b) { return a + b; }
+  static I andInt(I a, I b) { return a & b; }
+  static I orInt(I a, I b) { return a | b; }
+  static I shiftLeft23(I a) {
+    return static_cast<I>(static_cast<uint32_t>(a) << 23);
+  }
+  static I shiftRight23(I a) {
+    return static_cast<I>(static_cast<uint32_t>(a) >> 23);
+  }
+};
+
+} // namespace
+
+const BlockKernels &BlockKernels::exact() {
+  static const BlockKernels kernels{exactSine, exactPulseEnvelope,
+                                    exactPulseEnvelopeLanes, exactSaturate,
+                                    "exact"};
+  return kernels;
+}
+
+BlockKernels::InstructionSet BlockKernels::detectInstructionSet() {
+#if BLOCK_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  const bool sse2 = (info[3] & (1 << 26)) != 0;
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool fma = (info[2] & (1 << 12)) != 0;
+  const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  const bool avxState = (xcr0 & 0x6) == 0x6;
+  const bool avx512State = (xcr0 & 0xE6) == 0xE6;
+  bool avx2 = false, avx512 = false;
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+    avx512 = (info[1] & (1 << 16)) != 0;
+  }
+  if (avx512 && avx512State)
+    return InstructionSet::AVX512;
+  if (avx2 && fma && avxState)
+    return InstructionSet::AVX2;
+  if (sse2)
+    return InstructionSet::SSE2;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return InstructionSet::AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return InstructionSet::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return InstructionSet::SSE2;
+#endif
+#endif
+  return InstructionSet::Scalar;
+}
+
+const BlockKernels &BlockKernels::fast(InstructionSet limit) {
+  static const BlockKernels scalar{
+      fastSine<ScalarVec>, fastPulseEnvelope<ScalarVec>,
+      fastPulseEnvelopeLanes<ScalarVec>, fastSaturate<ScalarVec>,
+      "fast (scalar)"};
+
+  auto available = detectInstructionSet();
+  auto chosen = std::min(available, limit);
+  (void)chosen;
+#if BLOCK_KERNELS_X86
+  if (chosen == InstructionSet::AVX512)
+    return blockKernelsAVX512();
+  if (chosen == InstructionSet::AVX2)
+    return blockKernelsAVX2();
+  if (chosen == InstructionSet::SSE2)
+    return blockKernelsSSE2();
+#endif
+  return scalar;
+}
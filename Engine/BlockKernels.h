@@ -0,0 +1,35 @@
+#pragma once
+
+// Block-wise math for the batch renderer. Every kernel works on contiguous
+// float arrays so the fast versions can run several samples per instruction.
+//
+// The exact set calls std::sin / std::pow / std::tanh per element and gives
+// the same bits as the original per-sample loop. The fast set uses the
+// polynomial approximations in FastMath.h, with one build per instruction set
+// (SSE2, AVX2 + FMA, AVX-512) picked at runtime, plus a scalar build for
+// other CPUs. Input and output may be the same array.
+struct BlockKernels {
+  enum class InstructionSet { Scalar, SSE2, AVX2, AVX512 };
+
+  // out[i] = sin(phase[i])
+  void (*sine)(const float *phase, float *out, int numSamples);
+  // out[i] = pow(max(0, sine[i]), exponent)
+  void (*pulseEnvelope)(const float *sine, float exponent, float *out,
+                        int numSamples);
+  // The same for interleaved lanes with an exponent each:
+  // out[f * numLanes + l] = pow(max(0, sine[f * numLanes + l]), exponent[l]).
+  // numLanes must be a multiple of 16, so every register holds whole lanes
+  // on every instruction set.
+  void (*pulseEnvelopeLanes)(const float *sine, const float *exponent,
+                             int numLanes, float *out, int numFrames);
+  // out[i] = tanh(in[i])
+  void (*saturate)(const float *in, float *out, int numSamples);
+  const char *name;
+
+  static const BlockKernels &exact();
+  // Fastest set the CPU supports, optionally capped at `limit`.
+  static const BlockKernels &
+  fast(InstructionSet limit = InstructionSet::AVX512);
+
+  static InstructionSet detectInstructionSet();
+};
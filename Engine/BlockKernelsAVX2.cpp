@@ -0,0 +1,49 @@
+#include "BlockKernels.h"
+#include "FastMath.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct AVX2Vec {
+  using F = __m256;
+  using I = __m256i;
+  using M = __m256;
+  static constexpr int width = 8;
+
+  static F load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, F v) { _mm256_storeu_ps(p, v); }
+  static F set(float v) { return _mm256_set1_ps(v); }
+  static F add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm256_div_ps(a, b); }
+  static F fma(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+  static F min(F a, F b) { return _mm256_min_ps(a, b); }
+  static F max(F a, F b) { return _mm256_max_ps(a, b); }
+  static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+  static F round(F a) {
+    return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  }
+  static M greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+  static I toInt(F a) { return _mm256_cvttps_epi32(a); }
+  static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+  static I asInt(F a) { return _mm256_castps_si256(a); }
+  static F asFloat(I a) { return _mm256_castsi256_ps(a); }
+  static I setInt(int v) { return _mm256_set1_epi32(v); }
+  static I addInt(I a, I b) { return _mm256_add_epi32(a, b); }
+  static I andInt(I a, I b) { return _mm256_and_si256(a, b); }
+  static I orInt(I a, I b) { return _mm256_or_si256(a, b); }
+  static I shiftLeft23(I a) { return _mm256_slli_epi32(a, 23); }
+  static I shiftRight23(I a) { return _mm256_srli_epi32(a, 23); }
+};
+
+} // namespace
+
+const BlockKernels &blockKernelsAVX2() {
+  static const BlockKernels kernels{
+      fastSine<AVX2Vec>, fastPulseEnvelope<AVX2Vec>,
+      fastPulseEnvelopeLanes<AVX2Vec>, fastSaturate<AVX2Vec>, "fast (AVX2)"};
+  return kernels;
+}
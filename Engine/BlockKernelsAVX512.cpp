@@ -0,0 +1,50 @@
+#include "BlockKernels.h"
+#include "FastMath.h"
+
+#include <immintrin.h>
+
+namespace {
+
+// Sticks to AVX-512F so it runs on every AVX-512 part.
+struct AVX512Vec {
+  using F = __m512;
+  using I = __m512i;
+  using M = __mmask16;
+  static constexpr int width = 16;
+
+  static F load(const float *p) { return _mm512_loadu_ps(p); }
+  static void store(float *p, F v) { _mm512_storeu_ps(p, v); }
+  static F set(float v) { return _mm512_set1_ps(v); }
+  static F add(F a, F b) { return _mm512_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm512_div_ps(a, b); }
+  static F fma(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+  static F min(F a, F b) { return _mm512_min_ps(a, b); }
+  static F max(F a, F b) { return _mm512_max_ps(a, b); }
+  static F abs(F a) { return _mm512_abs_ps(a); }
+  static F round(F a) {
+    return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  }
+  static M greater(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+  static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+  static I toInt(F a) { return _mm512_cvttps_epi32(a); }
+  static F toFloat(I a) { return _mm512_cvtepi32_ps(a); }
+  static I asInt(F a) { return _mm512_castps_si512(a); }
+  static F asFloat(I a) { return _mm512_castsi512_ps(a); }
+  static I setInt(int v) { return _mm512_set1_epi32(v); }
+  static I addInt(I a, I b) { return _mm512_add_epi32(a, b); }
+  static I andInt(I a, I b) { return _mm512_and_si512(a, b); }
+  static I orInt(I a, I b) { return _mm512_or_si512(a, b); }
+  static I shiftLeft23(I a) { return _mm512_slli_epi32(a, 23); }
+  static I shiftRight23(I a) { return _mm512_srli_epi32(a, 23); }
+};
+
+} // namespace
+
+const BlockKernels &blockKernelsAVX512() {
+  static const BlockKernels kernels{
+      fastSine<AVX512Vec>, fastPulseEnvelope<AVX512Vec>,
+      fastPulseEnvelopeLanes<AVX512Vec>, fastSaturate<AVX512Vec>, "fast (AVX-512)"};
+  return kernels;
+}
@@ -0,0 +1,50 @@
+#include "BlockKernels.h"
+#include "FastMath.h"
+
+#include <emmintrin.h>
+
+namespace {
+
+struct SSE2Vec {
+  using F = __m128;
+  using I = __m128i;
+  using M = __m128;
+  static constexpr int width = 4;
+
+  static F load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, F v) { _mm_storeu_ps(p, v); }
+  static F set(float v) { return _mm_set1_ps(v); }
+  static F add(F a, F b) { return _mm_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm_div_ps(a, b); }
+  static F fma(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static F min(F a, F b) { return _mm_min_ps(a, b); }
+  static F max(F a, F b) { return _mm_max_ps(a, b); }
+  static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  // Rounds to nearest under the default MXCSR mode.
+  static F round(F a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+  static M greater(F a, F b) { return _mm_cmpgt_ps(a, b); }
+  static F select(M m, F a, F b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+  }
+  static I toInt(F a) { return _mm_cvttps_epi32(a); }
+  static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+  static I asInt(F a) { return _mm_castps_si128(a); }
+  static F asFloat(I a) { return _mm_castsi128_ps(a); }
+  static I setInt(int v) { return _mm_set1_epi32(v); }
+  static I addInt(I a, I b) { return _mm_add_epi32(a, b); }
+  static I andInt(I a, I b) { return _mm_and_si128(a, b); }
+  static I orInt(I a, I b) { return _mm_or_si128(a, b); }
+  static I shiftLeft23(I a) { return _mm_slli_epi32(a, 23); }
+  static I shiftRight23(I a) { return _mm_srli_epi32(a, 23); }
+};
+
+} // namespace
+
+const BlockKernels &blockKernelsSSE2() {
+  static const BlockKernels kernels{
+      fastSine<SSE2Vec>, fastPulseEnvelope<SSE2Vec>,
+      fastPulseEnvelopeLanes<SSE2Vec>, fastSaturate<SSE2Vec>, "fast (SSE2)"};
+  return kernels;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The isochronic pulse envelope, pow(max(0, sin(phase)), 1 + 4 * softness),
+// tabulated over one cycle of the pulse phase for a single softness. One
+// lookup and a linear interpolation replace a sine and a pow per sample.
+// Phase 0 and pi are table points, so the corners where the envelope
+// leaves and returns to zero are exact; elsewhere the error is under 1e-5
+// for every softness. The size is set by the intervals next to those
+// corners: with an exponent between 1 and 2 the curve bends sharply there,
+// and at 8192 points softness 0.03-0.06 reached 1.4e-5. At 16384 the worst
+// is 6.4e-6, at softness 0.03.
+//
+// The table holds the exact curve, not a band-limited one. A band-limited
+// envelope would round off those corners and change the sound, and the
+// plugin has to keep matching IsochronicBatchGen, which computes the exact
+// curve. The table adds no aliasing the exact curve doesn't already have.
+class EnvelopeTable {
+public:
+  static constexpr int size = 16384;
+
+  // Allocates and runs size pows; build these off the audio thread.
+  explicit EnvelopeTable(float tableSoftness) : softness(tableSoftness) {
+    const double exponent = 1.0 + (double)softness * 4.0;
+    const double pi = 3.14159265358979323846;
+    values.resize(size + 1);
+    for (int i = 0; i <= size; ++i) {
+      // Entry i is phase -pi + 2 pi i / size, the range the engine's float
+      // phases cover.
+      const double s = std::sin(-pi + 2.0 * pi * (double)i / (double)size);
+      values[(size_t)i] = static_cast<float>(std::pow(std::max(0.0, s),
+                                                      exponent));
+    }
+  }
+
+  float getSoftness() const { return softness; }
+
+  // phase in radians, [-pi, pi).
+  float lookup(float phase) const {
+    constexpr float scale = (float)size / 6.28318530717958647692f;
+    const float x =
+        std::min((phase + 3.14159265358979323846f) * scale, (float)size);
+    const int k = std::min(static_cast<int>(x), size - 1);
+    const float f = x - (float)k;
+    const float a = values[(size_t)k];
+    return a + f * (values[(size_t)k + 1] - a);
+  }
+
+private:
+  float softness;
+  std::vector<float> values;
+};
+
+// Hands the engine's isochronic path the envelope from a table, fading
+// from the previous table to a new one so softness changes don't step.
+// The tables belong to the caller, which also decides when to switch;
+// the shaper only keeps pointers, so it never allocates or frees. Used on
+// the audio thread only.
+class EnvelopeShaper {
+public:
+  // Fades from the current table to `next` over fadeSamples. The first
+  // table, or a fade length of 0, switches at once. Only call while
+  // !isFading().
+  void fadeTo(const EnvelopeTable *next, int fadeSamples) {
+    if (current == nullptr || fadeSamples <= 0) {
+      retired = current;
+      current = next;
+      return;
+    }
+    previous = current;
+    current = next;
+    fadeLength = fadeSamples;
+    fadePosition = 0;
+  }
+
+  bool isFading() const { return previous != nullptr; }
+  bool hasTable() const { return current != nullptr; }
+
+  // The table a finished fade stopped using, or nullptr. The caller may
+  // reclaim it once this returns it.
+  const EnvelopeTable *takeRetired() {
+    const EnvelopeTable *t = retired;
+    retired = nullptr;
+    return t;
+  }
+
+  // out[i] = envelope at phase[i], advancing any fade.
+  void apply(const float *phase, float *out, int numSamples) {
+    int i = 0;
+    if (previous != nullptr) {
+      const float step = 1.0f / (float)fadeLength;
+      for (; i < numSamples && fadePosition < fadeLength; ++i) {
+        const float t = (float)fadePosition++ * step;
+        const float from = previous->lookup(phase[i]);
+        out[i] = from + t * (current->lookup(phase[i]) - from);
+      }
+      if (fadePosition >= fadeLength) {
+        retired = previous;
+        previous = nullptr;
+      }
+    }
+    const EnvelopeTable &table = *current;
+    for (; i < numSamples; ++i)
+      out[i] = table.lookup(phase[i]);
+  }
+
+private:
+  const EnvelopeTable *current = nullptr;
+  const EnvelopeTable *previous = nullptr;
+  const EnvelopeTable *retired = nullptr;
+  int fadeLength = 1;
+  int fadePosition = 0;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+// Polynomial approximations behind the fast BlockKernels. Each instruction
+// set TU includes this file and instantiates it with its own register
+// wrapper V, so everything here has internal linkage. That keeps the linker
+// from merging an AVX build of a helper into code that runs on older CPUs.
+//
+// V provides F (float lanes), I (int32 lanes), M (lane mask), `width`, and
+// load/store/set, add/sub/mul/div/fma (a * b + c), min/max/abs/round,
+// greater/select, toInt/toFloat/asInt/asFloat and the int ops
+// setInt/addInt/andInt/orInt/shiftLeft23/shiftRight23.
+//
+// Error bounds, measured against double precision on every build:
+//   sine           |x| <= 1e4 rad                    abs error < 2.5e-7
+//   pulseEnvelope  s in [-1, 1], exponent in [1, 5]  abs error < 2.5e-7
+//   saturate       any x                             abs error < 1.5e-7
+// That is about 2 LSB at 24-bit for each stage.
+
+namespace {
+
+template <typename V> struct FastMath {
+  using F = typename V::F;
+  using I = typename V::I;
+  using M = typename V::M;
+
+  static F sine(F x) {
+    // Bring x into [-pi, pi] with a three-term Cody-Waite reduction. The
+    // first two constants have short mantissas, so k * C is exact even
+    // without FMA for |x| up to about 5e4.
+    F k = V::round(V::mul(x, V::set(0.159154937f)));
+    x = V::fma(k, V::set(-6.28125f), x);
+    x = V::fma(k, V::set(-1.93500519e-3f), x);
+    x = V::fma(k, V::set(-3.01991605e-7f), x);
+
+    // Fold into [-pi/2, pi/2] using sin(x) = sin(pi - x) = sin(-pi - x).
+    const F pi = V::set(3.14159274f);
+    F ax = V::abs(x);
+    F folded = V::select(V::greater(x, V::set(0.0f)), V::sub(pi, x),
+                         V::sub(V::sub(V::set(0.0f), pi), x));
+    x = V::select(V::greater(ax, V::set(1.57079637f)), folded, x);
+
+    // Odd minimax polynomial, 3.4e-9 max error on [-pi/2, pi/2].
+    F x2 = V::mul(x, x);
+    F p = V::fma(x2, V::set(2.590490068e-6f), V::set(-1.980089869e-4f));
+    p = V::fma(x2, p, V::set(8.332899842e-3f));
+    p = V::fma(x2, p, V::set(-0.1666664764f));
+    p = V::fma(x2, p, V::set(0.9999999766f));
+    return V::mul(x, p);
+  }
+
+  // 2^y for y in [-126, 126], 7.5e-8 relative error.
+  static F exp2(F y) {
+    y = V::max(V::set(-126.0f), V::min(V::set(126.0f), y));
+    F whole = V::round(y);
+    F f = V::sub(y, whole);
+    F p = V::fma(f, V::set(1.327658578e-3f), V::set(9.675542849e-3f));
+    p = V::fma(f, p, V::set(5.550712927e-2f));
+    p = V::fma(f, p, V::set(2.402211969e-1f));
+    p = V::fma(f, p, V::set(6.931469673e-1f));
+    p = V::fma(f, p, V::set(1.000000072f));
+    I bits = V::shiftLeft23(V::addInt(V::toInt(whole), V::setInt(127)));
+    return V::mul(p, V::asFloat(bits));
+  }
+
+  // log2(s) for normal s > 0, 1e-7 absolute error.
+  static F log2(F s) {
+    I bits = V::asInt(s);
+    F e = V::toFloat(V::addInt(V::shiftRight23(bits), V::setInt(-127)));
+    F m = V::asFloat(V::orInt(V::andInt(bits, V::setInt(0x007FFFFF)),
+                              V::setInt(0x3F800000)));
+    // Centre the mantissa on 1 so the atanh series converges quickly.
+    M high = V::greater(m, V::set(1.41421356f));
+    m = V::select(high, V::mul(m, V::set(0.5f)), m);
+    e = V::add(e, V::select(high, V::set(1.0f), V::set(0.0f)));
+
+    // log2(m) = 2 / ln(2) * atanh((m - 1) / (m + 1)), |t| <= 0.172
+    F t = V::div(V::sub(m, V::set(1.0f)), V::add(m, V::set(1.0f)));
+    F t2 = V::mul(t, t);
+    F p = V::fma(t2, V::set(1.0f / 9.0f), V::set(1.0f / 7.0f));
+    p = V::fma(t2, p, V::set(1.0f / 5.0f));
+    p = V::fma(t2, p, V::set(1.0f / 3.0f));
+    p = V::fma(t2, p, V::set(1.0f));
+    return V::fma(V::mul(t, p), V::set(2.88539008f), e);
+  }
+
+  static F pulseEnvelope(F s, F exponent) {
+    F clipped = V::max(s, V::set(1.17549435e-38f));
+    F r = exp2(V::mul(exponent, log2(clipped)));
+    return V::select(V::greater(s, V::set(0.0f)), r, V::set(0.0f));
+  }
+
+  static F saturate(F x) {
+    x = V::max(V::set(-9.0f), V::min(V::set(9.0f), x));
+    F e = exp2(V::mul(x, V::set(2.88539008f)));
+    return V::div(V::sub(e, V::set(1.0f)), V::add(e, V::set(1.0f)));
+  }
+};
+
+// Runs `op` over whole registers, then pads the tail through a scratch
+// register so the kernels never read or write past the caller's arrays.
+template <typename V, typename Op>
+inline void forEachRegister(const float *in, float *out, int numSamples,
+                            Op op) {
+  int i = 0;
+  for (; i + V::width <= numSamples; i += V::width)
+    V::store(out + i, op(V::load(in + i)));
+
+  if (i < numSamples) {
+    float tail[V::width] = {};
+    for (int j = 0; i + j < numSamples; ++j)
+      tail[j] = in[i + j];
+    V::store(tail, op(V::load(tail)));
+    for (int j = 0; i + j < numSamples; ++j)
+      out[i + j] = tail[j];
+  }
+}
+
+template <typename V>
+void fastSine(const float *phase, float *out, int numSamples) {
+  forEachRegister<V>(phase, out, numSamples,
+                     [](typename V::F x) { return FastMath<V>::sine(x); });
+}
+
+template <typename V>
+void fastPulseEnvelope(const float *sine, float exponent, float *out,
+                       int numSamples) {
+  const auto e = V::set(exponent);
+  forEachRegister<V>(sine, out, numSamples, [e](typename V::F s) {
+    return FastMath<V>::pulseEnvelope(s, e);
+  });
+}
+
+// One lane group at a time, so its exponents stay in a register while the
+// frames go by.
+template <typename V>
+void fastPulseEnvelopeLanes(const float *sine, const float *exponent,
+                            int numLanes, float *out, int numFrames) {
+  for (int l = 0; l < numLanes; l += V::width) {
+    const auto e = V::load(exponent + l);
+    for (int f = 0; f < numFrames; ++f) {
+      const int i = f * numLanes + l;
+      V::store(out + i, FastMath<V>::pulseEnvelope(V::load(sine + i), e));
+    }
+  }
+}
+
+template <typename V>
+void fastSaturate(const float *in, float *out, int numSamples) {
+  forEachRegister<V>(in, out, numSamples,
+                     [](typename V::F x) { return FastMath<V>::saturate(x); });
+}
+
+} // namespace
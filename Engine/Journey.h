@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Keyframe automation for journeys. A lane is a list of timestamped values
+// for one parameter; the engine samples it on a coarse control grid and
+// ramps linearly between grid points, so the per-sample cost is the same
+// whatever the curve shapes are.
+
+// How a lane travels from the previous keyframe to this one.
+enum class CurveShape {
+  Linear,
+  // Constant ratio per second, the natural shape for frequencies and gain.
+  // Falls back to linear unless both ends are positive.
+  Exponential,
+  // Keeps the previous value and jumps at the keyframe time.
+  Hold
+};
+
+struct Keyframe {
+  double timeSec;
+  double value;
+  CurveShape curve = CurveShape::Linear;
+};
+
+// Before its first keyframe a lane holds the first value, after its last
+// keyframe the last one. A lane without keyframes is left to the caller.
+class AutomationLane {
+public:
+  // Keyframes with the same time keep the order they were added in, which
+  // makes two keyframes at one time an instant jump.
+  void addKeyframe(double timeSec, double value,
+                   CurveShape curve = CurveShape::Linear) {
+    auto it = std::upper_bound(
+        keyframes.begin(), keyframes.end(), timeSec,
+        [](double t, const Keyframe &k) { return t < k.timeSec; });
+    keyframes.insert(it, {timeSec, value, curve});
+  }
+
+  bool isEmpty() const { return keyframes.empty(); }
+  const std::vector<Keyframe> &getKeyframes() const { return keyframes; }
+
+private:
+  std::vector<Keyframe> keyframes;
+};
+
+struct Journey {
+  AutomationLane pulse, carrier, gain, softness, noiseLevel;
+};
+
+// A lane sampled on the control grid, where tick k sits at sample
+// k * interval. Playback walks forward with a cursor; seeking and the
+// running sum used for phase seeks are closed form per keyframe segment.
+class ControlLane {
+public:
+  // `fallback` is used as a constant when the lane has no keyframes.
+  void prepare(const AutomationLane &lane, double fallback,
+               double ticksPerSecond) {
+    points.clear();
+    for (const auto &k : lane.getKeyframes()) {
+      Point p{k.timeSec * ticksPerSecond, k.value, k.curve, 0.0};
+      points.push_back(p);
+    }
+    if (points.empty())
+      points.push_back({0.0, fallback, CurveShape::Linear, 0.0});
+    // Per-tick log ratio of every exponential segment, zero elsewhere.
+    for (size_t i = 1; i < points.size(); ++i) {
+      auto &a = points[i - 1];
+      auto &b = points[i];
+      if (b.curve == CurveShape::Exponential && a.value > 0.0 &&
+          b.value > 0.0 && b.tick > a.tick)
+        b.logSlope = std::log(b.value / a.value) / (b.tick - a.tick);
+      else if (b.curve == CurveShape::Exponential)
+        b.curve = CurveShape::Linear;
+    }
+    seek(0);
+  }
+
+  // Afterwards current() is the value at `tick` and next() at tick + 1.
+  void seek(int64_t tick) {
+    nextTick = tick;
+    segment = segmentFor(tick);
+    nowValue = evaluate(nextTick++);
+    nextValue = evaluate(nextTick++);
+  }
+
+  void advance() {
+    nowValue = nextValue;
+    nextValue = evaluate(nextTick++);
+  }
+
+  double current() const { return nowValue; }
+  double next() const { return nextValue; }
+
+  double valueAt(int64_t tick) const {
+    return valueIn(segmentFor(tick), tick);
+  }
+
+  // Sum of the values at ticks [0, tick).
+  double sumBefore(int64_t tick) const {
+    // Segment i covers the ticks with points[i - 1].tick <= k < points[i].tick;
+    // segment 0 and the last one hold the end values.
+    double sum = 0.0;
+    int64_t from = 0;
+    for (size_t i = 0; i <= points.size() && from < tick; ++i) {
+      int64_t to = (i < points.size())
+                       ? std::min(tick, firstTickAtOrAfter(points[i].tick))
+                       : tick;
+      if (to > from)
+        sum += segmentSum(i, from, to - from);
+      from = std::max(from, to);
+    }
+    return sum;
+  }
+
+private:
+  struct Point {
+    double tick;
+    double value;
+    CurveShape curve;
+    double logSlope;
+  };
+
+  static int64_t firstTickAtOrAfter(double tick) {
+    return static_cast<int64_t>(std::ceil(tick));
+  }
+
+  // Index of the first point after `tick`.
+  size_t segmentFor(int64_t tick) const {
+    auto it = std::upper_bound(
+        points.begin(), points.end(), (double)tick,
+        [](double t, const Point &p) { return t < p.tick; });
+    return static_cast<size_t>(it - points.begin());
+  }
+
+  double evaluate(int64_t tick) {
+    while (segment < points.size() && points[segment].tick <= (double)tick)
+      ++segment;
+    return valueIn(segment, tick);
+  }
+
+  double valueIn(size_t i, int64_t tick) const {
+    if (i == 0)
+      return points.front().value;
+    if (i == points.size())
+      return points.back().value;
+    const Point &a = points[i - 1];
+    const Point &b = points[i];
+    double offset = (double)tick - a.tick;
+    switch (b.curve) {
+    case CurveShape::Hold:
+      return a.value;
+    case CurveShape::Exponential:
+      return a.value * std::exp(offset * b.logSlope);
+    case CurveShape::Linear:
+      break;
+    }
+    return a.value + offset / (b.tick - a.tick) * (b.value - a.value);
+  }
+
+  // Sum of valueIn(i, k) for k in [first, first + count).
+  double segmentSum(size_t i, int64_t first, int64_t count) const {
+    double n = (double)count;
+    if (i == 0 || i == points.size() || points[i].curve == CurveShape::Hold)
+      return n * valueIn(i, first);
+    const Point &a = points[i - 1];
+    const Point &b = points[i];
+    if (b.curve == CurveShape::Exponential) {
+      if (b.logSlope == 0.0)
+        return n * a.value;
+      return valueIn(i, first) * std::expm1(n * b.logSlope) /
+             std::expm1(b.logSlope);
+    }
+    double offset = (double)first - a.tick;
+    double slope = (b.value - a.value) / (b.tick - a.tick);
+    return n * a.value + slope * (n * offset + n * (n - 1.0) / 2.0);
+  }
+
+  std::vector<Point> points;
+  size_t segment = 0;
+  int64_t nextTick = 0;
+  double nowValue = 0.0, nextValue = 0.0;
+};
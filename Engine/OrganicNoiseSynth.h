@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"). Output is a pure function of (key, counter), so any sample of the
+// stream can be produced without generating the ones before it.
+struct PhiloxNoise {
+  // Four 32-bit words per counter value, for numQuads counters starting at
+  // firstQuad. The rounds run across all lanes at once so the compiler can
+  // vectorise them.
+  static void generate(uint64_t key, uint32_t stream, uint64_t firstQuad,
+                       int numQuads, uint32_t *out) {
+    constexpr int lanes = 16;
+    for (int base = 0; base < numQuads; base += lanes) {
+      const int n = std::min(lanes, numQuads - base);
+      uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+      for (int l = 0; l < lanes; ++l) {
+        uint64_t q = firstQuad + (uint64_t)(base + l);
+        c0[l] = (uint32_t)q;
+        c1[l] = (uint32_t)(q >> 32);
+        c2[l] = stream;
+        c3[l] = 0;
+      }
+      uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+      for (int round = 0; round < 10; ++round) {
+        for (int l = 0; l < lanes; ++l) {
+          uint64_t p0 = (uint64_t)0xD2511F53u * c0[l];
+          uint64_t p1 = (uint64_t)0xCD9E8D57u * c2[l];
+          uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+          uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+          c1[l] = (uint32_t)p1;
+          c3[l] = (uint32_t)p0;
+          c0[l] = n0;
+          c2[l] = n2;
+        }
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+      }
+      for (int l = 0; l < n; ++l) {
+        out[4 * (base + l) + 0] = c0[l];
+        out[4 * (base + l) + 1] = c1[l];
+        out[4 * (base + l) + 2] = c2[l];
+        out[4 * (base + l) + 3] = c3[l];
+      }
+    }
+  }
+};
+
+// --- Organic Noise Synthesizer ---
+class OrganicNoiseSynth {
+public:
+  enum Type { Brown, Pink, White };
+
+  // Channels of one session share the seed and use different streams.
+  void prepare(double sampleRateHz, Type noiseType, float targetEntrainmentFreq,
+               uint64_t seed, uint32_t stream) {
+    this->sampleRate = sampleRateHz;
+    this->type = noiseType;
+    this->key = seed;
+    this->streamId = stream;
+
+    // Contextual LFO: Higher frequencies get faster "shimming" wind
+    // Lower frequencies get slow, heavy wave swells
+    float lfoHz = (targetEntrainmentFreq < 8.0f) ? 0.05f : 0.2f;
+    lfoIncr =
+        (2.0 * juce::MathConstants<double>::pi * (double)lfoHz) / sampleRate;
+    lastOut = 0.0f;
+    filterLast = 0.0f;
+    seek(0);
+  }
+
+  // Jumps to `sampleIndex`. The random stream, the pink rows and the LFO
+  // land exactly where a continuous render would have them; the brown
+  // integrator and the sweep filter settle during the segment warm-up.
+  void seek(int64_t sampleIndex) {
+    position = sampleIndex;
+    pinkSum = 0;
+    for (int row = 0; row < pinkRowCount; ++row) {
+      // The row last changed at the latest t <= position whose lowest set
+      // bit is `row` (see advancePink).
+      const int64_t bit = int64_t(1) << row;
+      pinkRows[row] = 0;
+      if (position >= bit) {
+        int64_t t = ((position - bit) >> (row + 1) << (row + 1)) + bit;
+        pinkRows[row] = uniformAt(t - 1);
+      }
+      pinkSum += pinkRows[row];
+    }
+    lfoGridStart = -1;
+  }
+
+  // Position plus the filter memory that seek() can't rebuild.
+  void saveState(juce::OutputStream &out) const {
+    out.writeInt64(position);
+    out.writeFloat(lastOut);
+    out.writeFloat(filterLast);
+  }
+
+  bool restoreState(juce::InputStream &in) {
+    const int64_t sample = in.readInt64();
+    if (sample < 0)
+      return false;
+    seek(sample);
+    lastOut = in.readFloat();
+    filterLast = in.readFloat();
+    return true;
+  }
+
+  // dst[i] += noise * level[i]
+  void addTo(float *dst, const float *level, int numSamples) {
+    for (int offset = 0; offset < numSamples; offset += chunkSize) {
+      int n = std::min(chunkSize, numSamples - offset);
+      renderChunk(n);
+      for (int i = 0; i < n; ++i)
+        dst[offset + i] += chunk[i] * level[offset + i];
+    }
+  }
+
+  // dst[i] += noise * level
+  void addTo(float *dst, float level, int numSamples) {
+    for (int offset = 0; offset < numSamples; offset += chunkSize) {
+      int n = std::min(chunkSize, numSamples - offset);
+      renderChunk(n);
+      for (int i = 0; i < n; ++i)
+        dst[offset + i] += chunk[i] * level;
+    }
+  }
+
+private:
+  static constexpr int chunkSize = 256;
+  static constexpr int pinkRowCount = 7;
+  // The sweep LFO is evaluated every lfoGrid samples and interpolated in
+  // between; at 0.2 Hz the error is far below a float LSB.
+  static constexpr int lfoGrid = 32;
+  static constexpr float uniformScale = 1.0f / 8388608.0f;
+  // The leaky integrator divides by 1.01 each sample; a multiply keeps the
+  // division off the dependency chain.
+  static constexpr float brownDecay = 1.0f / 1.01f;
+
+  // Signed 24-bit uniform for sample `index`, in [-2^23, 2^23).
+  int32_t uniformAt(int64_t index) const {
+    uint32_t words[4];
+    PhiloxNoise::generate(key, streamId, (uint64_t)index >> 2, 1, words);
+    return (int32_t)(words[index & 3] >> 8) - 8388608;
+  }
+
+  // Voss-McCartney with one row update per sample: sample t-1 refreshes the
+  // row given by the trailing zeros of t, so row k changes every 2^(k+1)
+  // samples. The rows are integers, so the running sum never drifts.
+  int32_t advancePink(int64_t index, int32_t r) {
+    // Trailing zeros, capped at the row count; one step on average.
+    const uint64_t t = (uint64_t)index + 1;
+    int row = 0;
+    while (row < pinkRowCount && ((t >> row) & 1) == 0)
+      ++row;
+    if (row < pinkRowCount) {
+      pinkSum += r - pinkRows[row];
+      pinkRows[row] = r;
+    }
+    return pinkSum;
+  }
+
+  float sweepAlpha(int64_t index) const {
+    const double pi2 = 2.0 * juce::MathConstants<double>::pi;
+    double phase = std::fmod((double)index * lfoIncr, pi2);
+    float lfo = static_cast<float>((std::sin(phase) + 1.0) * 0.5);
+    return 0.005f + (lfo * 0.05f);
+  }
+
+  void renderChunk(int n) {
+    // Raw uniforms for [position, position + n), a whole number of quads.
+    const uint64_t firstQuad = (uint64_t)position >> 2;
+    const int skip = static_cast<int>(position & 3);
+    const int numQuads = (skip + n + 3) / 4;
+    PhiloxNoise::generate(key, streamId, firstQuad, numQuads, words);
+    int32_t *raw = rawScratch;
+    for (int i = 0; i < n; ++i)
+      raw[i] = (int32_t)(words[skip + i] >> 8) - 8388608;
+
+    float *out = chunk;
+    if (type == White) {
+      for (int i = 0; i < n; ++i)
+        out[i] = (float)raw[i] * uniformScale;
+    } else if (type == Brown) {
+      float last = lastOut;
+      for (int i = 0; i < n; ++i) {
+        last = (last + (0.05f * ((float)raw[i] * uniformScale))) * brownDecay;
+        out[i] = last * 3.5f;
+      }
+      lastOut = last;
+    } else {
+      for (int i = 0; i < n; ++i)
+        out[i] = (float)advancePink(position + i, raw[i]) *
+                 (0.12f * uniformScale);
+    }
+
+    // Dynamic Filter: Sweeps the "air" or "depth" of the noise
+    float state = filterLast;
+    for (int i = 0; i < n;) {
+      const int64_t index = position + i;
+      const int64_t grid = index - (index % lfoGrid);
+      if (grid != lfoGridStart) {
+        lfoGridStart = grid;
+        alphaStart = sweepAlpha(grid);
+        alphaStep = (sweepAlpha(grid + lfoGrid) - alphaStart) / (float)lfoGrid;
+      }
+      const int end = static_cast<int>(
+          std::min<int64_t>(n, i + (grid + lfoGrid - index)));
+      for (int k = static_cast<int>(index - grid); i < end; ++i, ++k) {
+        float alpha = alphaStart + alphaStep * (float)k;
+        state = state + alpha * (out[i] - state);
+        out[i] = state;
+      }
+    }
+    filterLast = state;
+    position += n;
+  }
+
+  double sampleRate = 44100.0;
+  Type type = White;
+  uint64_t key = 0;
+  uint32_t streamId = 0;
+  int64_t position = 0;
+  float lastOut = 0.0f;
+  int32_t pinkRows[pinkRowCount] = {0};
+  int32_t pinkSum = 0;
+  float filterLast = 0.0f;
+  double lfoIncr = 0.0;
+  int64_t lfoGridStart = -1;
+  float alphaStart = 0.0f, alphaStep = 0.0f;
+  uint32_t words[chunkSize + 4];
+  int32_t rawScratch[chunkSize];
+  float chunk[chunkSize];
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <juce_core/juce_core.h>
+#include <vector>
+
+enum class ReverbType { Classic, FeedbackDelayNetwork };
+
+// --- Mastering Chain ---
+// Stereo reverb that works a block at a time. Every delay line lives in one
+// arena and is a power of two long, so positions wrap with a mask. Blocks
+// are cut into chunks no longer than the shortest delay: within a chunk no
+// line reads anything it writes, so each stage is a plain loop over the
+// chunk that the compiler can vectorise.
+//
+// Classic is the original four parallel combs into an allpass, run on both
+// channels at once from interleaved lines; it gives the same samples as
+// the old per-sample version. FeedbackDelayNetwork mixes eight lines
+// through a Hadamard matrix for a denser tail of about the same length.
+class StereoReverb {
+public:
+  void prepare(double sampleRateHz, ReverbType reverbType) {
+    type = reverbType;
+    frame = 0;
+    lines.clear();
+    size_t arenaSize = 0;
+    auto addLine = [&](double seconds, int channels) {
+      Line line;
+      line.delay = std::max(1, static_cast<int>(seconds * sampleRateHz));
+      line.channels = channels;
+      lines.push_back(line);
+    };
+
+    if (type == ReverbType::Classic) {
+      // The float constants are part of the sound: they set the exact
+      // delay lengths.
+      for (float t : {0.0297f, 0.0371f, 0.0411f, 0.0437f, 0.005f})
+        addLine(t, 2);
+    } else {
+      const double rt60 = 1.45;
+      for (double t : {0.0297, 0.0371, 0.0411, 0.0437, 0.0319, 0.0353, 0.0391,
+                       0.0463}) {
+        addLine(t, 1);
+        // Per-line loss for the decay time, with the 1/sqrt(8) that makes
+        // the Hadamard mix orthonormal folded in.
+        lines.back().gain = static_cast<float>(
+            std::pow(10.0, -3.0 * lines.back().delay / (rt60 * sampleRateHz)) /
+            std::sqrt(8.0));
+      }
+    }
+
+    int shortest = lines.front().delay;
+    for (const auto &line : lines)
+      shortest = std::min(shortest, line.delay);
+    chunkSize = std::min(maxChunk, shortest);
+
+    // Room for the delay plus one chunk, so a chunk's reads and writes
+    // never overlap.
+    for (auto &line : lines) {
+      size_t frames = 1;
+      while (frames < static_cast<size_t>(line.delay + chunkSize))
+        frames <<= 1;
+      line.mask = frames - 1;
+      line.offset = arenaSize;
+      arenaSize += frames * static_cast<size_t>(line.channels);
+    }
+    arena.assign(arenaSize, 0.0f);
+  }
+
+  // Replaces each sample with dry + wet * wetGain.
+  void process(float *left, float *right, int numSamples, float wetGain) {
+    for (int offset = 0; offset < numSamples; offset += chunkSize) {
+      int n = std::min(chunkSize, numSamples - offset);
+      if (type == ReverbType::Classic)
+        processClassic(left + offset, right + offset, n, wetGain);
+      else
+        processNetwork(left + offset, right + offset, n, wetGain);
+      frame += static_cast<uint64_t>(n);
+    }
+  }
+
+  // The delay line contents and the write position. The layout of the
+  // arena depends on the sample rate and type, so restoring only works on
+  // a reverb prepared the same way.
+  void saveState(juce::OutputStream &out) const {
+    out.writeInt64(static_cast<juce::int64>(frame));
+    out.writeInt64(static_cast<juce::int64>(arena.size()));
+    out.write(arena.data(), arena.size() * sizeof(float));
+  }
+
+  bool restoreState(juce::InputStream &in) {
+    const auto savedFrame = static_cast<uint64_t>(in.readInt64());
+    if (in.readInt64() != static_cast<juce::int64>(arena.size()))
+      return false;
+    const size_t bytes = arena.size() * sizeof(float);
+    if (in.read(arena.data(), bytes) != static_cast<int>(bytes))
+      return false;
+    frame = savedFrame;
+    return true;
+  }
+
+private:
+  static constexpr int maxChunk = 256;
+  static constexpr float combFeedback = 0.84f;
+  static constexpr float allPassGain = 0.7f;
+  static constexpr int numNetworkLines = 8;
+
+  struct Line {
+    size_t offset = 0, mask = 0;
+    int delay = 1;
+    int channels = 1;
+    float gain = 0.0f;
+  };
+
+  // Calls fn(read, write, start, count) over the chunk's runs of
+  // `channels`-wide frames that don't cross the end of the line.
+  template <typename Fn> void forRuns(const Line &line, int n, Fn fn) {
+    float *base = arena.data() + line.offset;
+    const size_t width = static_cast<size_t>(line.channels);
+    for (int done = 0; done < n;) {
+      const size_t w = (frame + (uint64_t)done) & line.mask;
+      const size_t r = (frame + (uint64_t)done - (uint64_t)line.delay) &
+                       line.mask;
+      const int run = static_cast<int>(std::min<size_t>(
+          {static_cast<size_t>(n - done), line.mask + 1 - w,
+           line.mask + 1 - r}));
+      fn(base + r * width, base + w * width, done, run);
+      done += run;
+    }
+  }
+
+  void processClassic(float *left, float *right, int n, float wetGain) {
+    float *in = scratch[0];
+    float *sum = scratch[1];
+    for (int i = 0; i < n; ++i) {
+      in[2 * i] = left[i];
+      in[2 * i + 1] = right[i];
+      sum[2 * i] = 0.0f;
+      sum[2 * i + 1] = 0.0f;
+    }
+    for (int c = 0; c < 4; ++c) {
+      forRuns(lines[(size_t)c], n, [&](const float *rd, float *wr, int start,
+                                       int count) {
+        const float *x = in + 2 * start;
+        float *acc = sum + 2 * start;
+        for (int k = 0; k < 2 * count; ++k) {
+          float out = rd[k];
+          wr[k] = x[k] + (out * combFeedback);
+          acc[k] += out;
+        }
+      });
+    }
+    // The allpass works in place on the comb sum.
+    forRuns(lines[4], n, [&](const float *rd, float *wr, int start,
+                             int count) {
+      float *io = sum + 2 * start;
+      for (int k = 0; k < 2 * count; ++k) {
+        float x = io[k] * 0.25f;
+        float out = -allPassGain * x + rd[k];
+        wr[k] = x + allPassGain * out;
+        io[k] = out;
+      }
+    });
+    for (int i = 0; i < n; ++i) {
+      left[i] = left[i] + sum[2 * i] * wetGain;
+      right[i] = right[i] + sum[2 * i + 1] * wetGain;
+    }
+  }
+
+  void processNetwork(float *left, float *right, int n, float wetGain) {
+    float(*taps)[maxChunk] = networkScratch;
+    for (int j = 0; j < numNetworkLines; ++j)
+      forRuns(lines[(size_t)j], n, [&](const float *rd, float *, int start,
+                                       int count) {
+        std::copy(rd, rd + count, taps[j] + start);
+      });
+
+    // Output taps: even lines to the left, odd lines to the right, with
+    // alternating signs to decorrelate the channels.
+    float *wetL = scratch[0];
+    float *wetR = scratch[1];
+    for (int i = 0; i < n; ++i) {
+      wetL[i] = (taps[0][i] - taps[2][i] + taps[4][i] - taps[6][i]) * outScale;
+      wetR[i] = (taps[1][i] - taps[3][i] + taps[5][i] - taps[7][i]) * outScale;
+    }
+
+    // Fast Walsh-Hadamard transform in place, one butterfly stage at a time.
+    for (int h = 1; h < numNetworkLines; h <<= 1)
+      for (int j = 0; j < numNetworkLines; ++j)
+        if ((j & h) == 0)
+          for (int i = 0; i < n; ++i) {
+            float a = taps[j][i], b = taps[j + h][i];
+            taps[j][i] = a + b;
+            taps[j + h][i] = a - b;
+          }
+
+    for (int j = 0; j < numNetworkLines; ++j) {
+      const float *dry = (j & 1) ? right : left;
+      const float g = lines[(size_t)j].gain;
+      forRuns(lines[(size_t)j], n, [&](const float *, float *wr, int start,
+                                       int count) {
+        for (int k = 0; k < count; ++k)
+          wr[k] = taps[j][start + k] * g + dry[start + k] * inScale;
+      });
+    }
+
+    for (int i = 0; i < n; ++i) {
+      left[i] = left[i] + wetL[i] * wetGain;
+      right[i] = right[i] + wetR[i] * wetGain;
+    }
+  }
+
+  // Levels chosen so the network's wet signal sits close to Classic's.
+  static constexpr float inScale = 0.5f;
+  static constexpr float outScale = 0.53f;
+
+  ReverbType type = ReverbType::Classic;
+  std::vector<Line> lines;
+  std::vector<float> arena;
+  uint64_t frame = 0;
+  int chunkSize = maxChunk;
+  float scratch[2][2 * maxChunk];
+  float networkScratch[numNetworkLines][maxChunk];
+};
@@ -0,0 +1,504 @@
+#pragma once
+
+#include "BlockKernels.h"
+#include "EnvelopeShaper.h"
+#include "Journey.h"
+#include "OrganicNoiseSynth.h"
+#include "StereoReverb.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <memory>
+#include <vector>
+
+// The one synthesis path shared by the plugin and IsochronicBatchGen. Given
+// the same settings and sample rate, binaural output is the same bits in
+// both, whatever block sizes the host or the batch tool use. Isochronic
+// output matches to within 1e-5, because the plugin reads the pulse
+// envelope from an EnvelopeTable and the batch tool computes it exactly.
+
+// Bump this whenever the same settings start producing different samples;
+// it is part of the key of IsochronicBatchGen's render cache.
+constexpr int toneEngineVersion = 2;
+
+enum class EntrainmentMode { Isochronic, Binaural };
+
+// Time spent in each part of render(), summed over every engine that
+// points at it. Engines update it from whichever thread renders them.
+struct StageTimes {
+  enum Stage { Synthesis, Noise, Reverb, Saturation, numStages };
+
+  void add(Stage stage, int64_t ns) {
+    nanoseconds[stage].fetch_add(ns, std::memory_order_relaxed);
+  }
+  double seconds(Stage stage) const {
+    return (double)nanoseconds[stage].load(std::memory_order_relaxed) * 1e-9;
+  }
+
+private:
+  std::array<std::atomic<int64_t>, numStages> nanoseconds{};
+};
+
+struct SessionSettings {
+  double sampleRate = 44100.0;
+  int64_t totalSamples = 0;
+  EntrainmentMode mode = EntrainmentMode::Isochronic;
+  bool isJourney = false;
+  // Double so the batch tool can snap them onto an exact loop period.
+  double pulseFreq = 10.0;
+  double carrierFreq = 440.0;
+  // Journey sessions read every parameter from these lanes; a lane without
+  // keyframes stays at the fixed value below.
+  Journey journey;
+  // Samples between journey control points.
+  int controlInterval = 64;
+  float softness = 0.5f;
+  float gain = 1.0f;
+  int noiseTypeIdx = -1;
+  float noiseLevel = 0.3f;
+  // Noise is a pure function of the seed and the sample index, so equal
+  // seeds give identical renders however they are split up.
+  uint64_t noiseSeed = 0;
+  ReverbType reverb = ReverbType::Classic;
+  const BlockKernels *kernels = &BlockKernels::exact();
+  // If set, every engine made from these settings adds its time per stage
+  // here. It doesn't change the samples.
+  StageTimes *stageTimes = nullptr;
+};
+
+// Runtime face of the engine. Picking the specialisation happens once in
+// createToneEngine; after that the only indirection is one call per block.
+class ToneEngine {
+public:
+  virtual ~ToneEngine() = default;
+
+  // Moves the engine to `sample` without rendering up to it. The
+  // oscillator phases are set in closed form (exactly, for fixed sessions)
+  // and the noise stream jumps ahead exactly; reverb and noise filter
+  // memory is left as is, so callers render a warm-up run before any
+  // output they keep.
+  virtual void seek(int64_t sample) = 0;
+
+  // Fixed sessions only: retunes the engine between blocks
+  // without touching phases or reverb state.
+  virtual void setParameters(float pulseFreq, float carrierFreq,
+                             float softness, float gain) = 0;
+
+  // Fixed isochronic sessions only: takes the pulse envelope from the
+  // shaper's tables instead of the sine and pulse envelope kernels. The
+  // shaper must have a table and outlive its use; nullptr goes back to the
+  // kernels. The plugin uses it.
+  virtual void setEnvelopeShaper(EnvelopeShaper *shaper) = 0;
+
+  // dryL/dryR, if given, are mixed in after the oscillators and noise, so
+  // they share the reverb and saturation. The plugin's layers use it.
+  virtual void render(float *dataL, float *dataR, int numSamples,
+                      const float *dryL = nullptr,
+                      const float *dryR = nullptr) = 0;
+
+  // Writes everything render() carries from one block to the next: the
+  // position, the phase accumulators and the noise and reverb memory. An
+  // engine made from the same settings that restores it renders exactly
+  // the samples this one would have rendered next.
+  virtual void saveState(juce::OutputStream &out) const = 0;
+
+  // Returns false if the state was saved by a different kind of engine.
+  virtual bool restoreState(juce::InputStream &in) = 0;
+};
+
+// Mode, noise and journey are template parameters so that each combination
+// compiles to its own loop with no per-sample checks of session settings.
+template <EntrainmentMode Mode, bool WithNoise, bool IsJourney>
+class IsochronicEngine : public ToneEngine {
+public:
+  explicit IsochronicEngine(const SessionSettings &s) : settings(s) {
+    reverb.prepare(settings.sampleRate, settings.reverb);
+    if constexpr (IsJourney) {
+      const double ticksPerSecond =
+          settings.sampleRate / (double)settings.controlInterval;
+      const auto &journey = settings.journey;
+      pulseLane.prepare(journey.pulse, settings.pulseFreq, ticksPerSecond);
+      carrierLane.prepare(journey.carrier, settings.carrierFreq,
+                          ticksPerSecond);
+      gainLane.prepare(journey.gain, settings.gain, ticksPerSecond);
+      softnessLane.prepare(journey.softness, settings.softness,
+                           ticksPerSecond);
+      noiseLane.prepare(journey.noiseLevel, settings.noiseLevel, ticksPerSecond);
+    }
+    if constexpr (WithNoise) {
+      float basePulse = static_cast<float>(
+          IsJourney ? pulseLane.current() : settings.pulseFreq);
+      auto type = static_cast<OrganicNoiseSynth::Type>(settings.noiseTypeIdx);
+      noiseL.prepare(settings.sampleRate, type, basePulse, settings.noiseSeed,
+                     0);
+      noiseR.prepare(settings.sampleRate, type, basePulse, settings.noiseSeed,
+                     1);
+    }
+  }
+
+  void seek(int64_t sample) override {
+    if constexpr (IsJourney) {
+      // Closed form in double, within about 1e-8 of a cycle of the
+      // accumulated phase even 20 hours in.
+      const double carrierCycles = cyclesBefore(sample, carrierLane);
+      const double pulseCycles = cyclesBefore(sample, pulseLane);
+      if constexpr (Mode == EntrainmentMode::Isochronic) {
+        phaseA = toPhase(carrierCycles);
+        phaseB = toPhase(pulseCycles);
+      } else {
+        phaseA = toPhase(carrierCycles - pulseCycles / 2.0);
+        phaseB = toPhase(carrierCycles + pulseCycles / 2.0);
+      }
+      const int64_t tick = sample / settings.controlInterval;
+      for (auto *lane : {&pulseLane, &carrierLane, &gainLane, &softnessLane,
+                         &noiseLane})
+        lane->seek(tick);
+      tickOffset = static_cast<int>(sample % settings.controlInterval);
+    } else {
+      // Exactly the phase the accumulators reach sample by sample.
+      Phase incrA, incrB;
+      increments(settings.pulseFreq, settings.carrierFreq, incrA, incrB);
+      phaseA = incrA * static_cast<Phase>(sample);
+      phaseB = incrB * static_cast<Phase>(sample);
+    }
+    if constexpr (WithNoise) {
+      noiseL.seek(sample);
+      noiseR.seek(sample);
+    }
+    position = sample;
+  }
+
+  void setParameters(float pulseFreq, float carrierFreq, float softness,
+                     float gain) override {
+    settings.pulseFreq = pulseFreq;
+    settings.carrierFreq = carrierFreq;
+    settings.softness = softness;
+    settings.gain = gain;
+  }
+
+  void setEnvelopeShaper(EnvelopeShaper *newShaper) override {
+    shaper = newShaper;
+  }
+
+  void saveState(juce::OutputStream &out) const override {
+    out.writeInt(toneEngineVersion);
+    out.writeInt64(position);
+    out.writeInt64(static_cast<juce::int64>(phaseA));
+    out.writeInt64(static_cast<juce::int64>(phaseB));
+    if constexpr (WithNoise) {
+      noiseL.saveState(out);
+      noiseR.saveState(out);
+    }
+    reverb.saveState(out);
+  }
+
+  bool restoreState(juce::InputStream &in) override {
+    if (in.readInt() != toneEngineVersion)
+      return false;
+    const int64_t sample = in.readInt64();
+    if (sample < 0)
+      return false;
+    // seek() puts the journey lanes in place; the accumulators are then
+    // replaced by their saved values, which journeys need because seeking
+    // only gets within rounding of them.
+    seek(sample);
+    phaseA = static_cast<Phase>(in.readInt64());
+    phaseB = static_cast<Phase>(in.readInt64());
+    if constexpr (WithNoise) {
+      if (!noiseL.restoreState(in) || !noiseR.restoreState(in))
+        return false;
+    }
+    return reverb.restoreState(in);
+  }
+
+  void render(float *dataL, float *dataR, int numSamples,
+              const float *dryL, const float *dryR) override {
+    // Reverb tails decay into denormals; flushing them keeps the cost flat
+    // and makes every caller see the same bits.
+    juce::ScopedNoDenormals noDenormals;
+    for (int offset = 0; offset < numSamples; offset += kernelBlockSize) {
+      int n = std::min(kernelBlockSize, numSamples - offset);
+      renderBlock(dataL + offset, dataR + offset, n,
+                  dryL ? dryL + offset : nullptr,
+                  dryR ? dryR + offset : nullptr);
+    }
+  }
+
+private:
+  // Small enough that the phase scratch and the output stay in L1.
+  static constexpr int kernelBlockSize = 1024;
+
+  // Phases are 64-bit fractions of a cycle. The wrap is exact, and a fixed
+  // frequency is at n * increment after n samples, so seeking is exact too.
+  using Phase = uint64_t;
+
+  // A phase from a count of cycles, or an increment from cycles per
+  // sample; only the fraction matters, so frequencies past Nyquist fold.
+  static Phase toPhase(double cycles) {
+    cycles -= std::round(cycles);
+    if (cycles >= 0.5)
+      cycles -= 1.0;
+    return static_cast<Phase>(std::llround(std::ldexp(cycles, 64)));
+  }
+
+  // The kernels take radians in [-pi, pi).
+  static float toRadians(Phase phase) {
+    constexpr double scale =
+        juce::MathConstants<double>::pi / 9223372036854775808.0;
+    return static_cast<float>(
+        static_cast<double>(static_cast<int64_t>(phase)) * scale);
+  }
+
+  void renderBlock(float *dataL, float *dataR, int numSamples,
+                   const float *dryL, const float *dryR) {
+    const BlockKernels &kernels = *settings.kernels;
+    float *phasesA = phaseScratchA.data();
+    float *phasesB = phaseScratchB.data();
+
+    // With stage timing on, one clock read per stage and kernel block;
+    // without it, nothing.
+    using Clock = std::chrono::steady_clock;
+    StageTimes *times = settings.stageTimes;
+    Clock::time_point lapStart = times ? Clock::now() : Clock::time_point();
+    auto lap = [&](StageTimes::Stage stage) {
+      if (times == nullptr)
+        return;
+      const auto now = Clock::now();
+      times->add(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            now - lapStart)
+                            .count());
+      lapStart = now;
+    };
+
+    // Phases first. The accumulators are exact, so long sessions don't
+    // drift; the kernels only see the float phase of each sample.
+    int numSpans = 1;
+    if constexpr (IsJourney) {
+      numSpans = journeyPhases(phasesA, phasesB, numSamples);
+    } else {
+      Phase incrA, incrB;
+      increments(settings.pulseFreq, settings.carrierFreq, incrA, incrB);
+      accumulate(phasesA, phasesB, numSamples, incrA, 0, incrB, 0, 0);
+      spans[0] = {0, numSamples, 1.0f + (settings.softness * 4.0f)};
+    }
+
+    // Oscillators, written straight into the output block.
+    kernels.sine(phasesA, dataL, numSamples);
+    if constexpr (Mode == EntrainmentMode::Isochronic) {
+      if (!IsJourney && shaper != nullptr) {
+        shaper->apply(phasesB, dataR, numSamples);
+      } else {
+        kernels.sine(phasesB, dataR, numSamples);
+        for (int s = 0; s < numSpans; ++s)
+          kernels.pulseEnvelope(dataR + spans[s].offset, spans[s].exponent,
+                                dataR + spans[s].offset, spans[s].length);
+      }
+      if constexpr (IsJourney) {
+        const float *gain = gainScratch.data();
+        for (int i = 0; i < numSamples; ++i) {
+          dataL[i] = dataL[i] * dataR[i] * gain[i];
+          dataR[i] = dataL[i];
+        }
+      } else {
+        const float gain = settings.gain;
+        for (int i = 0; i < numSamples; ++i) {
+          dataL[i] = dataL[i] * dataR[i] * gain;
+          dataR[i] = dataL[i];
+        }
+      }
+    } else if constexpr (IsJourney) {
+      kernels.sine(phasesB, dataR, numSamples);
+      const float *gain = gainScratch.data();
+      for (int i = 0; i < numSamples; ++i) {
+        dataL[i] *= gain[i];
+        dataR[i] *= gain[i];
+      }
+    } else {
+      kernels.sine(phasesB, dataR, numSamples);
+      const float gain = settings.gain;
+      for (int i = 0; i < numSamples; ++i) {
+        dataL[i] *= gain;
+        dataR[i] *= gain;
+      }
+    }
+
+    lap(StageTimes::Synthesis);
+
+    if constexpr (WithNoise) {
+      if constexpr (IsJourney) {
+        noiseL.addTo(dataL, noiseScratch.data(), numSamples);
+        noiseR.addTo(dataR, noiseScratch.data(), numSamples);
+      } else {
+        noiseL.addTo(dataL, settings.noiseLevel, numSamples);
+        noiseR.addTo(dataR, settings.noiseLevel, numSamples);
+      }
+      lap(StageTimes::Noise);
+    }
+
+    if (dryL != nullptr) {
+      for (int i = 0; i < numSamples; ++i) {
+        dataL[i] += dryL[i];
+        dataR[i] += dryR[i];
+      }
+    }
+
+    reverb.process(dataL, dataR, numSamples, 0.12f);
+    lap(StageTimes::Reverb);
+
+    kernels.saturate(dataL, dataL, numSamples);
+    kernels.saturate(dataR, dataR, numSamples);
+    lap(StageTimes::Saturation);
+    position += numSamples;
+  }
+
+  // Journey phases for one block, one control tick at a time. Within a
+  // tick every parameter ramps linearly from its value at this tick to the
+  // value at the next, so the increments, gain and noise level are plain
+  // ramps. Returns the number of envelope spans written; softness steps
+  // once per tick.
+  int journeyPhases(float *phasesA, float *phasesB, int numSamples) {
+    const int interval = settings.controlInterval;
+    const double perSample = 1.0 / (double)interval;
+    // Increments ramp by a whole number of units per sample, rounded
+    // towards zero. A tick loses under interval^2 / 2 units to that, about
+    // 1e-16 of a cycle.
+    auto step = [interval](Phase from, Phase to) {
+      return static_cast<Phase>(static_cast<int64_t>(to - from) / interval);
+    };
+    float *gain = gainScratch.data();
+    float *noiseLevel = noiseScratch.data();
+    int numSpans = 0;
+    for (int offset = 0; offset < numSamples;) {
+      int n = std::min(interval - tickOffset, numSamples - offset);
+      Phase incrA, incrB, endA, endB;
+      increments(pulseLane.current(), carrierLane.current(), incrA, incrB);
+      increments(pulseLane.next(), carrierLane.next(), endA, endB);
+      accumulate(phasesA + offset, phasesB + offset, n, incrA,
+                 step(incrA, endA), incrB, step(incrB, endB), tickOffset);
+
+      ramp(gain + offset, n, gainLane, perSample);
+      if constexpr (WithNoise)
+        ramp(noiseLevel + offset, n, noiseLane, perSample);
+      float softness = static_cast<float>(softnessLane.current());
+      spans[numSpans++] = {offset, n, 1.0f + (softness * 4.0f)};
+
+      offset += n;
+      tickOffset += n;
+      if (tickOffset == interval) {
+        tickOffset = 0;
+        for (auto *lane : {&pulseLane, &carrierLane, &gainLane, &softnessLane,
+                           &noiseLane})
+          lane->advance();
+      }
+    }
+    return numSpans;
+  }
+
+  // Sample j of the current tick advances by incr + step * j. Unsigned
+  // overflow is the wrap at the end of each cycle.
+  void accumulate(float *phasesA, float *phasesB, int numSamples,
+                  Phase incrA, Phase stepA, Phase incrB, Phase stepB,
+                  int firstIndex) {
+    for (int i = 0; i < numSamples; ++i) {
+      const Phase j = static_cast<Phase>(firstIndex + i);
+      phasesA[i] = toRadians(phaseA);
+      phaseA += incrA + stepA * j;
+      phasesB[i] = toRadians(phaseB);
+      phaseB += incrB + stepB * j;
+    }
+  }
+
+  void ramp(float *out, int numSamples, const ControlLane &lane,
+            double perSample) const {
+    const double slope = (lane.next() - lane.current()) * perSample;
+    const float start =
+        static_cast<float>(lane.current() + slope * (double)tickOffset);
+    const float step = static_cast<float>(slope);
+    for (int i = 0; i < numSamples; ++i)
+      out[i] = start + step * (float)i;
+  }
+
+  // Per-sample phase increments for oscillator A and B. Isochronic runs
+  // the carrier and the pulse LFO, binaural the left and right carriers.
+  void increments(double pulse, double carrier, Phase &incrA,
+                  Phase &incrB) const {
+    const double sampleRate = settings.sampleRate;
+    if constexpr (Mode == EntrainmentMode::Isochronic) {
+      incrA = toPhase(carrier / sampleRate);
+      incrB = toPhase(pulse / sampleRate);
+    } else {
+      incrA = toPhase((carrier - (pulse / 2.0)) / sampleRate);
+      incrB = toPhase((carrier + (pulse / 2.0)) / sampleRate);
+    }
+  }
+
+  // Sum of f(k) / sampleRate over k in [0, sample), where f ramps
+  // linearly from lane value f[t] at sample t * C to f[t + 1], C being the
+  // control interval. Summing the ramps of whole ticks telescopes to
+  // C * sum(f[0..T)) + (C - 1) / 2 * (f[T] - f[0]).
+  double cyclesBefore(int64_t sample, const ControlLane &lane) const {
+    const int64_t interval = settings.controlInterval;
+    const int64_t tick = sample / interval;
+    const double c = (double)interval;
+    const double r = (double)(sample % interval);
+    double first = lane.valueAt(0);
+    double atTick = lane.valueAt(tick);
+    double afterTick = lane.valueAt(tick + 1);
+    double samples = c * lane.sumBefore(tick) +
+                     (c - 1.0) / 2.0 * (atTick - first) + r * atTick +
+                     (afterTick - atTick) * r * (r - 1.0) / (2.0 * c);
+    return samples / settings.sampleRate;
+  }
+
+  // One pulse envelope run with a single softness exponent.
+  struct Span {
+    int offset, length;
+    float exponent;
+  };
+
+  SessionSettings settings;
+  std::vector<float> phaseScratchA = std::vector<float>(kernelBlockSize);
+  std::vector<float> phaseScratchB = std::vector<float>(kernelBlockSize);
+  // Journey sessions only. Spans worst case is one per sample.
+  std::vector<float> gainScratch =
+      std::vector<float>(IsJourney ? kernelBlockSize : 0);
+  std::vector<float> noiseScratch =
+      std::vector<float>(IsJourney ? kernelBlockSize : 0);
+  std::vector<Span> spans = std::vector<Span>(IsJourney ? kernelBlockSize : 1);
+  ControlLane pulseLane, carrierLane, gainLane, softnessLane, noiseLane;
+  int tickOffset = 0;
+  StereoReverb reverb;
+  EnvelopeShaper *shaper = nullptr;
+  OrganicNoiseSynth noiseL, noiseR;
+  Phase phaseA = 0, phaseB = 0;
+  int64_t position = 0;
+};
+
+namespace detail {
+template <EntrainmentMode Mode, bool WithNoise>
+std::unique_ptr<ToneEngine> createWithNoise(const SessionSettings &s) {
+  if (s.isJourney)
+    return std::make_unique<IsochronicEngine<Mode, WithNoise, true>>(s);
+  return std::make_unique<IsochronicEngine<Mode, WithNoise, false>>(s);
+}
+
+template <EntrainmentMode Mode>
+std::unique_ptr<ToneEngine> createWithMode(const SessionSettings &s) {
+  if (s.noiseTypeIdx >= 0)
+    return createWithNoise<Mode, true>(s);
+  return createWithNoise<Mode, false>(s);
+}
+} // namespace detail
+
+// Allocates, so call it from prepare-time code, never the audio thread.
+inline std::unique_ptr<ToneEngine>
+createToneEngine(const SessionSettings &settings) {
+  if (settings.mode == EntrainmentMode::Binaural)
+    return detail::createWithMode<EntrainmentMode::Binaural>(settings);
+  return detail::createWithMode<EntrainmentMode::Isochronic>(settings);
+}
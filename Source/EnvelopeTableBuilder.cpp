@@ -0,0 +1,78 @@
+#include "EnvelopeTableBuilder.h"
+
+#include <algorithm>
+
+EnvelopeTableBuilder::EnvelopeTableBuilder(
+    std::atomic<float> &softnessParameter)
+    : juce::Thread("Envelope tables"), softness(softnessParameter) {}
+
+EnvelopeTableBuilder::~EnvelopeTableBuilder() { stop(); }
+
+void EnvelopeTableBuilder::start(EnvelopeShaper &shaper,
+                                 bool offlineRender) {
+  stop();
+  shaper = EnvelopeShaper();
+  tables.clear();
+  pending.store(nullptr);
+  retiredFifo.reset();
+
+  builtSoftness = softness.load();
+  tables.push_back(std::make_unique<EnvelopeTable>(builtSoftness));
+  shaper.fadeTo(tables.back().get(), 0);
+  offline = offlineRender;
+  if (!offline)
+    startThread();
+}
+
+void EnvelopeTableBuilder::stop() { stopThread(1000); }
+
+void EnvelopeTableBuilder::update(EnvelopeShaper &shaper, int fadeSamples) {
+  if (const EnvelopeTable *done = shaper.takeRetired()) {
+    int start1, size1, start2, size2;
+    retiredFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 > 0) {
+      retiredSlots[(size_t)start1] = done;
+      retiredFifo.finishedWrite(1);
+    }
+  }
+  if (offline)
+    collect();
+  if (!shaper.isFading())
+    if (EnvelopeTable *next = pending.exchange(nullptr))
+      shaper.fadeTo(next, fadeSamples);
+}
+
+void EnvelopeTableBuilder::reclaim(const EnvelopeTable *table) {
+  tables.erase(std::remove_if(tables.begin(), tables.end(),
+                              [table](const auto &t) {
+                                return t.get() == table;
+                              }),
+               tables.end());
+}
+
+void EnvelopeTableBuilder::run() {
+  while (!threadShouldExit()) {
+    collect();
+    wait(5);
+  }
+}
+
+void EnvelopeTableBuilder::collect() {
+  int start1, size1, start2, size2;
+  retiredFifo.prepareToRead(retiredFifo.getNumReady(), start1, size1, start2,
+                            size2);
+  for (int i = 0; i < size1; ++i)
+    reclaim(retiredSlots[(size_t)(start1 + i)]);
+  for (int i = 0; i < size2; ++i)
+    reclaim(retiredSlots[(size_t)(start2 + i)]);
+  retiredFifo.finishedRead(size1 + size2);
+
+  const float wanted = softness.load();
+  if (wanted != builtSoftness) {
+    builtSoftness = wanted;
+    tables.push_back(std::make_unique<EnvelopeTable>(wanted));
+    // A table the audio thread never took can go straight away.
+    if (EnvelopeTable *stale = pending.exchange(tables.back().get()))
+      reclaim(stale);
+  }
+}
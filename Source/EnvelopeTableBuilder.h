@@ -0,0 +1,58 @@
+#pragma once
+
+#include "EnvelopeShaper.h"
+
+#include <array>
+#include <atomic>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <vector>
+
+// Keeps the plugin's EnvelopeShaper supplied with a table for the current
+// SOFTNESS. A background thread watches the parameter and builds a new
+// table whenever it moves. The thread publishes it with an atomic pointer
+// swap, and the audio thread picks it up between blocks and fades to it.
+// Tables the audio thread has finished with come back through a
+// lock-free FIFO and are freed here, so the audio thread never allocates,
+// frees or waits.
+//
+// Offline, when the host renders faster than realtime, a table built on
+// the thread's schedule would land at a different point in the audio on
+// every run. There the builder has no thread and update() builds the
+// table itself, so a bounce is the same every time.
+class EnvelopeTableBuilder : private juce::Thread {
+public:
+  explicit EnvelopeTableBuilder(std::atomic<float> &softnessParameter);
+  ~EnvelopeTableBuilder() override;
+
+  // Call with the audio thread stopped. Builds the table for the current
+  // softness, gives it to a reset shaper, and starts watching, on the
+  // thread or, when offline, from update().
+  void start(EnvelopeShaper &shaper, bool offlineRender = false);
+  void stop();
+
+  // Audio thread, before each block: hands back the table a finished fade
+  // left behind and starts a fade to the newest table, if there is one.
+  void update(EnvelopeShaper &shaper, int fadeSamples);
+
+private:
+  void run() override;
+  // Frees retired tables and publishes one for a new softness.
+  void collect();
+  void reclaim(const EnvelopeTable *table);
+
+  std::atomic<float> &softness;
+  // Built but not yet taken by the audio thread.
+  std::atomic<EnvelopeTable *> pending{nullptr};
+  // Retired tables on their way back. A fade takes tens of milliseconds
+  // and the thread drains this every few, so it never fills in practice;
+  // if it did, the table would only be freed at the next start or stop.
+  juce::AbstractFifo retiredFifo{32};
+  std::array<const EnvelopeTable *, 32> retiredSlots{};
+  // Every table that exists. Only the builder thread touches this while
+  // it runs.
+  std::vector<std::unique_ptr<EnvelopeTable>> tables;
+  float builtSoftness = 0.0f;
+  // No thread; update() builds the tables.
+  bool offline = false;
+};
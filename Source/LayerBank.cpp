@@ -0,0 +1,238 @@
+#include "LayerBank.h"
+
+#include <algorithm>
+
+namespace {
+
+// Cycles per sample to a 32-bit phase increment; only the fraction matters.
+uint32_t toIncrement(double cyclesPerSample) {
+  const double fraction = cyclesPerSample - std::floor(cyclesPerSample);
+  return static_cast<uint32_t>(
+      static_cast<uint64_t>(std::llround(std::ldexp(fraction, 32))));
+}
+
+// Gains reach about 63% of a new target in this time.
+constexpr double glideSeconds = 0.005;
+
+constexpr int ccLevel = 7;
+constexpr int ccPulse = 20;
+constexpr int ccSoftness = 21;
+constexpr float bendRangeSemitones = 2.0f;
+
+} // namespace
+
+void LayerBank::prepare(double newSampleRate) {
+  sampleRate = newSampleRate;
+  smoothing = static_cast<float>(
+      1.0 - std::exp(-1.0 / (glideSeconds * sampleRate)));
+  kernels = &BlockKernels::fast();
+  const size_t scratchSize = static_cast<size_t>(maxFrames * numLayers);
+  scratchA.assign(scratchSize, 0.0f);
+  scratchB.assign(scratchSize, 0.0f);
+  scratchGain.assign(scratchSize, 0.0f);
+  for (auto &control : controls)
+    control.note = -1;
+  gain.fill(0.0f);
+  for (int l = 0; l < numLayers; ++l)
+    updateLayer(l);
+}
+
+void LayerBank::setBinaural(bool shouldBeBinaural) {
+  if (binaural == shouldBeBinaural)
+    return;
+  binaural = shouldBeBinaural;
+  for (int l = 0; l < numLayers; ++l)
+    updateLayer(l);
+}
+
+void LayerBank::setLayerParameters(int layer, bool enabled, float carrierFreq,
+                                   float pulseFreq, float softness,
+                                   float gainDb) {
+  Control &c = controls[(size_t)layer];
+  const float params[5] = {enabled ? 1.0f : 0.0f, carrierFreq, pulseFreq,
+                           softness, gainDb};
+  bool changed = false;
+  for (int i = 0; i < 5; ++i) {
+    // NaN compares unequal, so the first block applies everything.
+    if (params[i] == c.lastParams[i])
+      continue;
+    c.lastParams[i] = params[i];
+    changed = true;
+    switch (i) {
+    case 0:
+      c.enabled = enabled;
+      break;
+    case 1:
+      c.carrierFreq = carrierFreq;
+      break;
+    case 2:
+      c.pulseFreq = pulseFreq;
+      break;
+    case 3:
+      c.softness = softness;
+      break;
+    case 4:
+      c.level = juce::Decibels::decibelsToGain(gainDb);
+      break;
+    }
+  }
+  if (changed)
+    updateLayer(layer);
+}
+
+bool LayerBank::render(const juce::MidiBuffer &midi, int startSample,
+                       int numSamples, float *outL, float *outR) {
+  const int endSample = startSample + numSamples;
+  bool anySound = false;
+  int position = startSample;
+  auto renderUpTo = [&](int until) {
+    while (position < until) {
+      const int n = std::min(maxFrames, until - position);
+      float *l = outL + (position - startSample);
+      float *r = outR + (position - startSample);
+      if (isSilent()) {
+        std::fill(l, l + n, 0.0f);
+        std::fill(r, r + n, 0.0f);
+      } else {
+        renderFrames(l, r, n);
+        anySound = true;
+      }
+      position += n;
+    }
+  };
+
+  for (auto it = midi.findNextSamplePosition(startSample); it != midi.cend();
+       ++it) {
+    const auto event = *it;
+    if (event.samplePosition >= endSample)
+      break;
+    renderUpTo(std::max(position, event.samplePosition));
+    // Only channel messages matter here. Anything longer is SysEx, which
+    // getMessage() would copy to the heap on the audio thread.
+    if (event.numBytes > 3)
+      continue;
+    handleMidi(event.getMessage());
+  }
+  renderUpTo(endSample);
+  return anySound;
+}
+
+void LayerBank::handleMidi(const juce::MidiMessage &message) {
+  const int channel = message.getChannel();
+  if (channel < 1 || channel > numLayers)
+    return;
+  const int layer = channel - 1;
+  Control &c = controls[(size_t)layer];
+  if (message.isNoteOn()) {
+    c.note = message.getNoteNumber();
+    c.velocity = message.getFloatVelocity();
+  } else if (message.isNoteOff()) {
+    if (message.getNoteNumber() == c.note)
+      c.note = -1;
+  } else if (message.isAllNotesOff() || message.isAllSoundOff()) {
+    c.note = -1;
+  } else if (message.isPitchWheel()) {
+    c.bendSemitones = (float)(message.getPitchWheelValue() - 8192) / 8192.0f *
+                      bendRangeSemitones;
+  } else if (message.isController()) {
+    const float value = (float)message.getControllerValue() / 127.0f;
+    switch (message.getControllerNumber()) {
+    case ccLevel:
+      c.level = juce::Decibels::decibelsToGain(
+          juce::jmap(value, -60.0f, 0.0f), -60.0f);
+      break;
+    case ccPulse:
+      c.pulseFreq = juce::jmap(value, 0.5f, 60.0f);
+      break;
+    case ccSoftness:
+      c.softness = value;
+      break;
+    default:
+      return;
+    }
+  } else {
+    return;
+  }
+  updateLayer(layer);
+}
+
+// Turns a layer's controls into its increments, envelope exponent and
+// target gain, the same way the engine derives its own.
+void LayerBank::updateLayer(int layer) {
+  const Control &c = controls[(size_t)layer];
+  const size_t l = (size_t)layer;
+  const bool held = c.note >= 0;
+  double carrier = c.carrierFreq;
+  if (held)
+    carrier = juce::MidiMessage::getMidiNoteInHertz(c.note) *
+              std::pow(2.0, c.bendSemitones / 12.0);
+  const double pulse = c.pulseFreq;
+  if (binaural) {
+    incrA[l] = toIncrement((carrier - pulse / 2.0) / sampleRate);
+    incrB[l] = toIncrement((carrier + pulse / 2.0) / sampleRate);
+  } else {
+    incrA[l] = toIncrement(carrier / sampleRate);
+    incrB[l] = toIncrement(pulse / sampleRate);
+  }
+  exponent[l] = 1.0f + (c.softness * 4.0f);
+  targetGain[l] =
+      (held || c.enabled) ? c.level * (held ? c.velocity : 1.0f) : 0.0f;
+}
+
+bool LayerBank::isSilent() const {
+  for (int l = 0; l < numLayers; ++l)
+    if (gain[(size_t)l] > 1e-6f || targetGain[(size_t)l] > 0.0f)
+      return false;
+  return true;
+}
+
+void LayerBank::renderFrames(float *outL, float *outR, int numFrames) {
+  constexpr float toRadians =
+      juce::MathConstants<float>::pi / 2147483648.0f;
+  float *a = scratchA.data();
+  float *b = scratchB.data();
+  float *g = scratchGain.data();
+
+  // Phases and gains for every layer of every frame. The inner loops have
+  // a fixed trip count over contiguous arrays and vectorise.
+  for (int f = 0; f < numFrames; ++f) {
+    float *rowA = a + f * numLayers;
+    float *rowB = b + f * numLayers;
+    float *rowG = g + f * numLayers;
+    for (int l = 0; l < numLayers; ++l) {
+      rowA[l] = (float)(int32_t)phaseA[(size_t)l] * toRadians;
+      rowB[l] = (float)(int32_t)phaseB[(size_t)l] * toRadians;
+      phaseA[(size_t)l] += incrA[(size_t)l];
+      phaseB[(size_t)l] += incrB[(size_t)l];
+      rowG[l] = gain[(size_t)l];
+      gain[(size_t)l] += (targetGain[(size_t)l] - gain[(size_t)l]) * smoothing;
+    }
+  }
+
+  const int count = numFrames * numLayers;
+  kernels->sine(a, a, count);
+  kernels->sine(b, b, count);
+
+  if (binaural) {
+    for (int f = 0; f < numFrames; ++f) {
+      const int row = f * numLayers;
+      float left = 0.0f, right = 0.0f;
+      for (int l = 0; l < numLayers; ++l) {
+        left += a[row + l] * g[row + l];
+        right += b[row + l] * g[row + l];
+      }
+      outL[f] = left;
+      outR[f] = right;
+    }
+  } else {
+    kernels->pulseEnvelopeLanes(b, exponent.data(), numLayers, b, numFrames);
+    for (int f = 0; f < numFrames; ++f) {
+      const int row = f * numLayers;
+      float sum = 0.0f;
+      for (int l = 0; l < numLayers; ++l)
+        sum += a[row + l] * b[row + l] * g[row + l];
+      outL[f] = sum;
+      outR[f] = sum;
+    }
+  }
+}
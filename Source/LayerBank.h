@@ -0,0 +1,89 @@
+#pragma once
+
+#include "BlockKernels.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <vector>
+
+// Sixteen extra voices inside the plugin, each with its own carrier, pulse,
+// softness and gain. They render as a dry mix that the processor hands to
+// its ToneEngine, so they share the main voice's reverb and saturation.
+//
+// Layer n is driven by its LAYERn_* parameters and by MIDI channel n:
+// a note sounds the layer at the note's pitch and velocity, pitch bend
+// moves it by up to two semitones, CC 7 sets its level, CC 20 its pulse
+// rate and CC 21 its softness. Events take effect at their sample offset.
+// A parameter that changes takes over from whatever MIDI set last.
+//
+// The hot state is struct-of-arrays, one slot per layer, and the render
+// loops run across layers: phases for every layer of a frame sit next to
+// each other, so the sine and envelope kernels cover all sixteen at once
+// with whatever SIMD width the CPU has. Nothing allocates after prepare().
+class LayerBank {
+public:
+  static constexpr int numLayers = 16;
+
+  // Allocates; call from prepareToPlay.
+  void prepare(double sampleRate);
+
+  void setBinaural(bool shouldBeBinaural);
+
+  // Once per block from the layer's parameters. Only values that differ
+  // from the previous call are applied.
+  void setLayerParameters(int layer, bool enabled, float carrierFreq,
+                          float pulseFreq, float softness, float gainDb);
+
+  // Renders samples [startSample, startSample + numSamples) of the host
+  // block into outL/outR, applying the MIDI events that fall inside it.
+  // Returns false, with the outputs left undefined, if every layer was
+  // silent throughout.
+  bool render(const juce::MidiBuffer &midi, int startSample, int numSamples,
+              float *outL, float *outR);
+
+private:
+  // Frames per kernel pass; the scratch holds this many for every layer.
+  static constexpr int maxFrames = 256;
+
+  // What the parameters and MIDI have said about a layer. Not touched per
+  // sample; updateLayer turns it into the hot arrays below.
+  struct Control {
+    bool enabled = false;
+    int note = -1;
+    float velocity = 1.0f;
+    float bendSemitones = 0.0f;
+    float carrierFreq = 440.0f;
+    float pulseFreq = 10.0f;
+    float softness = 0.5f;
+    float level = 1.0f;
+    // Parameter values seen last block, to spot changes. NaN until the
+    // first block so everything applies once.
+    float lastParams[5] = {NAN, NAN, NAN, NAN, NAN};
+  };
+
+  void handleMidi(const juce::MidiMessage &message);
+  void updateLayer(int layer);
+  void renderFrames(float *outL, float *outR, int numFrames);
+  bool isSilent() const;
+
+  double sampleRate = 44100.0;
+  bool binaural = false;
+  float smoothing = 1.0f;
+  const BlockKernels *kernels = &BlockKernels::exact();
+  std::array<Control, numLayers> controls;
+
+  // Phases are 32-bit fractions of a cycle that wrap on overflow, like the
+  // engine's 64-bit ones; 32 bits is plenty for a few seconds of note and
+  // converts to float in one instruction.
+  alignas(64) std::array<uint32_t, numLayers> phaseA{}, phaseB{};
+  alignas(64) std::array<uint32_t, numLayers> incrA{}, incrB{};
+  // Gains glide to their targets over a few milliseconds so notes start
+  // and stop without clicks.
+  alignas(64) std::array<float, numLayers> gain{}, targetGain{};
+  alignas(64) std::array<float, numLayers> exponent{};
+
+  // [frame * numLayers + layer]
+  std::vector<float> scratchA, scratchB, scratchGain;
+};
@@ -0,0 +1,37 @@
+#include "PerformanceMonitor.h"
+
+bool PerformanceMonitor::writeHistogram(const juce::File &file) const {
+  const double tickSeconds =
+      1.0 / (double)juce::Time::getHighResolutionTicksPerSecond();
+  const uint64_t numBlocks = blocks.load(std::memory_order_relaxed);
+  const uint64_t budget = budgetTicks.load(std::memory_order_relaxed);
+
+  juce::String text;
+  text << "# blocks " << (juce::int64)numBlocks << "\n"
+       << "# near_xruns " << (juce::int64)risky.load(std::memory_order_relaxed)
+       << " (load >= " << riskLoad << ")\n"
+       << "# overruns "
+       << (juce::int64)overruns.load(std::memory_order_relaxed) << "\n"
+       << "# average_load "
+       << (budget > 0 ? (double)busyTicks.load(std::memory_order_relaxed) /
+                            (double)budget
+                      : 0.0)
+       << "\n"
+       << "# worst_load " << worstLoad.load(std::memory_order_relaxed) << "\n"
+       << "# worst_ms "
+       << (double)worstTicks.load(std::memory_order_relaxed) * tickSeconds *
+              1000.0
+       << "\n"
+       << "load_from,load_to,blocks\n";
+  for (int i = 0; i < numBins; ++i) {
+    const double from = (double)i / binsPerBudget;
+    text << from << ",";
+    if (i < numBins - 1)
+      text << (double)(i + 1) / binsPerBudget;
+    else
+      text << "inf";
+    text << "," << (int)histogram[(size_t)i].load(std::memory_order_relaxed)
+         << "\n";
+  }
+  return file.replaceWithText(text);
+}
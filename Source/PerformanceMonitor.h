@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <juce_core/juce_core.h>
+
+// Per-block timing of processBlock. The audio thread only reads the
+// high-resolution clock and does relaxed atomic stores and adds into
+// storage that exists from construction, so recording never allocates or
+// locks. The editor and the histogram dump read the same atomics from
+// other threads.
+//
+// Load is the time a block took over its budget, the block's length in
+// real time. Anything over 1 means the host had to wait for us.
+class PerformanceMonitor {
+public:
+  // Load histogram: bins of 1/64 of the budget up to twice the budget; the
+  // last bin also takes everything slower.
+  static constexpr int binsPerBudget = 64;
+  static constexpr int numBins = 2 * binsPerBudget + 1;
+  // Blocks at or above this load are close enough to an xrun to count.
+  static constexpr float riskLoad = 0.75f;
+
+  // Not thread safe; call while the audio thread is stopped.
+  void prepare(double sampleRate) {
+    ticksPerSample = (double)juce::Time::getHighResolutionTicksPerSecond() /
+                     sampleRate;
+    for (auto &bin : histogram)
+      bin.store(0, std::memory_order_relaxed);
+    for (auto *counter : {&blocks, &risky, &overruns, &busyTicks,
+                          &budgetTicks, &worstTicks})
+      counter->store(0, std::memory_order_relaxed);
+    worstLoad.store(0.0f, std::memory_order_relaxed);
+    recentPeak.store(0.0f, std::memory_order_relaxed);
+  }
+
+  // Audio thread: call at the top of processBlock and pass the result to
+  // blockFinished at the end.
+  static int64_t blockStarted() noexcept {
+    return juce::Time::getHighResolutionTicks();
+  }
+
+  void blockFinished(int64_t startTicks, int numSamples) noexcept {
+    const int64_t elapsed = juce::Time::getHighResolutionTicks() - startTicks;
+    const double budget = ticksPerSample * (double)numSamples;
+    if (numSamples <= 0 || budget <= 0.0)
+      return;
+    const float load = static_cast<float>((double)elapsed / budget);
+
+    const int bin = static_cast<int>(
+        std::min(load * (float)binsPerBudget, (float)(numBins - 1)));
+    histogram[(size_t)bin].fetch_add(1, std::memory_order_relaxed);
+    blocks.fetch_add(1, std::memory_order_relaxed);
+    if (load >= riskLoad)
+      risky.fetch_add(1, std::memory_order_relaxed);
+    if (load >= 1.0f)
+      overruns.fetch_add(1, std::memory_order_relaxed);
+    busyTicks.fetch_add((uint64_t)elapsed, std::memory_order_relaxed);
+    budgetTicks.fetch_add((uint64_t)budget, std::memory_order_relaxed);
+
+    // Only this thread raises the worst case, so a plain store will do.
+    if (load > worstLoad.load(std::memory_order_relaxed))
+      worstLoad.store(load, std::memory_order_relaxed);
+    if ((uint64_t)elapsed > worstTicks.load(std::memory_order_relaxed))
+      worstTicks.store((uint64_t)elapsed, std::memory_order_relaxed);
+    // The reader resets the peak, so raising it has to be a CAS.
+    float peak = recentPeak.load(std::memory_order_relaxed);
+    while (load > peak && !recentPeak.compare_exchange_weak(
+                              peak, load, std::memory_order_relaxed))
+      ;
+  }
+
+  struct Snapshot {
+    uint64_t blocks = 0, risky = 0, overruns = 0;
+    // Running totals; the load over any interval is the ratio of their
+    // differences.
+    uint64_t busyTicks = 0, budgetTicks = 0;
+    float worstLoad = 0.0f;
+    double worstMilliseconds = 0.0;
+    // Highest load since the previous takeSnapshot.
+    float recentPeak = 0.0f;
+  };
+
+  // Any thread but the audio thread. Resets the recent peak, so there
+  // should be one caller polling it (the editor's timer).
+  Snapshot takeSnapshot() {
+    Snapshot s;
+    s.blocks = blocks.load(std::memory_order_relaxed);
+    s.risky = risky.load(std::memory_order_relaxed);
+    s.overruns = overruns.load(std::memory_order_relaxed);
+    s.busyTicks = busyTicks.load(std::memory_order_relaxed);
+    s.budgetTicks = budgetTicks.load(std::memory_order_relaxed);
+    s.worstLoad = worstLoad.load(std::memory_order_relaxed);
+    s.worstMilliseconds =
+        juce::Time::highResolutionTicksToSeconds(
+            (int64_t)worstTicks.load(std::memory_order_relaxed)) *
+        1000.0;
+    s.recentPeak = recentPeak.exchange(0.0f, std::memory_order_relaxed);
+    return s;
+  }
+
+  // Writes the histogram and totals as CSV for offline analysis. Message
+  // thread; the audio thread may keep running, so the counts are a
+  // near-consistent snapshot rather than an exact one.
+  bool writeHistogram(const juce::File &file) const;
+
+private:
+  static_assert(std::atomic<float>::is_always_lock_free &&
+                    std::atomic<uint64_t>::is_always_lock_free,
+                "The audio thread can't take locks");
+
+  double ticksPerSample = 0.0;
+  std::array<std::atomic<uint32_t>, numBins> histogram{};
+  std::atomic<uint64_t> blocks{0}, risky{0}, overruns{0};
+  std::atomic<uint64_t> busyTicks{0}, budgetTicks{0}, worstTicks{0};
+  std::atomic<float> worstLoad{0.0f}, recentPeak{0.0f};
+};
@@ -4,7 +4,7 @@
 IsochronicToneGenEditor::IsochronicToneGenEditor(
     IsochronicToneGenAudioProcessor &p)
     : AudioProcessorEditor(&p), audioProcessor(p) {
-  setSize(400, 300);
+  setSize(400, 380);
 
   auto setupSlider =
       [this](
@@ -32,9 +32,78 @@ IsochronicToneGenEditor::IsochronicToneGenEditor(
   setupSlider(softnessSlider, softnessLabel, "Softness", softnessAttachment,
               "SOFTNESS");
   setupSlider(gainSlider, gainLabel, "Volume (dB)", gainAttachment, "GAIN");
+
+  modeBox.addItemList({"Isochronic", "Binaural"}, 1);
+  addAndMakeVisible(modeBox);
+  modeAttachment =
+      std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(
+          audioProcessor.apvts, "MODE", modeBox);
+
+  saveTimingButton.onClick = [this] { saveTimingHistogram(); };
+  addAndMakeVisible(saveTimingButton);
+
+  lastSnapshot = audioProcessor.getPerformanceMonitor().takeSnapshot();
+  startTimerHz(10);
 }
 
-IsochronicToneGenEditor::~IsochronicToneGenEditor() {}
+IsochronicToneGenEditor::~IsochronicToneGenEditor() { stopTimer(); }
+
+void IsochronicToneGenEditor::timerCallback() {
+  auto snapshot = audioProcessor.getPerformanceMonitor().takeSnapshot();
+  // prepareToPlay starts the totals again.
+  if (snapshot.budgetTicks < lastSnapshot.budgetTicks)
+    lastSnapshot = {};
+  const uint64_t budget = snapshot.budgetTicks - lastSnapshot.budgetTicks;
+  cpuLoad = budget > 0 ? (float)(snapshot.busyTicks - lastSnapshot.busyTicks) /
+                             (float)budget
+                       : 0.0f;
+  peakLoad = std::max(snapshot.recentPeak, peakLoad * 0.85f);
+  lastSnapshot = snapshot;
+  repaint(meterArea);
+}
+
+void IsochronicToneGenEditor::saveTimingHistogram() {
+  timingChooser = std::make_unique<juce::FileChooser>(
+      "Save processBlock timing",
+      juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+          .getChildFile("IsochronicToneGen_timing.csv"),
+      "*.csv");
+  timingChooser->launchAsync(
+      juce::FileBrowserComponent::saveMode |
+          juce::FileBrowserComponent::canSelectFiles |
+          juce::FileBrowserComponent::warnAboutOverwriting,
+      [this](const juce::FileChooser &chooser) {
+        auto file = chooser.getResult();
+        if (file != juce::File())
+          audioProcessor.getPerformanceMonitor().writeHistogram(file);
+      });
+}
+
+// A bar of load against the block budget: green with headroom, amber near
+// the xrun threshold, red past it.
+void IsochronicToneGenEditor::paintMeter(juce::Graphics &g,
+                                         juce::Rectangle<int> area,
+                                         const juce::String &name,
+                                         float load) {
+  g.setColour(juce::Colours::white.withAlpha(0.8f));
+  g.setFont(12.0f);
+  g.drawText(name, area.removeFromLeft(64), juce::Justification::centredLeft);
+  auto label = area.removeFromRight(44);
+  g.drawText(juce::String(juce::roundToInt(load * 100.0f)) + "%", label,
+             juce::Justification::centredRight);
+
+  auto bar = area.reduced(0, 3).toFloat();
+  g.setColour(juce::Colours::white.withAlpha(0.15f));
+  g.fillRoundedRectangle(bar, 3.0f);
+  juce::Colour colour = juce::Colours::limegreen;
+  if (load >= 1.0f)
+    colour = juce::Colours::red;
+  else if (load >= PerformanceMonitor::riskLoad)
+    colour = juce::Colours::orange;
+  g.setColour(colour);
+  g.fillRoundedRectangle(
+      bar.withWidth(bar.getWidth() * juce::jlimit(0.0f, 1.0f, load)), 3.0f);
+}
 
 void IsochronicToneGenEditor::paint(juce::Graphics &g) {
   // Gentle gradient to give it a slightly more modern, less "default" look.
@@ -53,11 +122,31 @@ void IsochronicToneGenEditor::paint(juce::Graphics &g) {
   // Subtle frame around the UI
   g.setColour(juce::Colours::cyan.withAlpha(0.5f));
   g.drawRoundedRectangle(getLocalBounds().reduced(10).toFloat(), 10.0f, 2.0f);
+
+  auto meters = meterArea;
+  paintMeter(g, meters.removeFromTop(18), "CPU", cpuLoad);
+  paintMeter(g, meters.removeFromTop(18), "Xrun risk", peakLoad);
+  g.setColour(juce::Colours::white.withAlpha(0.6f));
+  g.setFont(11.0f);
+  const int worstPercent = juce::roundToInt(lastSnapshot.worstLoad * 100.0f);
+  g.drawText("Worst block " +
+                 juce::String(lastSnapshot.worstMilliseconds, 2) + " ms (" +
+                 juce::String(worstPercent) + "%), " +
+                 juce::String((juce::int64)lastSnapshot.overruns) +
+                 " overruns",
+             meters, juce::Justification::centredLeft);
 }
 
 void IsochronicToneGenEditor::resized() {
   auto area = getLocalBounds().reduced(20);
   area.removeFromTop(40); // Title space
+  meterArea = area.removeFromBottom(52);
+  saveTimingButton.setBounds(
+      meterArea.removeFromRight(90).withSizeKeepingCentre(86, 24));
+  meterArea.removeFromRight(8);
+  area.removeFromBottom(6);
+  modeBox.setBounds(area.removeFromTop(24).withSizeKeepingCentre(160, 24));
+  area.removeFromTop(6);
 
   auto row1 = area.removeFromTop(area.getHeight() / 2);
 
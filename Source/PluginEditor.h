@@ -4,7 +4,8 @@
 #include <juce_audio_utils/juce_audio_utils.h>
 #include <juce_gui_basics/juce_gui_basics.h>
 
-class IsochronicToneGenEditor : public juce::AudioProcessorEditor {
+class IsochronicToneGenEditor : public juce::AudioProcessorEditor,
+                                private juce::Timer {
 public:
   IsochronicToneGenEditor(IsochronicToneGenAudioProcessor &);
   ~IsochronicToneGenEditor() override;
@@ -13,6 +14,12 @@ public:
   void resized() override;
 
 private:
+  // Reads the processor's PerformanceMonitor for the meters.
+  void timerCallback() override;
+  void paintMeter(juce::Graphics &g, juce::Rectangle<int> area,
+                  const juce::String &name, float load);
+  void saveTimingHistogram();
+
   IsochronicToneGenAudioProcessor &audioProcessor;
 
   juce::Slider pulseFreqSlider;
@@ -34,5 +41,18 @@ private:
   juce::Label softnessLabel;
   juce::Label gainLabel;
 
+  juce::ComboBox modeBox;
+  std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment>
+      modeAttachment;
+
+  // CPU load over the last timer interval, and the slowest block in it
+  // with a short hold so single spikes stay visible.
+  PerformanceMonitor::Snapshot lastSnapshot;
+  float cpuLoad = 0.0f;
+  float peakLoad = 0.0f;
+  juce::Rectangle<int> meterArea;
+  juce::TextButton saveTimingButton{"Save timing"};
+  std::unique_ptr<juce::FileChooser> timingChooser;
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(IsochronicToneGenEditor)
 };
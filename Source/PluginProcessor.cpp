@@ -14,9 +14,22 @@ IsochronicToneGenAudioProcessor::IsochronicToneGenAudioProcessor()
               ),
 #endif
       apvts(*this, nullptr, "Parameters", createParameterLayout()) {
+  envelopeTables = std::make_unique<EnvelopeTableBuilder>(
+      *apvts.getRawParameterValue("SOFTNESS"));
+  for (int l = 0; l < LayerBank::numLayers; ++l) {
+    const juce::String prefix = "LAYER" + juce::String(l + 1) + "_";
+    auto param = [&](const char *name) {
+      return apvts.getRawParameterValue(prefix + name);
+    };
+    layerParameters[(size_t)l] = {param("ON"), param("CARRIER"),
+                                  param("PULSE"), param("SOFTNESS"),
+                                  param("GAIN")};
+  }
 }
 
-IsochronicToneGenAudioProcessor::~IsochronicToneGenAudioProcessor() {}
+IsochronicToneGenAudioProcessor::~IsochronicToneGenAudioProcessor() {
+  envelopeTables->stop();
+}
 
 const juce::String IsochronicToneGenAudioProcessor::getName() const {
   return JucePlugin_Name;
@@ -39,9 +52,31 @@ void IsochronicToneGenAudioProcessor::changeProgramName(
 void IsochronicToneGenAudioProcessor::prepareToPlay(double sampleRate,
                                                     int samplesPerBlock) {
   currentSampleRate = sampleRate;
+
+  SessionSettings settings;
+  settings.sampleRate = sampleRate;
+  settings.mode = EntrainmentMode::Isochronic;
+  isochronicEngine = createToneEngine(settings);
+  settings.mode = EntrainmentMode::Binaural;
+  binauralEngine = createToneEngine(settings);
+
+  // Offline renders build softness tables inline, so they repeat exactly.
+  envelopeTables->start(envelopeShaper, isNonRealtime());
+  isochronicEngine->setEnvelopeShaper(&envelopeShaper);
+  // Softness changes fade over 20 ms.
+  envelopeFadeSamples = static_cast<int>(sampleRate * 0.02);
+
+  const size_t scratchSize = static_cast<size_t>(std::max(1, samplesPerBlock));
+  monoScratch.assign(scratchSize, 0.0f);
+  layerScratchL.assign(scratchSize, 0.0f);
+  layerScratchR.assign(scratchSize, 0.0f);
+  layers.prepare(sampleRate);
+  performance.prepare(sampleRate);
 }
 
-void IsochronicToneGenAudioProcessor::releaseResources() {}
+void IsochronicToneGenAudioProcessor::releaseResources() {
+  envelopeTables->stop();
+}
 
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool IsochronicToneGenAudioProcessor::isBusesLayoutSupported(
@@ -55,6 +90,7 @@ bool IsochronicToneGenAudioProcessor::isBusesLayoutSupported(
 
 void IsochronicToneGenAudioProcessor::processBlock(
     juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages) {
+  const auto blockStart = PerformanceMonitor::blockStarted();
   juce::ScopedNoDenormals noDenormals;
   auto totalNumInputChannels = getTotalNumInputChannels();
   auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -68,49 +104,42 @@ void IsochronicToneGenAudioProcessor::processBlock(
   float gain = juce::Decibels::decibelsToGain(
       apvts.getRawParameterValue("GAIN")->load());
 
+  bool binaural = apvts.getRawParameterValue("MODE")->load() > 0.5f;
+
+  auto &engine = binaural ? *binauralEngine : *isochronicEngine;
+  engine.setParameters(pulseFreq, carrierFreq, softness, gain);
+  envelopeTables->update(envelopeShaper, envelopeFadeSamples);
+
+  layers.setBinaural(binaural);
+  for (int l = 0; l < LayerBank::numLayers; ++l) {
+    const auto &p = layerParameters[(size_t)l];
+    layers.setLayerParameters(l, p.enabled->load() > 0.5f, p.carrier->load(),
+                              p.pulse->load(), p.softness->load(),
+                              p.gain->load());
+  }
+
+  // Same engine as IsochronicBatchGen, so while no layer sounds a bounce at
+  // 44.1 kHz matches the batch render of the same settings: bit for bit in
+  // binaural mode, within the envelope tables' 1e-5 in isochronic mode.
+  // Layers render a chunk at a time and go in as the engine's dry input.
   auto *channelDataL = buffer.getWritePointer(0);
   auto *channelDataR =
       totalNumOutputChannels > 1 ? buffer.getWritePointer(1) : nullptr;
-
-  for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
-    // Basic sine wave for the carrier. We might want to swap this for
-    // something richer later, but for now, it's clean.
-    float carrierSample = std::sin(carrierPhase);
-    carrierPhase += (2.0 * juce::MathConstants<double>::pi * carrierFreq) /
-                    currentSampleRate;
-    if (carrierPhase > 2.0 * juce::MathConstants<double>::pi)
-      carrierPhase -= 2.0 * juce::MathConstants<double>::pi;
-
-    // This is where the isochronic effect happens. We modulate the volume
-    // using a sine-based pulse and then shape it.
-    float pulseVal = std::sin(pulsePhase);
-
-    // We smooth out the edges here. If the pulses are too sharp (like a
-    // perfect square), they click and it sounds nasty.
-    float smoothedPulse =
-        std::pow(std::abs(pulseVal), 1.0f - (softness * 0.9f));
-
-    // Only play audio during the positive half of the pulse LFO.
-    if (pulseVal < 0)
-      smoothedPulse = 0;
-
-    pulsePhase +=
-        (2.0 * juce::MathConstants<double>::pi * pulseFreq) / currentSampleRate;
-    if (pulsePhase > 2.0 * juce::MathConstants<double>::pi)
-      pulsePhase -= 2.0 * juce::MathConstants<double>::pi;
-
-    float out = carrierSample * smoothedPulse * gain;
-
-    // Quick soft clipper to prevent the output from slamming the 0dB ceiling.
-    if (out > 0.9f)
-      out = 0.9f + (out - 0.9f) * 0.1f;
-    else if (out < -0.9f)
-      out = -0.9f + (out + 0.9f) * 0.1f;
-
-    channelDataL[sample] = out;
-    if (channelDataR != nullptr)
-      channelDataR[sample] = out;
+  const int numSamples = buffer.getNumSamples();
+  const int chunkSize = static_cast<int>(layerScratchL.size());
+  for (int offset = 0; offset < numSamples; offset += chunkSize) {
+    const int n = std::min(chunkSize, numSamples - offset);
+    const bool layered =
+        layers.render(midiMessages, offset, n, layerScratchL.data(),
+                      layerScratchR.data());
+    // Mono bus: the right channel still has to go somewhere.
+    float *right =
+        channelDataR != nullptr ? channelDataR + offset : monoScratch.data();
+    engine.render(channelDataL + offset, right, n,
+                  layered ? layerScratchL.data() : nullptr,
+                  layered ? layerScratchR.data() : nullptr);
   }
+  performance.blockFinished(blockStart, numSamples);
 }
 
 bool IsochronicToneGenAudioProcessor::hasEditor() const { return true; }
@@ -146,6 +175,24 @@ IsochronicToneGenAudioProcessor::createParameterLayout() {
       "SOFTNESS", "Softness", 0.0f, 1.0f, 0.5f));
   params.push_back(std::make_unique<juce::AudioParameterFloat>(
       "GAIN", "Volume (dB)", -60.0f, 0.0f, -6.0f));
+  params.push_back(std::make_unique<juce::AudioParameterChoice>(
+      "MODE", "Mode", juce::StringArray{"Isochronic", "Binaural"}, 0));
+
+  // Layers are off until enabled here or played from their MIDI channel.
+  for (int l = 1; l <= LayerBank::numLayers; ++l) {
+    const juce::String id = "LAYER" + juce::String(l) + "_";
+    const juce::String name = "Layer " + juce::String(l) + " ";
+    params.push_back(std::make_unique<juce::AudioParameterBool>(
+        id + "ON", name + "On", false));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        id + "CARRIER", name + "Carrier (Hz)", 40.0f, 1000.0f, 440.0f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        id + "PULSE", name + "Entrainment (Hz)", 0.5f, 60.0f, 10.0f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        id + "SOFTNESS", name + "Softness", 0.0f, 1.0f, 0.5f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        id + "GAIN", name + "Volume (dB)", -60.0f, 0.0f, -12.0f));
+  }
 
   return {params.begin(), params.end()};
 }
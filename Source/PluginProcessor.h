@@ -1,5 +1,11 @@
 #pragma once
 
+#include "EnvelopeTableBuilder.h"
+#include "LayerBank.h"
+#include "PerformanceMonitor.h"
+#include "ToneEngine.h"
+
+#include <array>
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_audio_utils/juce_audio_utils.h>
 #include <juce_gui_basics/juce_gui_basics.h>
@@ -39,12 +45,35 @@ public:
 
   juce::AudioProcessorValueTreeState apvts;
 
+  // Timing of every processBlock call, for the editor's meters and for
+  // writeHistogram.
+  PerformanceMonitor &getPerformanceMonitor() { return performance; }
+
 private:
   juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
-  double carrierPhase = 0.0;
-  double pulsePhase = 0.0;
   double currentSampleRate = 44100.0;
 
+  // One engine per mode, both built in prepareToPlay so switching modes
+  // never allocates on the audio thread.
+  std::unique_ptr<ToneEngine> isochronicEngine;
+  std::unique_ptr<ToneEngine> binauralEngine;
+  std::vector<float> monoScratch;
+  PerformanceMonitor performance;
+
+  // The isochronic engine reads its pulse envelope from these tables,
+  // rebuilt off the audio thread when SOFTNESS moves.
+  EnvelopeShaper envelopeShaper;
+  std::unique_ptr<EnvelopeTableBuilder> envelopeTables;
+  int envelopeFadeSamples = 0;
+
+  // The stacked layers and their LAYERn_* parameters, looked up once.
+  struct LayerParameters {
+    std::atomic<float> *enabled, *carrier, *pulse, *softness, *gain;
+  };
+  LayerBank layers;
+  std::array<LayerParameters, LayerBank::numLayers> layerParameters;
+  std::vector<float> layerScratchL, layerScratchR;
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(IsochronicToneGenAudioProcessor)
 };
@@ -2,6 +2,7 @@
 
 BINARY="./build/IsochronicBatchGen"
 OUTPUT_DIR="./renders"
+CACHE_DIR="${RENDER_CACHE:-$OUTPUT_DIR/.cache}"
 mkdir -p "$OUTPUT_DIR"
 
 PULSE_FREQ=${1:-10.0}
@@ -18,13 +19,23 @@ DURATIONS["5hour"]=18000
 DURATIONS["10hour"]=36000
 DURATIONS["20hour"]=72000
 
+file_for() {
+    echo "$OUTPUT_DIR/isochronic_${1}_${PULSE_FREQ}Hz_${CARRIER_FREQ}Hz.wav"
+}
+
+# One render of the longest session feeds every file; the shorter ones are
+# cut from it with a short fade-out instead of being synthesised again.
+EXTRA_OUTPUTS=()
 for NAME in "${!DURATIONS[@]}"; do
-    SECONDS=${DURATIONS[$NAME]}
-    FILE="$OUTPUT_DIR/isochronic_${NAME}_${PULSE_FREQ}Hz_${CARRIER_FREQ}Hz.wav"
-    echo "------------------------------------------------"
-    echo "Rendering $NAME ($SECONDS seconds)..."
-    $BINARY "$FILE" "$SECONDS" "$PULSE_FREQ" "$CARRIER_FREQ" "$SOFTNESS" "$GAIN_DB"
+    if [ "$NAME" != "20hour" ]; then
+        EXTRA_OUTPUTS+=(--also-write "$(file_for "$NAME")" "${DURATIONS[$NAME]}")
+    fi
 done
 
+echo "------------------------------------------------"
+echo "Rendering ${!DURATIONS[*]} in a single pass..."
+$BINARY "$(file_for 20hour)" "${DURATIONS[20hour]}" "$PULSE_FREQ" "$CARRIER_FREQ" "$SOFTNESS" 0 "$GAIN_DB" \
+    "${EXTRA_OUTPUTS[@]}" --fade-out 5 --threads 0 --cache "$CACHE_DIR"
+
 echo "------------------------------------------------"
 echo "All renders complete in $OUTPUT_DIR"
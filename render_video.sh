@@ -9,6 +9,12 @@ fi
 
 BINARY="./build/IsochronicBatchGen"
 OUTPUT_DIR="./renders"
+# Caching is opt-in: a cached render keeps a full copy of the audio, about
+# 19 GB for a 20hour video. Set RENDER_CACHE to a directory to turn it on.
+CACHE_ARGS=()
+if [ -n "$RENDER_CACHE" ]; then
+    CACHE_ARGS=(--cache "$RENDER_CACHE")
+fi
 mkdir -p "$OUTPUT_DIR"
 
 PULSE_FREQ=${1:-10.0}
@@ -23,6 +29,8 @@ NOISE_TYPE=${9:--1}
 NOISE_LEVEL=${10:-0.0}
 BRAND_NAME=${11:-""}
 QR_CODE_PATH=${12:-""}
+BG_AUDIO=${13:-""}
+BG_GAIN_DB=${14:--12.0}
 
 case "$DURATION_NAME" in
     "20min")  SECONDS=1200 ;;
@@ -36,28 +44,20 @@ case "$DURATION_NAME" in
         ;;
 esac
 
-WAV_FILE="$OUTPUT_DIR/temp_audio.wav"
 if [ "$TYPE" -eq 0 ]; then TYPE_NAME="Isochronic"; else TYPE_NAME="Binaural"; fi
 MP4_FILE="$OUTPUT_DIR/${TYPE_NAME}_${DURATION_NAME}_${PULSE_FREQ}Hz.mp4"
 
 # Bash compatibility: avoid ${VAR^^} for old versions
 UPPER_TYPE=$(echo "$TYPE_NAME" | tr '[:lower:]' '[:upper:]')
 
-echo "Step 1: Engineering Pure Mastered Audio..."
-$BINARY "$WAV_FILE" "$SECONDS" "$PULSE_FREQ" "$CARRIER_FREQ" "$SOFTNESS" "$TYPE" "$GAIN_DB" "$NOISE_TYPE" "$NOISE_LEVEL"
-
-if [ ! -s "$WAV_FILE" ]; then
-    echo "Error: Audio generation failed."
-    exit 1
-fi
-
-echo "Step 2: Rendering Visuals..."
+echo "Rendering Pure Mastered Audio and Visuals..."
 
 TEXT="PURE ${PULSE_FREQ}Hz ${UPPER_TYPE} TONE"
 
 # We'll build the filter complex step by step
 # 0:v is the black background
 # 1:v is the QR code if it exists, otherwise 1:a is the audio
+# The audio is streamed from the generator on stdin, so no temp file is needed
 V_FILTER="[0:v]drawtext=text='$TEXT':fontcolor=white:fontsize=120:x=(w-text_w)/2:y=(h-text_h)/2"
 
 if [ -n "$BRAND_NAME" ]; then
@@ -66,21 +66,38 @@ fi
 
 if [ -f "$QR_CODE_PATH" ]; then
     # With QR: input 1 is the image, input 2 is the audio
-    FF_INPUTS="-f lavfi -i color=c=black:s=3840x2160:r=24 -i $QR_CODE_PATH -i $WAV_FILE"
+    FF_INPUTS="-f lavfi -i color=c=black:s=3840x2160:r=24 -i $QR_CODE_PATH -f wav -i pipe:0"
     # Scale and overlay QR [1:v]
     V_COMPLEX="$V_FILTER[base];[1:v]scale=300:300,format=rgba,colorchannelmixer=aa=0.5[qr];[base][qr]overlay=W-w-100:H-h-100"
     A_MAP="-map 2:a"
 else
     # Without QR: input 1 is the audio
-    FF_INPUTS="-f lavfi -i color=c=black:s=3840x2160:r=24 -i $WAV_FILE"
+    FF_INPUTS="-f lavfi -i color=c=black:s=3840x2160:r=24 -f wav -i pipe:0"
     V_COMPLEX="$V_FILTER"
     A_MAP="-map 1:a"
 fi
 
+# A background bed is mixed in by the generator itself, so the audio still
+# reaches ffmpeg as a single stream
+MIX_ARGS=()
+if [ -f "$BG_AUDIO" ]; then
+    MIX_ARGS=(--mix "$BG_AUDIO" "$BG_GAIN_DB")
+fi
+
+$BINARY - "$SECONDS" "$PULSE_FREQ" "$CARRIER_FREQ" "$SOFTNESS" "$TYPE" "$GAIN_DB" "$NOISE_TYPE" "$NOISE_LEVEL" --stream wav "${CACHE_ARGS[@]}" "${MIX_ARGS[@]}" | \
 ffmpeg -y $FF_INPUTS -filter_complex "$V_COMPLEX" \
     -map 0:v $A_MAP \
     -c:v libx264 -preset ultrafast -tune stillimage -crf 22 -pix_fmt yuv420p \
     -c:a aac -b:a 320k -shortest "$MP4_FILE"
 
-rm "$WAV_FILE"
+STATUS=("${PIPESTATUS[@]}")
+if [ "${STATUS[0]}" -ne 0 ]; then
+    echo "Error: Audio generation failed."
+    exit 1
+fi
+if [ "${STATUS[1]}" -ne 0 ]; then
+    echo "Error: Video encoding failed."
+    exit 1
+fi
+
 echo "Production Complete: $MP4_FILE"
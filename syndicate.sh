@@ -34,12 +34,10 @@ echo "------------------------------------------------"
 echo "Step 1: Generating Narration..."
 # We take the first 5 mins for this demo to be fast
 head -c 5000 wisdom_text.txt > narration_input.txt
+# The generator reads the AIFF directly and resamples it, so there's no
+# conversion pass
 say -v "Daniel" -f narration_input.txt -o narration_temp.aiff
-ffmpeg -y -i narration_temp.aiff -ar 44100 narration_final.wav > /dev/null 2>&1
-rm narration_temp.aiff narration_input.txt
-
-# Get duration of narration to match the tone
-SEC=$(ffprobe -i narration_final.wav -show_entries format=duration -v quiet -of csv='p=0' | cut -d. -f1)
+rm narration_input.txt
 
 # 4. Select Brainwave Sync
 echo "------------------------------------------------"
@@ -56,14 +54,9 @@ case "$B_STATE" in
     *) FREQ="10.0"; NAME="Deep Learning" ;;
 esac
 
-# 5. Generate Tones
-echo "------------------------------------------------"
-echo "Step 3: Engineering Background Tones..."
-$BINARY "tones_temp.wav" "$SEC" "$FREQ" "440.0" "0.5" "1" "-15.0" "-1" "0.0"
-
-# 6. Render Final Video (Minimalist 4K + Narration + Tones)
+# 5. Render Final Video (Minimalist 4K + Narration + Tones)
 echo "------------------------------------------------"
-echo "Step 4: Mastering 4K Meditative Audiobook..."
+echo "Step 3: Mastering 4K Meditative Audiobook..."
 # Remove spaces for filename compatibility
 CLEAN_TITLE=$(echo $TITLE | sed 's/ /_/g')
 CLEAN_NAME=$(echo $NAME | sed 's/ /_/g')
@@ -73,14 +66,19 @@ MP4_FILE="$OUTPUT_DIR/${CLEAN_TITLE}_${CLEAN_NAME}.mp4"
 TEXT="$TITLE by $AUTHOR"
 METRICS="Mode $NAME - Frequency ${FREQ}Hz"
 
-ffmpeg -y -f lavfi -i color=c=black:s=3840x2160:r=24 -i narration_final.wav -i tones_temp.wav \
-    -filter_complex "[1:a][2:a]amix=inputs=2:duration=first:dropout_transition=2[aout];[0:v]drawtext=text='$TEXT':fontcolor=white:fontsize=120:x=(w-text_w)/2:y=(h-text_h)/2-100,drawtext=text='$METRICS':fontcolor=white@0.4:fontsize=50:x=(w-text_w)/2:y=(h-text_h)/2+100[vout]" \
-    -map "[vout]" -map "[aout]" \
+# The generator mixes the narration over the tones, ducking them while it
+# speaks, and streams the result straight into the encoder. The session is
+# as long as the narration.
+$BINARY - auto "$FREQ" "440.0" "0.5" "1" "-15.0" "-1" "0.0" \
+    --narration narration_temp.aiff 0 --stream wav | \
+ffmpeg -y -f lavfi -i color=c=black:s=3840x2160:r=24 -f wav -i pipe:0 \
+    -filter_complex "[0:v]drawtext=text='$TEXT':fontcolor=white:fontsize=120:x=(w-text_w)/2:y=(h-text_h)/2-100,drawtext=text='$METRICS':fontcolor=white@0.4:fontsize=50:x=(w-text_w)/2:y=(h-text_h)/2+100[vout]" \
+    -map "[vout]" -map 1:a \
     -c:v libx264 -preset fast -tune stillimage -crf 22 -pix_fmt yuv420p \
-    -c:a aac -b:a 320k "$MP4_FILE"
+    -c:a aac -b:a 320k -shortest "$MP4_FILE"
 
 # Cleanup
-rm tones_temp.wav narration_final.wav wisdom_text.txt
+rm narration_temp.aiff wisdom_text.txt
 echo "------------------------------------------------"
 echo "PRODUCTION COMPLETE"
 echo "Video saved to: $MP4_FILE"